@@ -459,6 +459,20 @@ void ether_stop_udp_thread(void)
 }
 
 
+/*
+ *  Send packet to UDP tunnel peer
+ */
+
+int16 ether_udp_write(const uint8 *packet, int length, const struct sockaddr_in *to)
+{
+	if (sendto(fd, packet, length, 0, (struct sockaddr *)to, sizeof(*to)) < 0) {
+		D(bug("WARNING: Couldn't transmit packet\n"));
+		return excessCollsns;
+	}
+	return noErr;
+}
+
+
 /*
  *  Ethernet interrupt - activate deferred tasks to call IODone or protocol handlers
  */
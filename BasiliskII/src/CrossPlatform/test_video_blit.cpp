@@ -0,0 +1,145 @@
+/*
+ *  test_video_blit.cpp - Check and time the vectorized blitters
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  Every entry of Screen_blitters_simd[] is run against its generic
+ *  counterpart on random data: the output must be identical, and the
+ *  throughput of both is reported in source megabytes per second.
+ *
+ *  Usage: test-video-blit [iterations]
+ */
+
+#include "sysdeps.h"
+
+#include <string.h>
+#include <sys/time.h>
+
+// The blitters don't need any SDL surface
+#undef USE_SDL_VIDEO
+#include "video_blit.cpp"
+
+// Source row length, in bytes (a 1024 pixels 32-bit row, plus an odd tail)
+const uint32 SRC_LENGTH = 4096 + 13;
+
+// Largest expansion factor (1-bit to 32-bit)
+const uint32 DEST_LENGTH = SRC_LENGTH * 32;
+
+static double get_time(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static double time_blitter(Screen_blit_func blit, uint8 *dest, const uint8 *src, int iterations)
+{
+	double start = get_time();
+	for (int i = 0; i < iterations; i++)
+		blit(dest, src, SRC_LENGTH);
+	double elapsed = get_time() - start;
+	return (double)SRC_LENGTH * iterations / (elapsed * 1e6);
+}
+
+// Name the generic blitters for the report
+static const char *blitter_name(Screen_blit_func blit)
+{
+#define BLITTER_NAME(NAME) if (blit == NAME) return #NAME
+	BLITTER_NAME(Blit_Expand_1_To_16);
+	BLITTER_NAME(Blit_Expand_1_To_32);
+	BLITTER_NAME(Blit_Expand_2_To_16);
+	BLITTER_NAME(Blit_Expand_2_To_32);
+	BLITTER_NAME(Blit_Expand_4_To_16);
+	BLITTER_NAME(Blit_Expand_4_To_32);
+	BLITTER_NAME(Blit_Expand_8_To_16);
+	BLITTER_NAME(Blit_Expand_8_To_32);
+	BLITTER_NAME(Blit_RGB555_NBO);
+	BLITTER_NAME(Blit_BGR555_NBO);
+	BLITTER_NAME(Blit_RGB565_NBO);
+	BLITTER_NAME(Blit_RGB888_NBO);
+	BLITTER_NAME(Blit_BGR888_NBO);
+#undef BLITTER_NAME
+	return "?";
+}
+
+int main(int argc, char *argv[])
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+	if (iterations <= 0)
+		iterations = 1;
+
+	uint8 *src = (uint8 *)malloc(SRC_LENGTH);
+	uint8 *dest_ref = (uint8 *)malloc(DEST_LENGTH);
+	uint8 *dest_simd = (uint8 *)malloc(DEST_LENGTH);
+	if (src == NULL || dest_ref == NULL || dest_simd == NULL) {
+		fprintf(stderr, "Not enough memory\n");
+		return 1;
+	}
+
+	// Random source pixels, and a palette repeated over the expansion
+	// map (as the video drivers set it up for 2/4-bit modes)
+	srand(1);
+	for (uint32 i = 0; i < SRC_LENGTH; i++)
+		src[i] = rand();
+	uint32 palette[16];
+	for (int i = 0; i < 16; i++)
+		palette[i] = (rand() << 16) ^ rand();
+
+	const uint32 features = Screen_blitter_simd_features();
+	printf("SIMD features:%s%s%s\n",
+		features & BLIT_SIMD_SSE2 ? " SSE2" : "",
+		features & BLIT_SIMD_SSSE3 ? " SSSE3" : "",
+		features & BLIT_SIMD_AVX2 ? " AVX2" : "");
+
+	int errors = 0;
+	for (const Screen_blit_simd_info *b = Screen_blitters_simd; b->handler; b++) {
+		const char *name = blitter_name(b->handler);
+		if ((b->features & features) != b->features) {
+			printf("%-22s skipped (unsupported CPU)\n", name);
+			continue;
+		}
+
+		// 8-bit blitters get a full 256-color map, 2-bit blitters repeat 4 colors
+		int num_colors = 16;
+		if (b->handler == Blit_Expand_8_To_16 || b->handler == Blit_Expand_8_To_32)
+			num_colors = 256;
+		else if (b->handler == Blit_Expand_2_To_16 || b->handler == Blit_Expand_2_To_32)
+			num_colors = 4;
+		for (int i = 0; i < 256; i++)
+			ExpandMap[i] = num_colors == 256 ? (rand() << 16) ^ rand() : palette[i & (num_colors - 1)];
+		memset(dest_ref, 0, DEST_LENGTH);
+		memset(dest_simd, 0, DEST_LENGTH);
+		b->handler(dest_ref, src, SRC_LENGTH);
+		b->handler_simd(dest_simd, src, SRC_LENGTH);
+		if (memcmp(dest_ref, dest_simd, DEST_LENGTH) != 0) {
+			printf("%-22s MISMATCH\n", name);
+			errors++;
+			continue;
+		}
+
+		const double mb_ref = time_blitter(b->handler, dest_ref, src, iterations);
+		const double mb_simd = time_blitter(b->handler_simd, dest_simd, src, iterations);
+		printf("%-22s %8.1f MB/s -> %8.1f MB/s (x%.2f)\n", name, mb_ref, mb_simd, mb_simd / mb_ref);
+	}
+
+	free(src);
+	free(dest_ref);
+	free(dest_simd);
+	return errors ? 1 : 0;
+}
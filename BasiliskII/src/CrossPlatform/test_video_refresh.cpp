@@ -0,0 +1,461 @@
+/*
+ *  test_video_refresh.cpp - Benchmark the video refresh strategies
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  Synthetic MacOS drawing workloads (scrolling, a blinking cursor, full
+ *  screen video, a window drag and a clock and progress bar in opposite
+ *  corners) are run on a frame buffer of every depth
+ *  and resolution. After each frame, the changes are converted with
+ *  Screen_blit into a null output surface (a host buffer that is never
+ *  displayed) by one of the refresh strategies:
+ *
+ *    vosf      page tracking through write faults, dirty lines converted
+ *              (update_display_window_vosf)
+ *    vosf-dga  page tracking, dirty lines compared in 64 pixel chunks with
+ *              a copy of the frame buffer (update_display_dga_vosf)
+ *    static    bounding box of the changed lines and columns, found by
+ *              comparing with a copy of the frame buffer (update_static_bbox)
+ *    tiles     hashes of 64x16 pixel tiles, only changed tiles compared
+ *              with the copy of the frame buffer (update_static_tiles)
+ *    auto      static or tiles, whichever is estimated to be cheaper
+ *              (update_static, the default of the X11 driver)
+ *
+ *  The static strategies are the ones of the X11 driver, from video_static.h.
+ *
+ *  Reported per frame: time spent drawing (including the write faults),
+ *  time spent in the refresh, and bytes read and written by the refresh.
+ *
+ *  Usage: test-video-refresh [frames]
+ */
+
+#include "sysdeps.h"
+
+#include <assert.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "video.h"
+
+// Null output surface
+struct test_surface_desc {
+	int depth;
+	int width, height;
+	int row_bytes;
+};
+static test_surface_desc test_surface;
+
+// Glue for video_vosf.h
+struct test_monitor_desc {
+	video_mode mode;
+	const video_mode &get_current_mode(void) const {return mode;}
+};
+static test_monitor_desc monitor;
+static test_monitor_desc *drv = &monitor;
+
+static uint8 *the_buffer = NULL;		// Mac frame buffer
+static uint8 *the_buffer_copy = NULL;	// Copy of Mac frame buffer
+static uint32 the_buffer_size;			// Size of allocated the_buffer
+static int frame_skip = 1;
+
+#define DEBUG 0
+#include "debug.h"
+
+// The blitters don't need any SDL surface
+#undef USE_SDL_VIDEO
+#include "video_blit.cpp"
+
+#define TEST_VOSF_PERFORMANCE 1
+#ifndef ENABLE_VOSF
+#define ENABLE_VOSF 1
+#endif
+#include "video_vosf.h"
+
+uint64 GetTicks_usec(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static sigsegv_return_t sigsegv_handler(sigsegv_info_t *sip)
+{
+	if (Screen_fault_handler(sip))
+		return SIGSEGV_RETURN_SUCCESS;
+	return SIGSEGV_RETURN_FAILURE;
+}
+
+
+/*
+ *  Synthetic workloads
+ */
+
+enum {
+	WORK_SCROLL,		// Text scrolling up by one line each frame
+	WORK_CURSOR,		// Text cursor blinking twice per second
+	WORK_VIDEO,			// Full screen video
+	WORK_DRAG,			// 320x240 window dragged across the screen
+	WORK_CORNERS,		// Clock in the top right and progress bar in the bottom left corner
+	NUM_WORKLOADS
+};
+
+static const char *workload_names[NUM_WORKLOADS] = {
+	"scroll", "cursor", "video", "drag", "corners"
+};
+
+static uint32 random_state = 1;
+
+static inline uint32 random32(void)
+{
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 17;
+	random_state ^= random_state << 5;
+	return random_state;
+}
+
+// Fill a rectangle, in bytes of the frame buffer
+static void fill_bytes(int x, int y, int w, int h, uint8 value)
+{
+	const video_mode &mode = monitor.mode;
+	for (int j = y; j < y + h; j++)
+		memset(the_buffer + j * mode.bytes_per_row + x, value, w);
+}
+
+static void draw_desktop(void)
+{
+	const video_mode &mode = monitor.mode;
+	for (uint32 j = 0; j < mode.y; j++)
+		memset(the_buffer + j * mode.bytes_per_row, (j & 1) ? 0x55 : 0xaa, mode.bytes_per_row);
+}
+
+static void draw_frame(int workload, int frame)
+{
+	const video_mode &mode = monitor.mode;
+	const int bytes_per_row = mode.bytes_per_row;
+	const int bits = mode.bytes_per_row * 8 / mode.x;
+	const int line_height = 16;
+
+	switch (workload) {
+	case WORK_SCROLL:
+		memmove(the_buffer, the_buffer + line_height * bytes_per_row, (mode.y - line_height) * bytes_per_row);
+		for (uint32 j = mode.y - line_height; j < mode.y; j++) {
+			uint8 *p = the_buffer + j * bytes_per_row;
+			for (int i = 0; i < bytes_per_row; i += 4) {
+				const uint32 v = random32();
+				memcpy(p + i, &v, 4);
+			}
+		}
+		break;
+	case WORK_CURSOR:
+		if (frame % 30 == 0) {
+			const int x = 200 * bits / 8, w = (2 * bits + 7) / 8;
+			for (int j = 100; j < 100 + line_height; j++)
+				for (int i = x; i < x + w; i++)
+					the_buffer[j * bytes_per_row + i] ^= 0xff;
+		}
+		break;
+	case WORK_VIDEO:
+		for (uint32 i = 0; i < mode.y * bytes_per_row; i += 4) {
+			const uint32 v = random32();
+			memcpy(the_buffer + i, &v, 4);
+		}
+		break;
+	case WORK_DRAG: {
+		const int w = 320 * bits / 8, h = 240;
+		const int step_x = bits, step_y = 4;	// 8 pixels, 4 lines
+		const int range_x = bytes_per_row - w, range_y = mode.y - h;
+		const int old_x = ((frame - 1) * step_x) % range_x, old_y = ((frame - 1) * step_y) % range_y;
+		const int x = (frame * step_x) % range_x, y = (frame * step_y) % range_y;
+		if (frame > 0) {
+			for (int j = old_y; j < old_y + h; j++)
+				memset(the_buffer + j * bytes_per_row + old_x, (j & 1) ? 0x55 : 0xaa, w);
+		}
+		fill_bytes(x, y, w, h, 0xff);
+		fill_bytes(x, y, w, 20, 0x33);
+		break;
+	}
+	case WORK_CORNERS: {
+		const int clock_w = 64 * bits / 8, bar_w = 200 * bits / 8;
+		fill_bytes(bytes_per_row - 2 * clock_w, 2, clock_w, line_height, frame);
+		fill_bytes(8 * bits / 8, mode.y - 2 * line_height, (frame % 100 + 1) * bar_w / 100, line_height, 0xff);
+		break;
+	}
+	}
+}
+
+
+/*
+ *  Refresh strategies
+ */
+
+enum {
+	REFRESH_VOSF,
+	REFRESH_VOSF_DGA,
+	REFRESH_STATIC,
+	REFRESH_TILES,
+	REFRESH_AUTO,
+	NUM_STRATEGIES
+};
+
+static const char *strategy_names[NUM_STRATEGIES] = {
+	"vosf", "vosf-dga", "static", "tiles", "auto"
+};
+
+static uint64 bytes_touched;			// Bytes read and written by the refresh
+
+// Convert lines [y1, y2] from byte x1 to byte x2 of the frame buffer to the output surface
+static void blit_area(int x1, int x2, int y1, int y2)
+{
+	const video_mode &mode = monitor.mode;
+	const int src_bytes_per_row = mode.bytes_per_row;
+	const int dst_bytes_per_row = test_surface.row_bytes;
+	const int dst_x = (int64)x1 * dst_bytes_per_row / src_bytes_per_row;
+	for (int j = y1; j <= y2; j++)
+		Screen_blit(the_host_buffer + j * dst_bytes_per_row + dst_x, the_buffer + j * src_bytes_per_row + x1, x2 - x1);
+	bytes_touched += (uint64)(y2 - y1 + 1) * (x2 - x1) * (1 + dst_bytes_per_row / src_bytes_per_row);
+}
+
+// Static refresh strategies of the X11 driver
+#define VIDEO_STATIC_DRV test_monitor_desc
+#define VIDEO_STATIC_COUNT(bytes) (bytes_touched += (bytes))
+#include "video_static.h"
+
+static void update_static_area(test_monitor_desc *drv, int x1, int x2, int y1, int y2)
+{
+	blit_area(x1, x2, y1, y2);
+}
+
+
+/*
+ *  Bytes touched by the page tracking refresh functions (computed before
+ *  they run, from the dirty pages)
+ */
+
+static void count_vosf_bytes(bool dga)
+{
+	const video_mode &mode = monitor.mode;
+	const int src_bytes_per_row = mode.bytes_per_row;
+	const int dst_bytes_per_row = test_surface.row_bytes;
+	const int chunk = TrivialBytesPerRow(64, mode.depth);
+
+	unsigned page = 0;
+	for (;;) {
+		const unsigned first_page = find_next_page_set(page);
+		if (first_page >= mainBuffer.pageCount)
+			break;
+		page = find_next_page_clear(first_page);
+		const int y1 = mainBuffer.pageInfo[first_page].top;
+		const int y2 = mainBuffer.pageInfo[page - 1].bottom;
+		if (!dga) {
+			bytes_touched += (uint64)(y2 - y1 + 1) * (src_bytes_per_row + dst_bytes_per_row);
+			continue;
+		}
+		for (int j = y1; j <= y2; j++) {
+			for (int i = 0; i < src_bytes_per_row; i += chunk) {
+				const int n = (i + chunk <= src_bytes_per_row) ? chunk : src_bytes_per_row - i;
+				const int offset = j * src_bytes_per_row + i;
+				bytes_touched += 2 * n;
+				if (memcmp(the_buffer + offset, the_buffer_copy + offset, n))
+					bytes_touched += 2 * n + n * dst_bytes_per_row / src_bytes_per_row;
+			}
+		}
+	}
+}
+
+
+/*
+ *  Benchmark one workload with one refresh strategy
+ */
+
+static double get_time(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static void run_benchmark(int workload, int strategy, int frames, double &draw_us, double &refresh_us, double &bytes)
+{
+	const video_mode &mode = monitor.mode;
+	const bool vosf = (strategy == REFRESH_VOSF || strategy == REFRESH_VOSF_DGA);
+
+	// Start from the same desktop, fully displayed
+	random_state = 1;
+	draw_desktop();
+	memcpy(the_buffer_copy, the_buffer, mode.y * mode.bytes_per_row);
+	tile_hashes_valid = false;
+	update_static_tiles(drv, mode);
+	static_use_tiles = false;
+	static_tiles_holdoff = 0;
+	if (vosf && !video_vosf_init()) {
+		fprintf(stderr, "Could not initialize VOSF\n");
+		exit(1);
+	}
+
+	double draw_time = 0, refresh_time = 0;
+	bytes_touched = 0;
+	for (int frame = 0; frame < frames; frame++) {
+		double start = get_time();
+		draw_frame(workload, frame);
+		double drawn = get_time();
+		draw_time += drawn - start;
+
+		switch (strategy) {
+		case REFRESH_VOSF:
+			count_vosf_bytes(false);
+			start = get_time();
+			if (mainBuffer.dirty) {
+				LOCK_VOSF;
+				update_display_window_vosf();
+				UNLOCK_VOSF;
+			}
+			break;
+		case REFRESH_VOSF_DGA:
+			count_vosf_bytes(true);
+			start = get_time();
+#if REAL_ADDRESSING || DIRECT_ADDRESSING
+			if (mainBuffer.dirty) {
+				LOCK_VOSF;
+				update_display_dga_vosf();
+				UNLOCK_VOSF;
+			}
+#endif
+			break;
+		case REFRESH_STATIC:
+			start = get_time();
+			update_static_bbox(drv, mode);
+			break;
+		case REFRESH_TILES:
+			start = get_time();
+			update_static_tiles(drv, mode);
+			break;
+		case REFRESH_AUTO:
+			start = get_time();
+			update_static(drv, mode, test_surface.row_bytes);
+			break;
+		}
+		refresh_time += get_time() - start;
+	}
+
+	if (vosf) {
+		video_vosf_exit();
+		vm_protect(the_buffer, the_buffer_size, VM_PAGE_READ | VM_PAGE_WRITE);
+	}
+
+	draw_us = draw_time * 1e6 / frames;
+	refresh_us = refresh_time * 1e6 / frames;
+	bytes = (double)bytes_touched / frames;
+}
+
+
+/*
+ *  Host formats of the output surface, for each Mac depth
+ */
+
+struct host_format {
+	const char *name;
+	VisualFormat format;
+};
+
+static const host_format host_formats_indexed[] = {
+	{ "RGB565", { true, 16, 0x00f800, 0x0007e0, 0x00001f, 0, 0, 0 } },
+	{ "RGB888", { true, 32, 0xff0000, 0x00ff00, 0x0000ff, 0, 0, 0 } },
+};
+
+static const host_format host_formats_16[] = {
+	{ "RGB555", { true, 16, 0x007c00, 0x0003e0, 0x00001f, 0, 0, 0 } },
+	{ "RGB565", { true, 16, 0x00f800, 0x0007e0, 0x00001f, 0, 0, 0 } },
+};
+
+static const host_format host_formats_32[] = {
+	{ "RGB888", { true, 32, 0xff0000, 0x00ff00, 0x0000ff, 0, 0, 0 } },
+	{ "BGR888", { true, 32, 0x0000ff, 0x00ff00, 0xff0000, 0, 0, 0 } },
+};
+
+int main(int argc, char *argv[])
+{
+	int frames = argc > 1 ? atoi(argv[1]) : 60;
+	if (frames <= 0)
+		frames = 1;
+
+	vm_init();
+	if (!sigsegv_install_handler(sigsegv_handler)) {
+		fprintf(stderr, "Could not install SIGSEGV handler\n");
+		return 1;
+	}
+
+	for (int i = 0; i < 256; i++)
+		ExpandMap[i] = 0xff000000 | (i * 0x010101);
+
+	static const struct { uint32 x, y; } resolutions[] = {
+		{ 640, 480 }, { 1024, 768 }, { 1280, 1024 }, { 1920, 1080 }
+	};
+	static const video_depth depths[] = {
+		VDEPTH_1BIT, VDEPTH_2BIT, VDEPTH_4BIT, VDEPTH_8BIT, VDEPTH_16BIT, VDEPTH_32BIT
+	};
+
+	printf("%-9s %-6s %-6s %-6s %-8s %10s %10s %10s\n", "mode", "depth", "output", "work", "refresh", "draw us", "refresh us", "KB touched");
+	for (int r = 0; r < int(sizeof(resolutions) / sizeof(resolutions[0])); r++) {
+		for (int d = 0; d < int(sizeof(depths) / sizeof(depths[0])); d++) {
+			video_mode &mode = monitor.mode;
+			mode.x = resolutions[r].x;
+			mode.y = resolutions[r].y;
+			mode.depth = depths[d];
+			mode.bytes_per_row = TrivialBytesPerRow(mode.x, mode.depth);
+			const int mac_depth = 1 << mode.depth;
+
+			// Frame buffer, copy and output surface sized for the largest output format
+			the_buffer_size = page_extend(mode.y * mode.bytes_per_row);
+			the_buffer = (uint8 *)vm_acquire(the_buffer_size);
+			the_buffer_copy = (uint8 *)malloc(the_buffer_size);
+			the_host_buffer = (uint8 *)malloc(mode.x * mode.y * 4);
+			if (the_buffer == VM_MAP_FAILED || the_buffer_copy == NULL || the_host_buffer == NULL) {
+				fprintf(stderr, "Not enough memory\n");
+				return 1;
+			}
+
+			const host_format *formats = mac_depth == 32 ? host_formats_32 : mac_depth == 16 ? host_formats_16 : host_formats_indexed;
+			for (int f = 0; f < 2; f++) {
+				test_surface.depth = formats[f].format.depth;
+				test_surface.width = mode.x;
+				test_surface.height = mode.y;
+				test_surface.row_bytes = mode.x * (test_surface.depth / 8);
+				Screen_blitter_init(formats[f].format, true, mac_depth);
+
+				for (int w = 0; w < NUM_WORKLOADS; w++) {
+					for (int s = 0; s < NUM_STRATEGIES; s++) {
+						double draw_us, refresh_us, bytes;
+						run_benchmark(w, s, frames, draw_us, refresh_us, bytes);
+						printf("%4dx%-4d %2d-bit %-6s %-6s %-8s %10.1f %10.1f %10.1f\n",
+							mode.x, mode.y, mac_depth, formats[f].name, workload_names[w], strategy_names[s],
+							draw_us, refresh_us, bytes / 1024);
+					}
+				}
+			}
+
+			vm_release(the_buffer, the_buffer_size);
+			free(the_buffer_copy);
+			free(the_host_buffer);
+			video_static_exit();
+		}
+	}
+
+	vm_exit();
+	return 0;
+}
@@ -466,6 +466,243 @@ static void Blit_Expand_8_To_32(uint8 * dest, const uint8 * p, uint32 length)
 		*q++ = ExpandMap[*p++];
 }
 
+/* -------------------------------------------------------------------------- */
+/* --- SIMD blitters (selected at run-time)                               --- */
+/* -------------------------------------------------------------------------- */
+
+// CPU features required by the vectorized blitters
+enum {
+	BLIT_SIMD_SSE2		= 1 << 0,
+	BLIT_SIMD_SSSE3		= 1 << 1,
+	BLIT_SIMD_AVX2		= 1 << 2
+};
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#if defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define VIDEO_BLIT_X86_SIMD 1
+#endif
+#endif
+
+#if VIDEO_BLIT_X86_SIMD
+#include <immintrin.h>
+
+#define SSE2_FUNC	__attribute__((target("sse2")))
+#define SSSE3_FUNC	__attribute__((target("ssse3")))
+#define AVX2_FUNC	__attribute__((target("avx2")))
+
+// 16-bit word blitters, 8 pixels per step
+#define DEFINE_BLIT_SSE2_16(NAME, SCALAR, EXPR) \
+static SSE2_FUNC void NAME(uint8 * dest, const uint8 * source, uint32 length) \
+{ \
+	while (length >= 16) { \
+		const __m128i v = _mm_loadu_si128((const __m128i *)source); \
+		_mm_storeu_si128((__m128i *)dest, (EXPR)); \
+		dest += 16; source += 16; length -= 16; \
+	} \
+	if (length) \
+		SCALAR(dest, source, length); \
+}
+
+#define SSE2_AND_16(x, m) _mm_and_si128((x), _mm_set1_epi16((short)(m)))
+
+// RGB 555, byte swap
+DEFINE_BLIT_SSE2_16(Blit_RGB555_NBO_SSE2, Blit_RGB555_NBO,
+	_mm_or_si128(_mm_srli_epi16(v, 8), _mm_slli_epi16(v, 8)))
+
+// BGR 555
+DEFINE_BLIT_SSE2_16(Blit_BGR555_NBO_SSE2, Blit_BGR555_NBO,
+	_mm_or_si128(_mm_or_si128(SSE2_AND_16(_mm_srli_epi16(v, 2), 0x001f), SSE2_AND_16(_mm_srli_epi16(v, 8), 0x00e0)),
+				 _mm_or_si128(SSE2_AND_16(_mm_slli_epi16(v, 8), 0x0300), SSE2_AND_16(_mm_slli_epi16(v, 2), 0x7c00))))
+
+// RGB 565
+DEFINE_BLIT_SSE2_16(Blit_RGB565_NBO_SSE2, Blit_RGB565_NBO,
+	_mm_or_si128(_mm_or_si128(SSE2_AND_16(_mm_srli_epi16(v, 8), 0x001f), SSE2_AND_16(_mm_slli_epi16(v, 9), 0xfe00)),
+				 SSE2_AND_16(_mm_srli_epi16(v, 7), 0x01c0)))
+
+// BGR 888, 4 pixels per step
+static SSE2_FUNC void Blit_BGR888_NBO_SSE2(uint8 * dest, const uint8 * source, uint32 length)
+{
+	const __m128i rb_mask = _mm_set1_epi32(0x00ff00ff);
+	const __m128i g_mask = _mm_set1_epi32(0x0000ff00);
+	while (length >= 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i *)source);
+		_mm_storeu_si128((__m128i *)dest, _mm_or_si128(_mm_and_si128(v, rb_mask), _mm_slli_epi32(_mm_and_si128(v, g_mask), 16)));
+		dest += 16; source += 16; length -= 16;
+	}
+	if (length)
+		Blit_BGR888_NBO(dest, source, length);
+}
+
+// RGB 888, byte swap with PSHUFB
+static SSSE3_FUNC void Blit_RGB888_NBO_SSSE3(uint8 * dest, const uint8 * source, uint32 length)
+{
+	const __m128i bswap = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	while (length >= 32) {
+		const __m128i v0 = _mm_loadu_si128((const __m128i *)source);
+		const __m128i v1 = _mm_loadu_si128((const __m128i *)(source + 16));
+		_mm_storeu_si128((__m128i *)dest, _mm_shuffle_epi8(v0, bswap));
+		_mm_storeu_si128((__m128i *)(dest + 16), _mm_shuffle_epi8(v1, bswap));
+		dest += 32; source += 32; length -= 32;
+	}
+	if (length)
+		Blit_RGB888_NBO(dest, source, length);
+}
+
+// 1-bit to 16/32-bit, one source byte per step
+static SSE2_FUNC void Blit_Expand_1_To_16_SSE2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const __m128i bits = _mm_setr_epi16(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+	for (uint32 i = 0; i < length; i++) {
+		const __m128i c = _mm_and_si128(_mm_set1_epi16(p[i]), bits);
+		_mm_storeu_si128((__m128i *)dest, _mm_cmpeq_epi16(c, bits));
+		dest += 16;
+	}
+}
+
+static SSE2_FUNC void Blit_Expand_1_To_32_SSE2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const __m128i bits_hi = _mm_setr_epi32(0x80, 0x40, 0x20, 0x10);
+	const __m128i bits_lo = _mm_setr_epi32(0x08, 0x04, 0x02, 0x01);
+	for (uint32 i = 0; i < length; i++) {
+		const __m128i c = _mm_set1_epi32(p[i]);
+		_mm_storeu_si128((__m128i *)dest, _mm_cmpeq_epi32(_mm_and_si128(c, bits_hi), bits_hi));
+		_mm_storeu_si128((__m128i *)(dest + 16), _mm_cmpeq_epi32(_mm_and_si128(c, bits_lo), bits_lo));
+		dest += 32;
+	}
+}
+
+// 2/4-bit palettes have at most 16 colors: split ExpandMap[0..15] into
+// byte planes and look pixels up with PSHUFB, 16 at a time. This relies
+// on ExpandMap[] repeating the first entries, as set up by the drivers
+static SSSE3_FUNC inline void expand_map_planes(__m128i planes[4])
+{
+	const __m128i gather = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+	const __m128i t0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&ExpandMap[0]), gather);
+	const __m128i t1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&ExpandMap[4]), gather);
+	const __m128i t2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&ExpandMap[8]), gather);
+	const __m128i t3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&ExpandMap[12]), gather);
+	const __m128i u0 = _mm_unpacklo_epi32(t0, t1);
+	const __m128i u1 = _mm_unpacklo_epi32(t2, t3);
+	const __m128i u2 = _mm_unpackhi_epi32(t0, t1);
+	const __m128i u3 = _mm_unpackhi_epi32(t2, t3);
+	planes[0] = _mm_unpacklo_epi64(u0, u1);
+	planes[1] = _mm_unpackhi_epi64(u0, u1);
+	planes[2] = _mm_unpacklo_epi64(u2, u3);
+	planes[3] = _mm_unpackhi_epi64(u2, u3);
+}
+
+static SSSE3_FUNC inline void expand_16_pixels_16(uint8 * q, __m128i idx, const __m128i planes[4])
+{
+	const __m128i b0 = _mm_shuffle_epi8(planes[0], idx);
+	const __m128i b1 = _mm_shuffle_epi8(planes[1], idx);
+	_mm_storeu_si128((__m128i *)q, _mm_unpacklo_epi8(b0, b1));
+	_mm_storeu_si128((__m128i *)(q + 16), _mm_unpackhi_epi8(b0, b1));
+}
+
+static SSSE3_FUNC inline void expand_16_pixels_32(uint8 * q, __m128i idx, const __m128i planes[4])
+{
+	const __m128i b0 = _mm_shuffle_epi8(planes[0], idx);
+	const __m128i b1 = _mm_shuffle_epi8(planes[1], idx);
+	const __m128i b2 = _mm_shuffle_epi8(planes[2], idx);
+	const __m128i b3 = _mm_shuffle_epi8(planes[3], idx);
+	const __m128i lo01 = _mm_unpacklo_epi8(b0, b1);
+	const __m128i lo23 = _mm_unpacklo_epi8(b2, b3);
+	const __m128i hi01 = _mm_unpackhi_epi8(b0, b1);
+	const __m128i hi23 = _mm_unpackhi_epi8(b2, b3);
+	_mm_storeu_si128((__m128i *)q, _mm_unpacklo_epi16(lo01, lo23));
+	_mm_storeu_si128((__m128i *)(q + 16), _mm_unpackhi_epi16(lo01, lo23));
+	_mm_storeu_si128((__m128i *)(q + 32), _mm_unpacklo_epi16(hi01, hi23));
+	_mm_storeu_si128((__m128i *)(q + 48), _mm_unpackhi_epi16(hi01, hi23));
+}
+
+// Split 16 bytes of 2-bit pixels into 4 vectors of 16 indices, in pixel order
+static SSSE3_FUNC inline void split_2_bit_pixels(__m128i v, __m128i idx[4])
+{
+	const __m128i mask = _mm_set1_epi8(3);
+	const __m128i i0 = _mm_and_si128(_mm_srli_epi16(v, 6), mask);
+	const __m128i i1 = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+	const __m128i i2 = _mm_and_si128(_mm_srli_epi16(v, 2), mask);
+	const __m128i i3 = _mm_and_si128(v, mask);
+	const __m128i lo01 = _mm_unpacklo_epi8(i0, i1);
+	const __m128i lo23 = _mm_unpacklo_epi8(i2, i3);
+	const __m128i hi01 = _mm_unpackhi_epi8(i0, i1);
+	const __m128i hi23 = _mm_unpackhi_epi8(i2, i3);
+	idx[0] = _mm_unpacklo_epi16(lo01, lo23);
+	idx[1] = _mm_unpackhi_epi16(lo01, lo23);
+	idx[2] = _mm_unpacklo_epi16(hi01, hi23);
+	idx[3] = _mm_unpackhi_epi16(hi01, hi23);
+}
+
+#define DEFINE_BLIT_EXPAND_2_SSSE3(NAME, SCALAR, EXPAND, PIXEL_BYTES) \
+static SSSE3_FUNC void NAME(uint8 * dest, const uint8 * p, uint32 length) \
+{ \
+	__m128i planes[4], idx[4]; \
+	expand_map_planes(planes); \
+	while (length >= 16) { \
+		split_2_bit_pixels(_mm_loadu_si128((const __m128i *)p), idx); \
+		for (int i = 0; i < 4; i++) \
+			EXPAND(dest + i * 16 * PIXEL_BYTES, idx[i], planes); \
+		dest += 64 * PIXEL_BYTES; p += 16; length -= 16; \
+	} \
+	if (length) \
+		SCALAR(dest, p, length); \
+}
+
+#define DEFINE_BLIT_EXPAND_4_SSSE3(NAME, SCALAR, EXPAND, PIXEL_BYTES) \
+static SSSE3_FUNC void NAME(uint8 * dest, const uint8 * p, uint32 length) \
+{ \
+	__m128i planes[4]; \
+	expand_map_planes(planes); \
+	const __m128i nibble = _mm_set1_epi8(0x0f); \
+	while (length >= 16) { \
+		const __m128i v = _mm_loadu_si128((const __m128i *)p); \
+		const __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble); \
+		const __m128i lo = _mm_and_si128(v, nibble); \
+		EXPAND(dest, _mm_unpacklo_epi8(hi, lo), planes); \
+		EXPAND(dest + 16 * PIXEL_BYTES, _mm_unpackhi_epi8(hi, lo), planes); \
+		dest += 32 * PIXEL_BYTES; p += 16; length -= 16; \
+	} \
+	if (length) \
+		SCALAR(dest, p, length); \
+}
+
+DEFINE_BLIT_EXPAND_2_SSSE3(Blit_Expand_2_To_16_SSSE3, Blit_Expand_2_To_16, expand_16_pixels_16, 2)
+DEFINE_BLIT_EXPAND_2_SSSE3(Blit_Expand_2_To_32_SSSE3, Blit_Expand_2_To_32, expand_16_pixels_32, 4)
+DEFINE_BLIT_EXPAND_4_SSSE3(Blit_Expand_4_To_16_SSSE3, Blit_Expand_4_To_16, expand_16_pixels_16, 2)
+DEFINE_BLIT_EXPAND_4_SSSE3(Blit_Expand_4_To_32_SSSE3, Blit_Expand_4_To_32, expand_16_pixels_32, 4)
+
+// 8-bit to 16/32-bit, 256-entry palette lookups with VPGATHERDD
+static AVX2_FUNC void Blit_Expand_8_To_16_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const __m256i mask = _mm256_set1_epi32(0xffff);
+	while (length >= 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i *)p);
+		const __m256i c0 = _mm256_i32gather_epi32((const int *)ExpandMap, _mm256_cvtepu8_epi32(v), 4);
+		const __m256i c1 = _mm256_i32gather_epi32((const int *)ExpandMap, _mm256_cvtepu8_epi32(_mm_srli_si128(v, 8)), 4);
+		const __m256i packed = _mm256_packus_epi32(_mm256_and_si256(c0, mask), _mm256_and_si256(c1, mask));
+		_mm256_storeu_si256((__m256i *)dest, _mm256_permute4x64_epi64(packed, 0xd8));
+		dest += 32; p += 16; length -= 16;
+	}
+	if (length)
+		Blit_Expand_8_To_16(dest, p, length);
+}
+
+static AVX2_FUNC void Blit_Expand_8_To_32_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	while (length >= 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i *)p);
+		const __m256i c0 = _mm256_i32gather_epi32((const int *)ExpandMap, _mm256_cvtepu8_epi32(v), 4);
+		const __m256i c1 = _mm256_i32gather_epi32((const int *)ExpandMap, _mm256_cvtepu8_epi32(_mm_srli_si128(v, 8)), 4);
+		_mm256_storeu_si256((__m256i *)dest, c0);
+		_mm256_storeu_si256((__m256i *)(dest + 32), c1);
+		dest += 64; p += 16; length -= 16;
+	}
+	if (length)
+		Blit_Expand_8_To_32(dest, p, length);
+}
+
+#endif /* VIDEO_BLIT_X86_SIMD */
+
 /* -------------------------------------------------------------------------- */
 /* --- Blitters to the host frame buffer, or XImage buffer                --- */
 /* -------------------------------------------------------------------------- */
@@ -513,6 +750,63 @@ static Screen_blit_func_info Screen_blitters[] = {
 	{ 32, 0xff00, 0xff0000, 0xff000000, Blit_Copy_Raw   , Blit_Copy_Raw     }   // OK
 };
 
+// Table of vectorized replacements for the generic blitters
+struct Screen_blit_simd_info {
+	Screen_blit_func	handler;		// Generic update function
+	Screen_blit_func	handler_simd;	// Vectorized update function
+	uint32				features;		// Required BLIT_SIMD_* features
+};
+
+static const Screen_blit_simd_info Screen_blitters_simd[] = {
+#if VIDEO_BLIT_X86_SIMD
+	{ Blit_Expand_8_To_32	, Blit_Expand_8_To_32_AVX2	, BLIT_SIMD_AVX2	},
+	{ Blit_Expand_8_To_16	, Blit_Expand_8_To_16_AVX2	, BLIT_SIMD_AVX2	},
+	{ Blit_Expand_4_To_32	, Blit_Expand_4_To_32_SSSE3	, BLIT_SIMD_SSSE3	},
+	{ Blit_Expand_4_To_16	, Blit_Expand_4_To_16_SSSE3	, BLIT_SIMD_SSSE3	},
+	{ Blit_Expand_2_To_32	, Blit_Expand_2_To_32_SSSE3	, BLIT_SIMD_SSSE3	},
+	{ Blit_Expand_2_To_16	, Blit_Expand_2_To_16_SSSE3	, BLIT_SIMD_SSSE3	},
+	{ Blit_Expand_1_To_32	, Blit_Expand_1_To_32_SSE2	, BLIT_SIMD_SSE2	},
+	{ Blit_Expand_1_To_16	, Blit_Expand_1_To_16_SSE2	, BLIT_SIMD_SSE2	},
+#ifndef WORDS_BIGENDIAN
+	{ Blit_RGB555_NBO		, Blit_RGB555_NBO_SSE2		, BLIT_SIMD_SSE2	},
+	{ Blit_BGR555_NBO		, Blit_BGR555_NBO_SSE2		, BLIT_SIMD_SSE2	},
+	{ Blit_RGB565_NBO		, Blit_RGB565_NBO_SSE2		, BLIT_SIMD_SSE2	},
+	{ Blit_RGB888_NBO		, Blit_RGB888_NBO_SSSE3		, BLIT_SIMD_SSSE3	},
+	{ Blit_BGR888_NBO		, Blit_BGR888_NBO_SSE2		, BLIT_SIMD_SSE2	},
+#endif
+#endif
+	{ NULL					, NULL						, 0					}
+};
+
+// Return the BLIT_SIMD_* features supported by the host CPU
+static uint32 Screen_blitter_simd_features(void)
+{
+	uint32 features = 0;
+#if VIDEO_BLIT_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		features |= BLIT_SIMD_SSE2;
+	if (__builtin_cpu_supports("ssse3"))
+		features |= BLIT_SIMD_SSSE3;
+	if (__builtin_cpu_supports("avx2"))
+		features |= BLIT_SIMD_AVX2;
+#endif
+	return features;
+}
+
+// Substitute a vectorized version of the blitter, if the CPU supports one
+static Screen_blit_func Screen_blitter_simd(Screen_blit_func handler)
+{
+	static int32 features = -1;
+	if (features < 0)
+		features = Screen_blitter_simd_features();
+	for (const Screen_blit_simd_info *b = Screen_blitters_simd; b->handler; b++) {
+		if (b->handler == handler && (b->features & features) == b->features)
+			return b->handler_simd;
+	}
+	return handler;
+}
+
 // Initialize the framebuffer update function
 // Returns FALSE, if the function was to be reduced to a simple memcpy()
 // --> In that case, VOSF is not necessary
@@ -607,6 +901,9 @@ bool Screen_blitter_init(VisualFormat const & visual_format, bool native_byte_or
 				visualFormat.Rshift, visualFormat.Gshift, visualFormat.Bshift);
 			abort();
 		}
+
+		// Use a vectorized blitter if there is one for this CPU
+		Screen_blit = Screen_blitter_simd(Screen_blit);
 	}
 #else
 	if (use_sdl_video && 1 == mac_depth && 8 == visual_format.depth) {
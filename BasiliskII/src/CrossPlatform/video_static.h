@@ -0,0 +1,314 @@
+/*
+ *  video_static.h - Video/graphics emulation, incremental refresh by
+ *                   comparison with a copy of the frame buffer
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef VIDEO_STATIC_H
+#define VIDEO_STATIC_H
+
+// Note: this file must be #include'd only in video_x.cpp (and the
+// test-video-refresh benchmark). The includer defines VIDEO_STATIC_DRV,
+// the driver type passed through to update_static_area(), which displays
+// bytes [x1, x2) of lines y1..y2 of the_buffer after the_buffer_copy has
+// been updated.
+static void update_static_area(VIDEO_STATIC_DRV *drv, int x1, int x2, int y1, int y2);
+
+// Bytes read and written by the refresh, counted by the benchmark
+#ifndef VIDEO_STATIC_COUNT
+#define VIDEO_STATIC_COUNT(bytes)	/* nothing */
+#endif
+
+// Tile hashes
+const int TILE_WIDTH = 64;							// Tile size in pixels
+const int TILE_HEIGHT = 16;
+static uint64 *tile_hashes = NULL;					// Hash of each tile of the_buffer at the last refresh
+static bool tile_hashes_valid = false;				// Flag: tile_hashes match the_buffer_copy
+
+// Refresh strategy of update_static()
+static bool static_use_tiles = false;				// Flag: refresh by tiles, not by bounding box
+static int static_tiles_holdoff = 0;				// Refreshes until tiles may be tried again
+const int STATIC_TILES_HOLDOFF = 64;
+
+// Estimated costs of both strategies, per byte of the frame buffer (a
+// tenth of a byte compared with memcmp()), and per tile hashed. Measured
+// with test-video-refresh at 1920x1080: scanning the bounding box columns
+// costs twice memcmp(), hashing a bit more, copying and converting
+// depends on the bytes written to the display.
+const int STATIC_COST_COMPARE = 10;
+const int STATIC_COST_SCAN = 20;
+const int STATIC_COST_HASH = 15;
+const int STATIC_COST_TILE = 6000;
+const int STATIC_COST_COPY = 25;
+const int STATIC_COST_BLIT = 7;					// Per byte written to the display
+
+struct static_costs {
+	int copy;										// In: cost of refreshing a byte
+	uint64 bbox;									// Out: estimated cost of each strategy
+	uint64 tiles;
+};
+
+static void video_static_exit(void)
+{
+	if (tile_hashes) {
+		free(tile_hashes);
+		tile_hashes = NULL;
+	}
+	static_use_tiles = false;
+	static_tiles_holdoff = 0;
+}
+
+// Estimated cost of a bounding box refresh of lines y1..y2, bytes [x1, x2)
+static uint64 static_bbox_cost(const static_costs *costs, const video_mode &mode, int line_bytes, int x1, int x2, int y1, int y2)
+{
+	const uint64 high = y2 - y1 + 1;
+	return (mode.y - high) * line_bytes * STATIC_COST_COMPARE		// Unchanged lines
+		+ high * (x1 + line_bytes - x2) * STATIC_COST_SCAN			// Unchanged columns
+		+ high * (x2 - x1) * costs->copy;							// Bounding box
+}
+
+// Estimated cost of hashing all tiles
+static uint64 static_hash_cost(const video_mode &mode, int line_bytes)
+{
+	const int tiles = ((mode.x + TILE_WIDTH - 1) / TILE_WIDTH) * ((mode.y + TILE_HEIGHT - 1) / TILE_HEIGHT);
+	return (uint64)line_bytes * mode.y * STATIC_COST_HASH + (uint64)tiles * STATIC_COST_TILE;
+}
+
+// Update the copy of the frame buffer, then the display
+static void static_copy_area(VIDEO_STATIC_DRV *drv, int bytes_per_row, int x1, int x2, int y1, int y2)
+{
+	for (int j = y1; j <= y2; j++)
+		memcpy(the_buffer_copy + j * bytes_per_row + x1, the_buffer + j * bytes_per_row + x1, x2 - x1);
+	VIDEO_STATIC_COUNT((uint64)(y2 - y1 + 1) * (x2 - x1) * 2);
+	update_static_area(drv, x1, x2, y1, y2);
+}
+
+// Compare 8 bytes at once
+static inline bool static_equal8(const uint8 *p, const uint8 *p2)
+{
+	uint64 a, b;
+	memcpy(&a, p, 8);
+	memcpy(&b, p2, 8);
+	return a == b;
+}
+
+// Refresh the bounding box of the changed lines and columns
+static void update_static_bbox(VIDEO_STATIC_DRV *drv, const video_mode &mode, static_costs *costs = NULL)
+{
+	const int bytes_per_row = mode.bytes_per_row;
+	const int line_bytes = TrivialBytesPerRow(mode.x, mode.depth);
+	const uint64 frame_bytes = (uint64)line_bytes * mode.y;
+	if (costs) {
+		costs->bbox = frame_bytes * STATIC_COST_COMPARE;
+		costs->tiles = static_hash_cost(mode, line_bytes);
+	}
+
+	// First and last lines that have changed
+	int y1 = 0, y2 = -1;
+	for (int j = 0; j < (int)mode.y; j++) {
+		VIDEO_STATIC_COUNT(2 * line_bytes);
+		if (memcmp(the_buffer + j * bytes_per_row, the_buffer_copy + j * bytes_per_row, line_bytes)) {
+			y1 = y2 = j;
+			break;
+		}
+	}
+	if (y2 < 0)
+		return;
+	for (int j = mode.y - 1; j > y1; j--) {
+		VIDEO_STATIC_COUNT(2 * line_bytes);
+		if (memcmp(the_buffer + j * bytes_per_row, the_buffer_copy + j * bytes_per_row, line_bytes)) {
+			y2 = j;
+			break;
+		}
+	}
+
+	// First and last bytes that have changed in these lines
+	int x1 = line_bytes, x2 = 0;
+	for (int j = y1; j <= y2; j++) {
+		const uint8 *p = the_buffer + j * bytes_per_row, *p2 = the_buffer_copy + j * bytes_per_row;
+		int i = 0;
+		while (i + 8 <= x1 && static_equal8(p + i, p2 + i))
+			i += 8;
+		while (i < x1 && p[i] == p2[i])
+			i++;
+		x1 = i;
+		i = line_bytes;
+		while (i - 8 >= x2 && static_equal8(p + i - 8, p2 + i - 8))
+			i -= 8;
+		while (i > x2 && p[i - 1] == p2[i - 1])
+			i--;
+		x2 = i;
+		VIDEO_STATIC_COUNT(2 * (x1 + line_bytes - x2));
+	}
+	if (x1 < x2) {
+		static_copy_area(drv, bytes_per_row, x1, x2, y1, y2);
+
+		// Tiles would still hash everything, but might find that much
+		// less than the bounding box changed
+		if (costs)
+			costs->bbox = static_bbox_cost(costs, mode, line_bytes, x1, x2, y1, y2);
+	}
+}
+
+// Hash a block of pixels (xxHash64 style rounds, four lanes of 8 byte words)
+static uint64 hash_tile(const uint8 *p, int bytes_per_row, int width, int height)
+{
+	const uint64 PRIME1 = UVAL64(0x9e3779b185ebca87);
+	const uint64 PRIME2 = UVAL64(0xc2b2ae3d27d4eb4f);
+	const uint64 PRIME3 = UVAL64(0x165667b19e3779f9);
+	uint64 h = PRIME3 + width;
+	uint64 v1 = PRIME1 + PRIME2, v2 = PRIME2, v3 = 0, v4 = -PRIME1;
+	for (int j = 0; j < height; j++, p += bytes_per_row) {
+		int i = 0;
+		for (; i + 32 <= width; i += 32) {
+			uint64 w[4];
+			memcpy(w, p + i, 32);
+			v1 += w[0] * PRIME2; v1 = ((v1 << 31) | (v1 >> 33)) * PRIME1;
+			v2 += w[1] * PRIME2; v2 = ((v2 << 31) | (v2 >> 33)) * PRIME1;
+			v3 += w[2] * PRIME2; v3 = ((v3 << 31) | (v3 >> 33)) * PRIME1;
+			v4 += w[3] * PRIME2; v4 = ((v4 << 31) | (v4 >> 33)) * PRIME1;
+		}
+		for (; i + 8 <= width; i += 8) {
+			uint64 v;
+			memcpy(&v, p + i, 8);
+			h ^= v * PRIME2;
+			h = ((h << 31) | (h >> 33)) * PRIME1;
+		}
+		for (; i < width; i++) {
+			h ^= p[i] * PRIME3;
+			h = ((h << 11) | (h >> 53)) * PRIME1;
+		}
+	}
+	h ^= ((v1 << 1) | (v1 >> 63)) + ((v2 << 7) | (v2 >> 57)) + ((v3 << 12) | (v3 >> 52)) + ((v4 << 18) | (v4 >> 46));
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	return h;
+}
+
+// Refresh the tiles whose hash changed. Only these are compared with
+// the_buffer_copy, adjacent changed tiles of a tile row are merged into
+// one rectangle. Without valid hashes, all tiles are compared.
+static void update_static_tiles(VIDEO_STATIC_DRV *drv, const video_mode &mode, static_costs *costs = NULL)
+{
+	const int bytes_per_row = mode.bytes_per_row;
+	const int tile_bytes = TrivialBytesPerRow(TILE_WIDTH, mode.depth);
+	const int line_bytes = TrivialBytesPerRow(mode.x, mode.depth);
+	const int tiles_x = (line_bytes + tile_bytes - 1) / tile_bytes;
+	const int tiles_y = (mode.y + TILE_HEIGHT - 1) / TILE_HEIGHT;
+	if (tile_hashes == NULL) {
+		tile_hashes = (uint64 *)malloc(tiles_x * tiles_y * sizeof(uint64));
+		tile_hashes_valid = false;
+		if (tile_hashes == NULL)
+			return;
+	}
+
+	// Bounding box and area of the changes, to estimate the costs
+	int bx1 = line_bytes, bx2 = 0, by1 = mode.y, by2 = -1;
+	uint64 changed_bytes = 0;
+
+	for (int ty = 0; ty < tiles_y; ty++) {
+		const int y = ty * TILE_HEIGHT;
+		const int high = (y + TILE_HEIGHT <= (int)mode.y) ? TILE_HEIGHT : mode.y - y;
+		uint64 *hashes = &tile_hashes[ty * tiles_x];
+		int run = -1;
+		for (int tx = 0; tx <= tiles_x; tx++) {
+			bool changed = false;
+			if (tx < tiles_x) {
+				const int x = tx * tile_bytes;
+				const int wide = (x + tile_bytes <= line_bytes) ? tile_bytes : line_bytes - x;
+				const uint64 h = hash_tile(the_buffer + y * bytes_per_row + x, bytes_per_row, wide, high);
+				VIDEO_STATIC_COUNT(wide * high);
+				changed = !tile_hashes_valid || hashes[tx] != h;
+				hashes[tx] = h;
+			}
+			if (changed) {
+				if (run < 0)
+					run = tx;
+				continue;
+			}
+			if (run < 0)
+				continue;
+
+			// Find the first and last lines of the run that did change
+			const int x1 = run * tile_bytes;
+			const int x2 = (tx * tile_bytes < line_bytes) ? tx * tile_bytes : line_bytes;
+			run = -1;
+			int y1 = y, y2 = y + high - 1;
+			while (y1 <= y2 && memcmp(the_buffer + y1 * bytes_per_row + x1, the_buffer_copy + y1 * bytes_per_row + x1, x2 - x1) == 0)
+				y1++;
+			while (y2 > y1 && memcmp(the_buffer + y2 * bytes_per_row + x1, the_buffer_copy + y2 * bytes_per_row + x1, x2 - x1) == 0)
+				y2--;
+			VIDEO_STATIC_COUNT(2 * (uint64)(x2 - x1) * ((y1 > y2) ? high : high - (y2 - y1 + 1) + (y1 < y2 ? 2 : 1)));
+			if (y1 > y2)
+				continue;
+			static_copy_area(drv, bytes_per_row, x1, x2, y1, y2);
+
+			changed_bytes += (uint64)(x2 - x1) * (y2 - y1 + 1);
+			if (x1 < bx1)
+				bx1 = x1;
+			if (x2 > bx2)
+				bx2 = x2;
+			if (y1 < by1)
+				by1 = y1;
+			by2 = y2;
+		}
+	}
+	tile_hashes_valid = true;
+
+	if (costs) {
+		const uint64 frame_bytes = (uint64)line_bytes * mode.y;
+		costs->tiles = static_hash_cost(mode, line_bytes) + changed_bytes * (STATIC_COST_COMPARE + costs->copy);
+		if (by2 < 0)
+			costs->bbox = frame_bytes * STATIC_COST_COMPARE;
+		else
+			costs->bbox = static_bbox_cost(costs, mode, line_bytes, bx1, bx2, by1, by2);
+	}
+}
+
+// Static refresh. The bounding box is cheaper in most cases: scrolling,
+// full screen changes and small changes, for which hashing everything
+// costs more than comparing. Tiles are tried when the bounding box was
+// expensive, and kept as long as they are estimated to be cheaper (e.g.
+// for distant changes in the corners of the screen). display_bytes_per_row
+// is the size of a line after conversion by update_static_area().
+static void update_static(VIDEO_STATIC_DRV *drv, const video_mode &mode, int display_bytes_per_row)
+{
+	static_costs costs;
+	costs.copy = STATIC_COST_COPY + STATIC_COST_BLIT * display_bytes_per_row / TrivialBytesPerRow(mode.x, mode.depth);
+	if (static_use_tiles) {
+		// Without valid hashes, whole rows of tiles are compared, which
+		// says nothing about the cost of the next refreshes
+		const bool first = !tile_hashes_valid;
+		update_static_tiles(drv, mode, &costs);
+		if (!first && costs.bbox <= costs.tiles) {
+			static_use_tiles = false;
+			static_tiles_holdoff = STATIC_TILES_HOLDOFF;
+		}
+	} else {
+		update_static_bbox(drv, mode, &costs);
+		if (static_tiles_holdoff > 0)
+			static_tiles_holdoff--;
+		else if (costs.tiles < costs.bbox) {
+			static_use_tiles = true;
+			tile_hashes_valid = false;
+		}
+	}
+}
+
+#endif /* VIDEO_STATIC_H */
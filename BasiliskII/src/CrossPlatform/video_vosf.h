@@ -39,6 +39,16 @@ extern void update_sdl_video(SDL_Surface *screen, int numrects, SDL_Rect *rects)
 // Glue for SDL and X11 support
 #ifdef TEST_VOSF_PERFORMANCE
 #define MONITOR_INIT			/* nothing */
+#define VIDEO_DRV_WIN_INIT		/* nothing */
+#define VIDEO_DRV_DGA_INIT		/* nothing */
+#define VIDEO_DRV_LOCK_PIXELS	/* nothing */
+#define VIDEO_DRV_UNLOCK_PIXELS	/* nothing */
+#define VIDEO_DRV_DEPTH			test_surface.depth
+#define VIDEO_DRV_WIDTH			test_surface.width
+#define VIDEO_DRV_HEIGHT		test_surface.height
+#define VIDEO_DRV_ROW_BYTES		test_surface.row_bytes
+#elif defined(USE_HEADLESS_VIDEO)
+#define MONITOR_INIT			headless_monitor_desc &monitor
 #else
 #ifdef USE_SDL_VIDEO
 #define MONITOR_INIT			SDL_monitor_desc &monitor
@@ -483,7 +493,7 @@ There are two cases to check:
 	than pageCount.
 */
 
-#ifndef TEST_VOSF_PERFORMANCE
+#if defined(TEST_VOSF_PERFORMANCE) || !defined(USE_HEADLESS_VIDEO)
 static void update_display_window_vosf(VIDEO_DRV_WIN_INIT)
 {
 	VIDEO_MODE_INIT;
@@ -519,7 +529,9 @@ static void update_display_window_vosf(VIDEO_DRV_WIN_INIT)
 		}
 		VIDEO_DRV_UNLOCK_PIXELS;
 
-#ifdef USE_SDL_VIDEO
+#if defined(TEST_VOSF_PERFORMANCE)
+		(void)height;	// Null output surface
+#elif defined(USE_SDL_VIDEO)
 		update_sdl_video(drv->s, 0, y1, VIDEO_MODE_X, height);
 #else
 		if (VIDEO_DRV_HAVE_SHM)
@@ -538,7 +550,7 @@ static void update_display_window_vosf(VIDEO_DRV_WIN_INIT)
  *	(only in Real or Direct Addressing mode)
  */
 
-#ifndef TEST_VOSF_PERFORMANCE
+#if defined(TEST_VOSF_PERFORMANCE) || !defined(USE_HEADLESS_VIDEO)
 #if REAL_ADDRESSING || DIRECT_ADDRESSING
 
 static void update_display_dga_vosf(VIDEO_DRV_DGA_INIT)
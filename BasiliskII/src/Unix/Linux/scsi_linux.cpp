@@ -21,6 +21,8 @@
 #include "sysdeps.h"
 
 #include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <linux/param.h>
 #include <linux/../scsi/sg.h>	// workaround for broken RedHat 6.0 /usr/include/scsi
 #include <unistd.h>
@@ -32,6 +34,7 @@
 #include "prefs.h"
 #include "user_strings.h"
 #include "scsi.h"
+#include "disk_unix.h"
 
 #define DEBUG 0
 #include "debug.h"
@@ -47,6 +50,31 @@ static uint8 *buffer = NULL;	// Pointer to data buffer
 static uint8 the_cmd[12];		// Active SCSI command
 static int the_cmd_len;
 
+// Disk image mounted as a virtual SCSI target
+struct scsi_image {
+	char *name;					// Copy of image file name
+	int fd;						// Plain image file or block device, -1 if generic_disk is used
+	disk_generic *generic_disk;	// Image format backend (sparsebundle, VHD)
+	bool read_only;
+	uint32 num_blocks;			// Size of image in 512-byte blocks
+	uint8 sense[18];			// Sense data of last command (returned by REQUEST SENSE)
+};
+
+static scsi_image *images[8];	// Virtual targets for 8 units
+static scsi_image *image;		// Active virtual target (NULL if a real device is selected)
+
+static disk_factory *image_factories[] = {
+	disk_sparsebundle_factory,
+#if defined(HAVE_LIBVHD)
+	disk_vhd_factory,
+#endif
+	NULL
+};
+
+static scsi_image *image_open(const char *path);
+static void image_close(scsi_image *img);
+static bool image_send_cmd(scsi_image *img, size_t data_length, bool reading, int sg_size, uint8 **sg_ptr, uint32 *sg_len, uint16 *stat);
+
 
 /*
  *  Initialization
@@ -64,7 +92,13 @@ void SCSIInit(void)
 		char prefs_name[16];
 		sprintf(prefs_name, "scsi%d", id);
 		const char *str = PrefsFindString(prefs_name);
-		if (str) {
+		images[id] = NULL;
+		struct stat st;
+		if (str && stat(str, &st) == 0 && !S_ISCHR(st.st_mode)) {
+			// Image file or block device, handled by the virtual target
+			fds[id] = -1;
+			images[id] = image_open(str);
+		} else if (str) {
 			int fd = fds[id] = open(str, O_RDWR | O_EXCL);
 			if (fd > 0) {
 				// Is it really a Generic SCSI device?
@@ -108,7 +142,12 @@ void SCSIExit(void)
 		int fd = fds[i];
 		if (fd > 0)
 			close(fd);
+		if (images[i]) {
+			image_close(images[i]);
+			images[i] = NULL;
+		}
 	}
+	image = NULL;
 
 	// Free buffer
 	if (buffer) {
@@ -154,7 +193,7 @@ void scsi_set_cmd(int cmd_length, uint8 *cmd)
 
 bool scsi_is_target_present(int id)
 {
-	return fds[id] > 0;
+	return fds[id] > 0 || images[id] != NULL;
 }
 
 
@@ -164,6 +203,16 @@ bool scsi_is_target_present(int id)
 
 bool scsi_set_target(int id, int lun)
 {
+	if (images[id]) {
+		// Virtual targets only have LUN 0
+		if (lun != 0)
+			return false;
+		image = images[id];
+		fd = -1;
+		return true;
+	}
+	image = NULL;
+
 	int new_fd = fds[id];
 	if (new_fd < 0)
 		return false;
@@ -186,6 +235,10 @@ bool scsi_send_cmd(size_t data_length, bool reading, int sg_size, uint8 **sg_ptr
 {
 	static int pack_id = 0;
 
+	// Virtual targets transfer directly from/to the S/G table
+	if (image)
+		return image_send_cmd(image, data_length, reading, sg_size, sg_ptr, sg_len, stat);
+
 	// Check if buffer is large enough, allocate new buffer if needed
 	if (!try_buffer(data_length)) {
 		char str[256];
@@ -269,3 +322,392 @@ bool scsi_send_cmd(size_t data_length, bool reading, int sg_size, uint8 **sg_ptr
 	}
 	return res >= 0;
 }
+
+
+/*
+ *  Virtual SCSI target backed by a disk image
+ */
+
+const uint32 IMAGE_BLOCK_SIZE = 512;
+const int IMAGE_MAX_IOV = 256;		// Entries per preadv()/pwritev() call
+
+// Sense keys and additional sense codes
+enum {
+	SENSE_NONE = 0x00,
+	SENSE_MEDIUM_ERROR = 0x03,
+	SENSE_ILLEGAL_REQUEST = 0x05,
+	SENSE_DATA_PROTECT = 0x07
+};
+
+enum {
+	ASC_WRITE_ERROR = 0x0c,
+	ASC_READ_ERROR = 0x11,
+	ASC_INVALID_OPCODE = 0x20,
+	ASC_LBA_OUT_OF_RANGE = 0x21,
+	ASC_INVALID_FIELD_IN_CDB = 0x24,
+	ASC_WRITE_PROTECTED = 0x27
+};
+
+// Open image file, returns NULL on error
+static scsi_image *image_open(const char *path)
+{
+	scsi_image *img = new scsi_image;
+	memset(img, 0, sizeof(scsi_image));
+	img->fd = -1;
+
+	loff_t size = -1;
+	for (int i = 0; image_factories[i]; ++i) {
+		disk_generic *generic;
+		disk_generic::status st = image_factories[i](path, false, &generic);
+		if (st == disk_generic::DISK_INVALID) {
+			char msg[256];
+			sprintf(msg, GetString(STR_SCSI_IMAGE_INVALID_WARN), path);
+			WarningAlert(msg);
+			image_close(img);
+			return NULL;
+		}
+		if (st == disk_generic::DISK_VALID) {
+			img->generic_disk = generic;
+			img->read_only = generic->is_read_only();
+			size = generic->size();
+			break;
+		}
+	}
+
+	if (img->generic_disk == NULL) {
+		img->fd = open(path, O_RDWR);
+		if (img->fd < 0) {
+			img->read_only = true;
+			img->fd = open(path, O_RDONLY);
+		}
+		if (img->fd >= 0)
+			size = lseek(img->fd, 0, SEEK_END);
+	}
+
+	if (size < (loff_t)IMAGE_BLOCK_SIZE) {
+		char msg[256];
+		if (size < 0)
+			sprintf(msg, GetString(STR_SCSI_DEVICE_OPEN_WARN), path, strerror(errno));
+		else
+			sprintf(msg, GetString(STR_SCSI_IMAGE_SIZE_WARN), path);
+		WarningAlert(msg);
+		image_close(img);
+		return NULL;
+	}
+
+	loff_t num_blocks = size / IMAGE_BLOCK_SIZE;
+	img->num_blocks = num_blocks > 0xffffffff ? 0xffffffff : (uint32)num_blocks;
+	img->name = strdup(path);
+	D(bug("SCSI image %s, %u blocks%s\n", path, img->num_blocks, img->read_only ? ", read-only" : ""));
+	return img;
+}
+
+// Close image file
+static void image_close(scsi_image *img)
+{
+	if (img->generic_disk)
+		delete img->generic_disk;
+	if (img->fd >= 0)
+		close(img->fd);
+	free(img->name);
+	delete img;
+}
+
+// Set sense data of active target
+static void image_set_sense(scsi_image *img, uint8 key, uint8 asc)
+{
+	memset(img->sense, 0, sizeof(img->sense));
+	img->sense[0] = 0x70;	// Current error, fixed format
+	img->sense[2] = key;
+	img->sense[7] = sizeof(img->sense) - 8;
+	img->sense[12] = asc;
+}
+
+// Copy command reply to S/G table, returns number of bytes copied
+static size_t image_reply(const uint8 *data, size_t length, size_t data_length, int sg_size, uint8 **sg_ptr, uint32 *sg_len)
+{
+	if (length > data_length)
+		length = data_length;
+	size_t done = 0;
+	for (int i=0; i<sg_size && done < length; i++) {
+		size_t len = sg_len[i];
+		if (len > length - done)
+			len = length - done;
+		memcpy(sg_ptr[i], data + done, len);
+		done += len;
+	}
+	return done;
+}
+
+// Transfer data between image and S/G table without intermediate copies
+static bool image_transfer(scsi_image *img, bool reading, loff_t offset, size_t length, int sg_size, uint8 **sg_ptr, uint32 *sg_len)
+{
+	int i = 0;
+	size_t seg_done = 0;	// Bytes of sg entry i already transferred
+	while (length > 0 && i < sg_size) {
+
+		if (img->generic_disk) {
+
+			// Image format backend, one call per S/G entry
+			size_t len = sg_len[i] - seg_done;
+			if (len > length)
+				len = length;
+			size_t actual = reading ? img->generic_disk->read(sg_ptr[i] + seg_done, offset, len)
+			                        : img->generic_disk->write(sg_ptr[i] + seg_done, offset, len);
+			if (actual != len)
+				return false;
+			offset += len;
+			length -= len;
+			seg_done = 0;
+			i++;
+
+		} else {
+
+			// Plain file, gather the S/G entries into a single system call
+			struct iovec iov[IMAGE_MAX_IOV];
+			int n = 0;
+			size_t total = 0;
+			for (int j = i; j < sg_size && n < IMAGE_MAX_IOV && total < length; j++, n++) {
+				size_t skip = (j == i) ? seg_done : 0;
+				size_t len = sg_len[j] - skip;
+				if (len > length - total)
+					len = length - total;
+				iov[n].iov_base = sg_ptr[j] + skip;
+				iov[n].iov_len = len;
+				total += len;
+			}
+			ssize_t actual;
+			do {
+				actual = reading ? preadv(img->fd, iov, n, offset) : pwritev(img->fd, iov, n, offset);
+			} while (actual < 0 && errno == EINTR);
+			if (actual <= 0)
+				return false;
+
+			// Advance S/G position (short transfers resume in the middle of an entry)
+			offset += actual;
+			length -= actual;
+			while (actual > 0) {
+				size_t left = sg_len[i] - seg_done;
+				if ((size_t)actual < left) {
+					seg_done += actual;
+					break;
+				}
+				actual -= left;
+				seg_done = 0;
+				i++;
+			}
+		}
+	}
+	return length == 0;
+}
+
+// Build MODE SENSE page, returns page length
+static int image_mode_page(scsi_image *img, int page, uint8 *p)
+{
+	const int heads = 16, sectors = 63;
+	uint32 cylinders = img->num_blocks / (heads * sectors);
+	switch (page) {
+		case 0x01:	// Read-write error recovery
+			memset(p, 0, 12);
+			p[0] = 0x01;
+			p[1] = 10;
+			return 12;
+		case 0x03:	// Format device
+			memset(p, 0, 24);
+			p[0] = 0x03;
+			p[1] = 22;
+			p[10] = 0; p[11] = sectors;
+			p[12] = IMAGE_BLOCK_SIZE >> 8; p[13] = IMAGE_BLOCK_SIZE & 0xff;
+			p[20] = 0x40;	// Hard sectored
+			return 24;
+		case 0x04:	// Rigid disk geometry
+			memset(p, 0, 24);
+			p[0] = 0x04;
+			p[1] = 22;
+			p[2] = cylinders >> 16; p[3] = cylinders >> 8; p[4] = cylinders;
+			p[5] = heads;
+			p[20] = 0x1c; p[21] = 0x20;	// 7200 rpm
+			return 24;
+		case 0x08:	// Caching
+			memset(p, 0, 12);
+			p[0] = 0x08;
+			p[1] = 10;
+			p[2] = 0x04;	// Write cache enabled
+			return 12;
+	}
+	return 0;
+}
+
+// Execute command on virtual target
+static bool image_send_cmd(scsi_image *img, size_t data_length, bool reading, int sg_size, uint8 **sg_ptr, uint32 *sg_len, uint16 *stat)
+{
+	const uint8 *cmd = the_cmd;
+	uint8 reply[256];
+	uint32 block = 0, count = 0;
+	bool writing = false;
+
+	D(bug(" virtual target command %02x, length %d\n", cmd[0], data_length));
+	*stat = 0;
+
+	switch (cmd[0]) {
+		case 0x00:	// TEST UNIT READY
+		case 0x04:	// FORMAT UNIT
+		case 0x15:	// MODE SELECT(6)
+		case 0x16:	// RESERVE
+		case 0x17:	// RELEASE
+		case 0x1b:	// START STOP UNIT
+		case 0x1d:	// SEND DIAGNOSTIC
+		case 0x1e:	// PREVENT ALLOW MEDIUM REMOVAL
+		case 0x2f:	// VERIFY(10)
+		case 0x55:	// MODE SELECT(10)
+			break;
+
+		case 0x03: {	// REQUEST SENSE
+			image_reply(img->sense, sizeof(img->sense) < cmd[4] ? sizeof(img->sense) : cmd[4], data_length, sg_size, sg_ptr, sg_len);
+			image_set_sense(img, SENSE_NONE, 0);
+			return true;
+		}
+
+		case 0x12: {	// INQUIRY
+			if (cmd[1] & 1) {	// Vital product data
+				if (cmd[2] != 0)
+					goto invalid_field;
+				memset(reply, 0, 6);
+				reply[3] = 1;	// Supported pages: 0x00 only
+				image_reply(reply, 5 < cmd[4] ? 5 : cmd[4], data_length, sg_size, sg_ptr, sg_len);
+				break;
+			}
+			memset(reply, 0, 36);
+			reply[0] = 0x00;	// Direct-access device
+			reply[2] = 0x02;	// SCSI-2
+			reply[3] = 0x02;	// Response data format
+			reply[4] = 36 - 5;
+			memcpy(reply + 8, "Basilisk", 8);
+			memcpy(reply + 16, "Virtual Disk    ", 16);
+			memcpy(reply + 32, "1.0 ", 4);
+			image_reply(reply, 36 < cmd[4] ? 36 : cmd[4], data_length, sg_size, sg_ptr, sg_len);
+			break;
+		}
+
+		case 0x1a:		// MODE SENSE(6)
+		case 0x5a: {	// MODE SENSE(10)
+			bool ten = (cmd[0] == 0x5a);
+			bool dbd = cmd[1] & 0x08;
+			int page = cmd[2] & 0x3f;
+			int hdr = ten ? 8 : 4;
+			int len = hdr;
+			if (!dbd) {
+				uint8 *d = reply + len;
+				memset(d, 0, 8);
+				uint32 n = img->num_blocks > 0xffffff ? 0xffffff : img->num_blocks;
+				d[1] = n >> 16; d[2] = n >> 8; d[3] = n;
+				d[6] = IMAGE_BLOCK_SIZE >> 8; d[7] = IMAGE_BLOCK_SIZE & 0xff;
+				len += 8;
+			}
+			if (page == 0x3f) {
+				static const int all_pages[] = {0x01, 0x03, 0x04, 0x08};
+				for (int i=0; i<4; i++)
+					len += image_mode_page(img, all_pages[i], reply + len);
+			} else {
+				int page_len = image_mode_page(img, page, reply + len);
+				if (page_len == 0)
+					goto invalid_field;
+				len += page_len;
+			}
+			memset(reply, 0, hdr);
+			if (ten) {
+				reply[0] = (len - 2) >> 8; reply[1] = len - 2;
+				reply[3] = img->read_only ? 0x80 : 0;
+				reply[7] = dbd ? 0 : 8;
+			} else {
+				reply[0] = len - 1;
+				reply[2] = img->read_only ? 0x80 : 0;
+				reply[3] = dbd ? 0 : 8;
+			}
+			size_t alloc = ten ? (cmd[7] << 8) | cmd[8] : cmd[4];
+			image_reply(reply, (size_t)len < alloc ? len : alloc, data_length, sg_size, sg_ptr, sg_len);
+			break;
+		}
+
+		case 0x25: {	// READ CAPACITY(10)
+			uint32 last = img->num_blocks - 1;
+			reply[0] = last >> 24; reply[1] = last >> 16; reply[2] = last >> 8; reply[3] = last;
+			reply[4] = 0; reply[5] = 0; reply[6] = IMAGE_BLOCK_SIZE >> 8; reply[7] = IMAGE_BLOCK_SIZE & 0xff;
+			image_reply(reply, 8, data_length, sg_size, sg_ptr, sg_len);
+			break;
+		}
+
+		case 0x35:	// SYNCHRONIZE CACHE(10)
+			if (img->fd >= 0)
+				fsync(img->fd);
+			break;
+
+		case 0x0a:	// WRITE(6)
+			writing = true;
+			// fall through
+		case 0x08:	// READ(6)
+			block = ((cmd[1] & 0x1f) << 16) | (cmd[2] << 8) | cmd[3];
+			count = cmd[4] ? cmd[4] : 256;
+			goto rw;
+
+		case 0x2a:	// WRITE(10)
+		case 0x2e:	// WRITE AND VERIFY(10)
+			writing = true;
+			// fall through
+		case 0x28:	// READ(10)
+			block = (cmd[2] << 24) | (cmd[3] << 16) | (cmd[4] << 8) | cmd[5];
+			count = (cmd[7] << 8) | cmd[8];
+			goto rw;
+
+		case 0xaa:	// WRITE(12)
+			writing = true;
+			// fall through
+		case 0xa8:	// READ(12)
+			block = (cmd[2] << 24) | (cmd[3] << 16) | (cmd[4] << 8) | cmd[5];
+			count = (cmd[6] << 24) | (cmd[7] << 16) | (cmd[8] << 8) | cmd[9];
+			goto rw;
+
+		default:
+			D(bug("  unsupported command %02x\n", cmd[0]));
+			image_set_sense(img, SENSE_ILLEGAL_REQUEST, ASC_INVALID_OPCODE);
+			*stat = 2;	// Check condition
+			return true;
+	}
+
+	image_set_sense(img, SENSE_NONE, 0);
+	return true;
+
+rw:
+	if (block > img->num_blocks || count > img->num_blocks - block) {
+		image_set_sense(img, SENSE_ILLEGAL_REQUEST, ASC_LBA_OUT_OF_RANGE);
+		*stat = 2;
+		return true;
+	}
+	if (writing && img->read_only) {
+		image_set_sense(img, SENSE_DATA_PROTECT, ASC_WRITE_PROTECTED);
+		*stat = 2;
+		return true;
+	}
+	{
+		uint64 length = (uint64)count * IMAGE_BLOCK_SIZE;
+		if (length > data_length)
+			length = data_length;
+		if (length > 0 && writing == reading) {
+			// Data phase direction doesn't match the command
+			goto invalid_field;
+		}
+		D(bug("  %s %u blocks at %u\n", writing ? "write" : "read", count, block));
+		if (!image_transfer(img, reading, (loff_t)block * IMAGE_BLOCK_SIZE, length, sg_size, sg_ptr, sg_len)) {
+			image_set_sense(img, SENSE_MEDIUM_ERROR, writing ? ASC_WRITE_ERROR : ASC_READ_ERROR);
+			*stat = 2;
+			return true;
+		}
+	}
+	image_set_sense(img, SENSE_NONE, 0);
+	return true;
+
+invalid_field:
+	image_set_sense(img, SENSE_ILLEGAL_REQUEST, ASC_INVALID_FIELD_IN_CDB);
+	*stat = 2;
+	return true;
+}
@@ -0,0 +1,408 @@
+/*
+ *  test_scsi.cpp - Check the virtual SCSI target of the Linux SCSI Manager
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  The SCSI Manager backend (scsi_linux.cpp, included below so that its
+ *  static functions are at hand) is given image files as "scsi0".."scsi2",
+ *  and the virtual target is sent CDBs the way scsi.cpp does, with the data
+ *  scattered over several S/G entries of odd sizes:
+ *
+ *    INQUIRY, READ CAPACITY(10), REQUEST SENSE
+ *    READ(6), READ(10), READ(12), WRITE(6), WRITE(10) (preadv()/pwritev()),
+ *    also with more S/G entries than fit into a single system call
+ *    out of range block addresses and unsupported commands
+ *
+ *  Read data is compared to the image file, written data is read back
+ *  from the file with pread(). Images that an image format backend rejects
+ *  as invalid, or that are too small, must not become targets.
+ *
+ *  Usage: test-scsi
+ */
+
+#include "sysdeps.h"
+
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <stdarg.h>
+
+
+/*
+ *  The driver under test
+ */
+
+#include "scsi_linux.cpp"
+
+
+/*
+ *  MacOS glue
+ */
+
+// Image files given with the "scsi<n>" prefs items
+static const char *scsi_prefs[8];
+
+const char *PrefsFindString(const char *name, int index)
+{
+	if (strncmp(name, "scsi", 4) == 0 && name[4] >= '0' && name[4] <= '7' && name[5] == 0 && index == 0)
+		return scsi_prefs[name[4] - '0'];
+	return NULL;
+}
+
+// Warnings shown while opening the images
+static std::vector<std::string> warnings;
+
+void WarningAlert(const char *text)
+{
+	warnings.push_back(text);
+}
+
+void ErrorAlert(const char *text)
+{
+	fprintf(stderr, "ERROR: %s\n", text);
+}
+
+int16 SCSIReset(void)
+{
+	return 0;
+}
+
+// Image format backends, the one given here claims to be an invalid image
+static const char *invalid_image_path = NULL;
+
+disk_generic::status disk_sparsebundle_factory(const char *path, bool read_only, disk_generic **disk)
+{
+	if (invalid_image_path && strcmp(path, invalid_image_path) == 0)
+		return disk_generic::DISK_INVALID;
+	return disk_generic::DISK_UNKNOWN;
+}
+
+#if defined(HAVE_LIBVHD)
+disk_generic::status disk_vhd_factory(const char *path, bool read_only, disk_generic **disk)
+{
+	return disk_generic::DISK_UNKNOWN;
+}
+#endif
+
+
+/*
+ *  Test helpers
+ */
+
+const uint32 NUM_BLOCKS = 2048;
+const uint32 BLOCK_SIZE = 512;
+
+static int errors = 0;
+static int image_fd = -1;
+
+static void check(bool ok, const char *fmt, ...)
+{
+	if (ok)
+		return;
+	va_list args;
+	va_start(args, fmt);
+	printf("FAILED: ");
+	vprintf(fmt, args);
+	printf("\n");
+	va_end(args);
+	errors++;
+}
+
+static void report(const char *name, int errors_before)
+{
+	printf("%-24s %s\n", name, errors == errors_before ? "ok" : "FAILED");
+}
+
+// Contents of an image byte, as initially written
+static uint8 image_byte(loff_t offset)
+{
+	return (uint8)((offset / BLOCK_SIZE) * 7 + offset % BLOCK_SIZE);
+}
+
+// Create image file of the given size, returns its path
+static std::string create_image(const char *name, loff_t size)
+{
+	char path[256];
+	const char *tmp = getenv("TMPDIR");
+	sprintf(path, "%s/test-scsi-%d-%s", tmp ? tmp : "/tmp", (int)getpid(), name);
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		fprintf(stderr, "Cannot create %s (%s)\n", path, strerror(errno));
+		exit(1);
+	}
+	uint8 block[BLOCK_SIZE];
+	for (loff_t offset = 0; offset < size; offset += BLOCK_SIZE) {
+		size_t len = size - offset < BLOCK_SIZE ? size - offset : BLOCK_SIZE;
+		for (size_t i = 0; i < len; i++)
+			block[i] = image_byte(offset + i);
+		if (pwrite(fd, block, len, offset) != (ssize_t)len) {
+			fprintf(stderr, "Cannot write %s (%s)\n", path, strerror(errno));
+			exit(1);
+		}
+	}
+	close(fd);
+	return path;
+}
+
+// Build READ/WRITE CDB, returns its length
+static int rw_cdb(uint8 *cdb, uint8 op, uint32 block, uint32 count)
+{
+	memset(cdb, 0, 12);
+	cdb[0] = op;
+	switch (op >> 5) {
+		case 0:		// 6-byte commands
+			cdb[1] = (block >> 16) & 0x1f; cdb[2] = block >> 8; cdb[3] = block;
+			cdb[4] = count;
+			return 6;
+		case 1:		// 10-byte commands
+			cdb[2] = block >> 24; cdb[3] = block >> 16; cdb[4] = block >> 8; cdb[5] = block;
+			cdb[7] = count >> 8; cdb[8] = count;
+			return 10;
+		default:	// 12-byte commands
+			cdb[2] = block >> 24; cdb[3] = block >> 16; cdb[4] = block >> 8; cdb[5] = block;
+			cdb[6] = count >> 24; cdb[7] = count >> 16; cdb[8] = count >> 8; cdb[9] = count;
+			return 12;
+	}
+}
+
+// Split length bytes into S/G entries of entry_size bytes (terminated by 0)
+static uint32 *split(uint32 *sizes, uint32 length, uint32 entry_size)
+{
+	int n = 0;
+	while (length) {
+		uint32 len = length < entry_size ? length : entry_size;
+		sizes[n++] = len;
+		length -= len;
+	}
+	sizes[n] = 0;
+	return sizes;
+}
+
+// Send command to the selected target, with the data split into S/G
+// entries of the given sizes (terminated by 0); returns the SCSI status
+static uint16 send_cmd(const uint8 *cdb, int cdb_length, bool reading, uint8 *data, const uint32 *sizes)
+{
+	uint8 *sg_ptr[1024];
+	uint32 sg_len[1024];
+	int sg_size = 0;
+	size_t length = 0;
+	while (sizes && sizes[sg_size]) {
+		sg_ptr[sg_size] = data + length;
+		sg_len[sg_size] = sizes[sg_size];
+		length += sizes[sg_size];
+		sg_size++;
+	}
+	scsi_set_cmd(cdb_length, (uint8 *)cdb);
+	uint16 stat = 0xffff;
+	check(scsi_send_cmd(length, reading, sg_size, sg_ptr, sg_len, &stat, 0), "command %02x not sent", cdb[0]);
+	return stat;
+}
+
+// Read/write count blocks in S/G entries of entry_size bytes, returns the SCSI status
+static uint16 send_rw(uint8 op, uint32 block, uint32 count, uint8 *data, uint32 entry_size)
+{
+	uint8 cdb[12];
+	uint32 sizes[1024];
+	const int cdb_length = rw_cdb(cdb, op, block, count);
+	const bool reading = (op & 0x0f) == 0x08;
+	return send_cmd(cdb, cdb_length, reading, data, split(sizes, count * BLOCK_SIZE, entry_size));
+}
+
+// Check sense key and additional sense code of the last command
+static void check_sense(uint8 key, uint8 asc, const char *what)
+{
+	static const uint8 cdb[6] = {0x03, 0, 0, 0, 18, 0};
+	static const uint32 sizes[] = {18, 0};
+	uint8 sense[18];
+	uint16 stat = send_cmd(cdb, 6, true, sense, sizes);
+	check(stat == 0, "%s: REQUEST SENSE status %d", what, stat);
+	check(sense[0] == 0x70, "%s: sense response code %02x", what, sense[0]);
+	check((sense[2] & 0x0f) == key && sense[12] == asc, "%s: sense key %02x, ASC %02x (expected %02x, %02x)",
+		what, sense[2] & 0x0f, sense[12], key, asc);
+}
+
+// Check data against the image file
+static void check_image_data(const uint8 *data, uint32 block, uint32 count, const char *what)
+{
+	const size_t length = count * BLOCK_SIZE;
+	uint8 *expected = (uint8 *)malloc(length);
+	check(pread(image_fd, expected, length, (loff_t)block * BLOCK_SIZE) == (ssize_t)length, "%s: cannot read image file", what);
+	check(memcmp(data, expected, length) == 0, "%s: data mismatch", what);
+	free(expected);
+}
+
+
+/*
+ *  Tests
+ */
+
+static void test_open(const std::vector<std::string> &warnings, const char *invalid, const char *small)
+{
+	const int e = errors;
+	check(scsi_is_target_present(0), "image is not a target");
+	check(scsi_set_target(0, 0), "cannot select target 0");
+	check(!scsi_set_target(0, 1), "virtual target has LUN 1");
+	check(!scsi_is_target_present(1), "invalid image is a target");
+	check(!scsi_is_target_present(2), "too small image is a target");
+
+	char msg[256];
+	check(warnings.size() == 2, "%d warnings when opening the images", (int)warnings.size());
+	sprintf(msg, GetString(STR_SCSI_IMAGE_INVALID_WARN), invalid);
+	check(warnings.size() > 0 && warnings[0] == msg, "unexpected warning for the invalid image");
+	sprintf(msg, GetString(STR_SCSI_IMAGE_SIZE_WARN), small);
+	check(warnings.size() > 1 && warnings[1] == msg, "unexpected warning for the too small image");
+	report("Opening images", e);
+}
+
+static void test_inquiry(void)
+{
+	const int e = errors;
+	static const uint8 cdb[6] = {0x12, 0, 0, 0, 36, 0};
+	static const uint32 sizes[] = {5, 31, 0};
+	uint8 data[36];
+	memset(data, 0xaa, sizeof(data));
+	uint16 stat = send_cmd(cdb, 6, true, data, sizes);
+	check(stat == 0, "INQUIRY status %d", stat);
+	check(data[0] == 0x00, "INQUIRY device type %02x", data[0]);
+	check(data[4] == 36 - 5, "INQUIRY additional length %d", data[4]);
+	check(memcmp(data + 8, "Basilisk", 8) == 0, "INQUIRY vendor");
+	check(memcmp(data + 16, "Virtual Disk    ", 16) == 0, "INQUIRY product");
+	report("INQUIRY", e);
+}
+
+static void test_read_capacity(void)
+{
+	const int e = errors;
+	static const uint8 cdb[10] = {0x25, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+	static const uint32 sizes[] = {3, 5, 0};
+	uint8 data[8];
+	uint16 stat = send_cmd(cdb, 10, true, data, sizes);
+	check(stat == 0, "READ CAPACITY status %d", stat);
+	uint32 last = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+	uint32 block_size = (data[4] << 24) | (data[5] << 16) | (data[6] << 8) | data[7];
+	check(last == NUM_BLOCKS - 1, "READ CAPACITY last block %u", last);
+	check(block_size == BLOCK_SIZE, "READ CAPACITY block size %u", block_size);
+	report("READ CAPACITY(10)", e);
+}
+
+static void test_read(void)
+{
+	uint8 *data = (uint8 *)malloc(300 * BLOCK_SIZE);
+
+	// READ(6), entries not ending on block boundaries
+	int e = errors;
+	memset(data, 0, 2 * BLOCK_SIZE);
+	check(send_rw(0x08, 3, 2, data, 100) == 0, "READ(6) status");
+	check_image_data(data, 3, 2, "READ(6)");
+	report("READ(6)", e);
+
+	// READ(10), up to the last block
+	e = errors;
+	memset(data, 0, 16 * BLOCK_SIZE);
+	check(send_rw(0x28, NUM_BLOCKS - 16, 16, data, 1000) == 0, "READ(10) status");
+	check_image_data(data, NUM_BLOCKS - 16, 16, "READ(10)");
+	report("READ(10)", e);
+
+	// READ(12), more S/G entries than a single preadv() takes
+	e = errors;
+	memset(data, 0, 300 * BLOCK_SIZE);
+	check(send_rw(0xa8, 0x100, 300, data, 300) == 0, "READ(12) status");
+	check_image_data(data, 0x100, 300, "READ(12)");
+	report("READ(12), 512 S/G", e);
+
+	free(data);
+}
+
+static void test_write(void)
+{
+	uint8 data[4 * BLOCK_SIZE], readback[4 * BLOCK_SIZE];
+	for (uint32 i = 0; i < sizeof(data); i++)
+		data[i] = rand();
+
+	// WRITE(10), then read back from the file and through the target
+	int e = errors;
+	check(send_rw(0x2a, 5, 4, data, 700) == 0, "WRITE(10) status");
+	check_image_data(data, 5, 4, "WRITE(10)");
+	memset(readback, 0, sizeof(readback));
+	check(send_rw(0x28, 5, 4, readback, 4 * BLOCK_SIZE) == 0, "READ(10) after WRITE(10) status");
+	check(memcmp(data, readback, 4 * BLOCK_SIZE) == 0, "READ(10) after WRITE(10) data mismatch");
+	report("WRITE(10)", e);
+
+	// WRITE(6), the neighbouring blocks must be unchanged
+	e = errors;
+	check(send_rw(0x0a, 12, 1, data, 3) == 0, "WRITE(6) status");
+	check_image_data(data, 12, 1, "WRITE(6)");
+	check(pread(image_fd, readback, BLOCK_SIZE, 11 * BLOCK_SIZE) == BLOCK_SIZE, "WRITE(6) read back");
+	check(pread(image_fd, readback + BLOCK_SIZE, BLOCK_SIZE, 13 * BLOCK_SIZE) == BLOCK_SIZE, "WRITE(6) read back");
+	bool unchanged = true;
+	for (uint32 i = 0; i < BLOCK_SIZE; i++) {
+		if (readback[i] != image_byte(11 * BLOCK_SIZE + i) || readback[BLOCK_SIZE + i] != image_byte(13 * BLOCK_SIZE + i))
+			unchanged = false;
+	}
+	check(unchanged, "WRITE(6) changed the neighbouring blocks");
+	report("WRITE(6)", e);
+}
+
+static void test_errors(void)
+{
+	const int e = errors;
+	uint8 data[2 * BLOCK_SIZE];
+
+	// READ(10) past the end of the image
+	check(send_rw(0x28, NUM_BLOCKS - 1, 2, data, BLOCK_SIZE) == 2, "READ(10) past the end not rejected");
+	check_sense(SENSE_ILLEGAL_REQUEST, ASC_LBA_OUT_OF_RANGE, "READ(10) past the end");
+	check_sense(SENSE_NONE, 0, "second REQUEST SENSE");
+
+	// Unsupported command (REZERO UNIT)
+	static const uint8 rezero[6] = {0x01, 0, 0, 0, 0, 0};
+	check(send_cmd(rezero, 6, true, data, NULL) == 2, "REZERO UNIT not rejected");
+	check_sense(SENSE_ILLEGAL_REQUEST, ASC_INVALID_OPCODE, "REZERO UNIT");
+	report("Errors and sense data", e);
+}
+
+int main(int argc, char *argv[])
+{
+	std::string path = create_image("disk", NUM_BLOCKS * BLOCK_SIZE);
+	std::string invalid = create_image("invalid", NUM_BLOCKS * BLOCK_SIZE);
+	std::string small = create_image("small", BLOCK_SIZE - 1);
+	image_fd = open(path.c_str(), O_RDONLY);
+	scsi_prefs[0] = path.c_str();
+	scsi_prefs[1] = invalid_image_path = invalid.c_str();
+	scsi_prefs[2] = small.c_str();
+	srand(1);
+
+	SCSIInit();
+	test_open(warnings, invalid.c_str(), small.c_str());
+	if (scsi_set_target(0, 0)) {
+		test_inquiry();
+		test_read_capacity();
+		test_read();
+		test_write();
+		test_errors();
+	}
+	SCSIExit();
+
+	close(image_fd);
+	unlink(path.c_str());
+	unlink(invalid.c_str());
+	unlink(small.c_str());
+	if (errors)
+		printf("%d errors\n", errors);
+	return errors ? 1 : 0;
+}
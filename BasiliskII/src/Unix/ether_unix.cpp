@@ -39,8 +39,12 @@
 #ifdef HAVE_SYS_POLL_H
 #include <sys/poll.h>
 #endif
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #ifdef ENABLE_MACOSX_ETHERHELPER
 
@@ -146,6 +150,50 @@ static pthread_t slirp_thread;				// Slirp reception thread
 static bool slirp_thread_active = false;	// Flag: Slirp reception threadinstalled
 static int slirp_output_fd = -1;			// fd of slirp output pipe
 static int slirp_input_fds[2] = { -1, -1 };	// fds of slirp input pipe
+
+// Received frames for the MacOS, filled by the reception thread (the slirp
+// thread with slirp) and drained by ether_do_interrupt(), so one Ethernet
+// interrupt delivers all frames queued meanwhile. The slirp output pipe only
+// carries a wakeup byte when a frame is queued on an empty ring.
+const int RX_RING_SIZE = 256;				// Frames, must be a power of 2
+struct rx_frame {
+	uint32 length;
+	uint8 data[1516];						// Room for the Linux ethertap prefix
+	struct sockaddr_in from;				// Sender (UDP tunnel)
+};
+static rx_frame *rx_ring = NULL;
+static uint32 rx_ring_head = 0;				// Next frame to fill, advanced by the reception or slirp thread
+static uint32 rx_ring_tail = 0;				// Next frame to deliver, advanced by ether_do_interrupt()
+#ifdef HAVE_SLIRP
+static bool slirp_ring_stalled = false;		// Flag: slirp_can_output() found the ring full
+#endif
+
+#ifndef SHEEPSHAVER
+// Frames to send through the UDP tunnel, queued by ether_udp_write() and
+// sent in batches. Frames written while the MacOS handles received ones are
+// sent by ether_do_interrupt(), others by the reception thread, woken up
+// through the pipe when the ring was empty.
+const int UDP_TX_RING_SIZE = 64;			// Frames, must be a power of 2
+struct udp_tx_frame {
+	struct sockaddr_in to;
+	uint32 length;
+	uint8 data[1514];
+};
+static udp_tx_frame *udp_tx_ring = NULL;
+static uint32 udp_tx_head = 0;				// Next frame to fill, advanced by ether_udp_write()
+static uint32 udp_tx_tail = 0;				// Next frame to send, advanced by the reception thread
+static int udp_wake_fds[2] = { -1, -1 };	// Pipe to wake up the reception thread for sending
+static bool udp_in_interrupt = false;		// Flag: ether_do_interrupt() is delivering UDP frames
+#ifdef HAVE_RECVMMSG
+static struct mmsghdr udp_rx_msgs[RX_RING_SIZE];	// recvmmsg() headers for the receive ring slots
+static struct iovec udp_rx_iov[RX_RING_SIZE];
+#endif
+#endif
+
+// Receive filter, frames the MacOS would discard are dropped before they
+// are queued. Changed by the MacOS thread, read by the reception threads.
+static uint32 rx_type_filter[65536 / 32];	// Bit set for each packet type with a protocol handler
+static uint16 rx_multicast_filter[64];		// Number of enabled multicast addresses for each address hash
 #ifdef HAVE_LIBVDEPLUG
 static VDECONN *vde_conn;
 #endif
@@ -166,6 +214,9 @@ static map<uint16, uint32> net_protocols;
 
 // Prototypes
 static void *receive_func(void *arg);
+#ifndef SHEEPSHAVER
+static void *udp_receive_func(void *arg);
+#endif
 static void *slirp_receive_func(void *arg);
 static int16 ether_do_add_multicast(uint8 *addr);
 static int16 ether_do_del_multicast(uint8 *addr);
@@ -191,8 +242,14 @@ static bool start_thread(void)
 		return false;
 	}
 
+	void *(*thread_func)(void *) = receive_func;
+#ifndef SHEEPSHAVER
+	if (udp_tunnel)
+		thread_func = udp_receive_func;
+#endif
+
 	Set_pthread_attr(&ether_thread_attr, 1);
-	thread_active = (pthread_create(&ether_thread, &ether_thread_attr, receive_func, NULL) == 0);
+	thread_active = (pthread_create(&ether_thread, &ether_thread_attr, thread_func, NULL) == 0);
 	if (!thread_active) {
 		printf("WARNING: Cannot start Ethernet thread");
 		return false;
@@ -343,6 +400,8 @@ bool ether_init(void)
 			return false;
 		fd = fds[0];
 		slirp_output_fd = fds[1];
+		fcntl(slirp_output_fd, F_SETFL, fcntl(slirp_output_fd, F_GETFL, 0) | O_NONBLOCK);
+		slirp_ring_stalled = false;
 
 		// Open slirp input pipe
 		if (pipe(slirp_input_fds) < 0)
@@ -513,6 +572,10 @@ bool ether_init(void)
 		ioctl(fd, SIOCGIFADDR, ether_addr);
 	D(bug("Ethernet address %02x %02x %02x %02x %02x %02x\n", ether_addr[0], ether_addr[1], ether_addr[2], ether_addr[3], ether_addr[4], ether_addr[5]));
 
+	// Allocate receive ring
+	rx_ring = new rx_frame[RX_RING_SIZE];
+	rx_ring_head = rx_ring_tail = 0;
+
 	// Start packet reception thread
 	if (!start_thread())
 		goto open_error;
@@ -539,6 +602,8 @@ open_error:
 		close(slirp_output_fd);
 		slirp_output_fd = -1;
 	}
+	delete[] rx_ring;
+	rx_ring = NULL;
 	return false;
 }
 
@@ -574,6 +639,10 @@ void ether_exit(void)
 	if (slirp_output_fd > 0)
 		close(slirp_output_fd);
 
+	// Free receive ring
+	delete[] rx_ring;
+	rx_ring = NULL;
+
 #ifdef HAVE_LIBVDEPLUG
 	// Close vde_connection
 	if (net_if_type == NET_IF_VDE)
@@ -680,6 +749,26 @@ static inline int ether_arg_to_buffer(uint32 mp, uint8 *p)
 	return ether_msgb_to_buffer(mp, p);
 }
 
+// Point I/O vector at packet data in message block, returns number of
+// entries used or -1 if the packet has more than max_iov fragments
+static int ether_arg_to_iovec(uint32 mp, struct iovec *iov, int max_iov)
+{
+	int n = 0;
+	while (mp) {
+		uint32 start = ReadMacInt32(mp + 12);
+		uint32 size = ReadMacInt32(mp + 16) - start;
+		if (size) {
+			if (n == max_iov)
+				return -1;
+			iov[n].iov_base = Mac2HostAddr(start);
+			iov[n].iov_len = size;
+			n++;
+		}
+		mp = ReadMacInt32(mp + 8);
+	}
+	return n;
+}
+
 // Ethernet interrupt
 void EtherIRQ(void)
 {
@@ -719,6 +808,26 @@ static inline int ether_arg_to_buffer(uint32 wds, uint8 *p)
 	return ether_wds_to_buffer(wds, p);
 }
 
+// Point I/O vector at packet data in WDS, returns number of entries used
+// or -1 if the packet has more than max_iov fragments
+static int ether_arg_to_iovec(uint32 wds, struct iovec *iov, int max_iov)
+{
+	int n = 0, len = 0;
+	while (len < 1514) {
+		int w = ReadMacInt16(wds);
+		if (w == 0)
+			break;
+		if (n == max_iov)
+			return -1;
+		iov[n].iov_base = Mac2HostAddr(ReadMacInt32(wds + 2));
+		iov[n].iov_len = w;
+		n++;
+		len += w;
+		wds += 6;
+	}
+	return n;
+}
+
 // Dispatch packet to protocol handler
 static void ether_dispatch_packet(uint32 p, uint32 length)
 {
@@ -727,9 +836,10 @@ static void ether_dispatch_packet(uint32 p, uint32 length)
 
 	// Look for protocol
 	uint16 search_type = (type <= 1500 ? 0 : type);
-	if (net_protocols.find(search_type) == net_protocols.end())
+	map<uint16, uint32>::const_iterator it = net_protocols.find(search_type);
+	if (it == net_protocols.end())
 		return;
-	uint32 handler = net_protocols[search_type];
+	uint32 handler = it->second;
 
 	// No default handler
 	if (handler == 0)
@@ -763,6 +873,50 @@ void EtherInterrupt(void)
 #endif
 
 
+/*
+ *  Receive filter
+ */
+
+// Hash multicast address for rx_multicast_filter, like the 64-bit
+// multicast hash filters of Ethernet controllers (6 bits of the CRC-32)
+static int ether_multicast_hash(const uint8 *addr)
+{
+	uint32 crc = 0xffffffff;
+	for (int i = 0; i < 6; i++) {
+		uint8 b = addr[i];
+		for (int j = 0; j < 8; j++) {
+			crc = (crc >> 1) ^ (((crc ^ b) & 1) ? 0xedb88320 : 0);
+			b >>= 1;
+		}
+	}
+	return crc & 63;
+}
+
+// Check whether the MacOS has a use for a received frame. Multicast frames
+// need an enabled address (or one with the same hash), and there must be a
+// protocol handler for the packet type. SheepShaver's DLPI streams do their
+// own filtering, some of them take all multicast frames.
+static bool ether_accept_frame(const uint8 *frame, int length)
+{
+	if (length < 14)
+		return false;
+#ifndef SHEEPSHAVER
+	static const uint8 broadcast[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+	if ((frame[0] & 1) && memcmp(frame, broadcast, 6) != 0) {
+		if (__atomic_load_n(&rx_multicast_filter[ether_multicast_hash(frame)], __ATOMIC_RELAXED) == 0)
+			return false;
+	}
+
+	uint16 type = (frame[12] << 8) | frame[13];
+	if (type <= 1500)
+		type = 0;
+	if ((__atomic_load_n(&rx_type_filter[type >> 5], __ATOMIC_RELAXED) & ((uint32)1 << (type & 31))) == 0)
+		return false;
+#endif
+	return true;
+}
+
+
 /*
  *  Reset
  */
@@ -770,6 +924,10 @@ void EtherInterrupt(void)
 void ether_reset(void)
 {
 	net_protocols.clear();
+	for (int i = 0; i < 65536 / 32; i++)
+		__atomic_store_n(&rx_type_filter[i], 0, __ATOMIC_RELAXED);
+	for (int i = 0; i < 64; i++)
+		__atomic_store_n(&rx_multicast_filter[i], 0, __ATOMIC_RELAXED);
 }
 
 
@@ -784,16 +942,16 @@ static int16 ether_do_add_multicast(uint8 *addr)
 	case NET_IF_SHEEPNET:
 		if (ioctl(fd, SIOCADDMULTI, addr) < 0) {
 			D(bug("WARNING: Couldn't enable multicast address\n"));
-			if (net_if_type == NET_IF_ETHERTAP) {
-				return noErr;
-			} else {
+			if (net_if_type != NET_IF_ETHERTAP)
 				return eMultiErr;
-			}
 		}
-		return noErr;
+		break;
 	default:
-		return noErr;
+		break;
 	}
+
+	__atomic_fetch_add(&rx_multicast_filter[ether_multicast_hash(addr)], 1, __ATOMIC_RELAXED);
+	return noErr;
 }
 
 
@@ -810,10 +968,15 @@ static int16 ether_do_del_multicast(uint8 *addr)
 			D(bug("WARNING: Couldn't disable multicast address\n"));
 			return eMultiErr;
 		}
-		return noErr;
+		break;
 	default:
-		return noErr;
+		break;
 	}
+
+	int hash = ether_multicast_hash(addr);
+	if (rx_multicast_filter[hash])
+		__atomic_fetch_sub(&rx_multicast_filter[hash], 1, __ATOMIC_RELAXED);
+	return noErr;
 }
 
 
@@ -826,6 +989,8 @@ int16 ether_attach_ph(uint16 type, uint32 handler)
 	if (net_protocols.find(type) != net_protocols.end())
 		return lapProtErr;
 	net_protocols[type] = handler;
+	if (handler)
+		__atomic_fetch_or(&rx_type_filter[type >> 5], (uint32)1 << (type & 31), __ATOMIC_RELAXED);
 	return noErr;
 }
 
@@ -838,6 +1003,7 @@ int16 ether_detach_ph(uint16 type)
 {
 	if (net_protocols.erase(type) == 0)
 		return lapProtErr;
+	__atomic_fetch_and(&rx_type_filter[type >> 5], ~((uint32)1 << (type & 31)), __ATOMIC_RELAXED);
 	return noErr;
 }
 
@@ -846,8 +1012,55 @@ int16 ether_detach_ph(uint16 type)
  *  Transmit raw ethernet packet
  */
 
+// Maximum number of packet fragments gathered by ether_do_writev()
+const int ETHER_MAX_IOV = 16;
+
+// Transmit packet straight from the MacOS buffers, returns false if the
+// interface can't take it that way
+static bool ether_do_writev(uint32 arg, int16 &result)
+{
+	// Fragments go to iov[1..n], iov[0] is room for the slirp length
+	struct iovec iov[ETHER_MAX_IOV + 1];
+	int n = ether_arg_to_iovec(arg, iov + 1, ETHER_MAX_IOV);
+	if (n <= 0)
+		return false;
+
+#ifdef HAVE_SLIRP
+	if (net_if_type == NET_IF_SLIRP) {
+		// Length and packet in one write, which the pipe keeps atomic
+		int len = 0;
+		for (int i = 1; i <= n; i++)
+			len += iov[i].iov_len;
+		iov[0].iov_base = &len;
+		iov[0].iov_len = sizeof(len);
+		writev(slirp_input_fds[1], iov, n + 1);
+		result = noErr;
+		return true;
+	}
+#endif
+
+	// The TUN/TAP driver takes a frame from one writev() call, unlike
+	// sheep_net and ethertap which would see each fragment as a frame
+	if (net_if_type == NET_IF_TUNTAP) {
+		if (writev(fd, iov + 1, n) < 0) {
+			D(bug("WARNING: Couldn't transmit packet\n"));
+			result = excessCollsns;
+		} else
+			result = noErr;
+		return true;
+	}
+	return false;
+}
+
 static int16 ether_do_write(uint32 arg)
 {
+#if !MONITOR
+	// Avoid the copy where possible
+	int16 result;
+	if (ether_do_writev(arg, result))
+		return result;
+#endif
+
 	// Copy packet to buffer
 	uint8 packet[1516], *p = packet;
 	int len = 0;
@@ -923,11 +1136,58 @@ static int16 ether_do_write(uint32 arg)
  *  Start UDP packet reception thread
  */
 
+static void udp_free_rings(void)
+{
+#ifndef SHEEPSHAVER
+	for (int i = 0; i < 2; i++) {
+		if (udp_wake_fds[i] >= 0) {
+			close(udp_wake_fds[i]);
+			udp_wake_fds[i] = -1;
+		}
+	}
+	delete[] rx_ring;
+	rx_ring = NULL;
+	delete[] udp_tx_ring;
+	udp_tx_ring = NULL;
+#endif
+}
+
 bool ether_start_udp_thread(int socket_fd)
 {
 	fd = socket_fd;
 	udp_tunnel = true;
-	return start_thread();
+
+#ifndef SHEEPSHAVER
+	// Allocate receive and transmit rings
+	if (pipe(udp_wake_fds) < 0) {
+		printf("WARNING: Cannot create UDP tunnel pipe (%s)\n", strerror(errno));
+		return false;
+	}
+	fcntl(udp_wake_fds[0], F_SETFL, O_NONBLOCK);
+	fcntl(udp_wake_fds[1], F_SETFL, O_NONBLOCK);
+	rx_ring = new rx_frame[RX_RING_SIZE];
+	rx_ring_head = rx_ring_tail = 0;
+#ifdef HAVE_RECVMMSG
+	memset(udp_rx_msgs, 0, sizeof(udp_rx_msgs));
+	for (int i = 0; i < RX_RING_SIZE; i++) {
+		udp_rx_iov[i].iov_base = rx_ring[i].data;
+		udp_rx_iov[i].iov_len = 1514;
+		udp_rx_msgs[i].msg_hdr.msg_name = &rx_ring[i].from;
+		udp_rx_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		udp_rx_msgs[i].msg_hdr.msg_iov = &udp_rx_iov[i];
+		udp_rx_msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+#endif
+	udp_tx_ring = new udp_tx_frame[UDP_TX_RING_SIZE];
+	udp_tx_head = udp_tx_tail = 0;
+#endif
+
+	if (!start_thread()) {
+		stop_thread();
+		udp_free_rings();
+		return false;
+	}
+	return true;
 }
 
 
@@ -939,9 +1199,206 @@ void ether_stop_udp_thread(void)
 {
 	stop_thread();
 	fd = -1;
+	udp_free_rings();
 }
 
 
+/*
+ *  Receive ring
+ */
+
+static inline bool rx_ring_full(void)
+{
+	return rx_ring_head - __atomic_load_n(&rx_ring_tail, __ATOMIC_SEQ_CST) >= RX_RING_SIZE;
+}
+
+// Queue the frame in the next slot of the ring, after it was filled in
+static inline void rx_ring_put(uint32 head)
+{
+	__atomic_store_n(&rx_ring_head, head + 1, __ATOMIC_SEQ_CST);
+}
+
+// Take the next frame off the receive ring, returns its length or 0
+static int rx_ring_get(uint8 *packet, struct sockaddr_in *from = NULL)
+{
+	uint32 tail = rx_ring_tail;
+	if (tail == __atomic_load_n(&rx_ring_head, __ATOMIC_SEQ_CST))
+		return 0;
+	const rx_frame *f = &rx_ring[tail & (RX_RING_SIZE - 1)];
+	int length = f->length;
+	memcpy(packet, f->data, length);
+	if (from)
+		*from = f->from;
+	__atomic_store_n(&rx_ring_tail, tail + 1, __ATOMIC_SEQ_CST);
+	return length;
+}
+
+// Read frames from the network device into the receive ring, returns the
+// number of frames queued for the MacOS
+static int ether_read_frames(void)
+{
+	int queued = 0;
+	while (!rx_ring_full()) {
+		uint32 head = rx_ring_head;
+		rx_frame *f = &rx_ring[head & (RX_RING_SIZE - 1)];
+		ssize_t length;
+#ifdef HAVE_LIBVDEPLUG
+		if (net_if_type == NET_IF_VDE) {
+			length = vde_recv(vde_conn, f->data, 1514, 0);
+		} else
+#endif
+		{
+#if defined(__linux__)
+			length = read(fd, f->data, net_if_type == NET_IF_ETHERTAP ? 1516 : 1514);
+			if (net_if_type == NET_IF_ETHERTAP && length >= 2) {
+				length -= 2;	// Linux ethertap has two random bytes before the packet
+				memmove(f->data, f->data + 2, length);
+			}
+#else
+			length = read(fd, f->data, 1514);
+#endif
+		}
+		if (length < 14)
+			break;
+
+		if (ether_accept_frame(f->data, length)) {
+			f->length = length;
+			rx_ring_put(head);
+			queued++;
+		}
+	}
+	return queued;
+}
+
+
+/*
+ *  UDP tunnel rings
+ */
+
+#ifndef SHEEPSHAVER
+// Read datagrams from the UDP tunnel socket into the receive ring, returns
+// the number of frames queued for the MacOS
+static int udp_read_frames(void)
+{
+	uint32 head = rx_ring_head;
+	int space = RX_RING_SIZE - (head - __atomic_load_n(&rx_ring_tail, __ATOMIC_SEQ_CST));
+	int queued = 0;
+
+#ifdef HAVE_RECVMMSG
+	// Receive into the free slots up to the end of the ring in one go
+	uint32 first = head & (RX_RING_SIZE - 1);
+	if (space > (int)(RX_RING_SIZE - first))
+		space = RX_RING_SIZE - first;
+	struct mmsghdr *msgs = udp_rx_msgs + first;
+	int n = space ? recvmmsg(fd, msgs, space, MSG_DONTWAIT, NULL) : 0;
+	for (int i = 0; i < n; i++) {
+		msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		if (msgs[i].msg_len < 14)
+			continue;
+
+		// Close the gap left by a runt datagram
+		rx_frame *f = &rx_ring[(head + queued) & (RX_RING_SIZE - 1)];
+		if (queued != i) {
+			const rx_frame *g = &rx_ring[(head + i) & (RX_RING_SIZE - 1)];
+			memcpy(f->data, g->data, msgs[i].msg_len);
+			f->from = g->from;
+		}
+		f->length = msgs[i].msg_len;
+		queued++;
+	}
+#else
+	while (queued < space) {
+		rx_frame *f = &rx_ring[(head + queued) & (RX_RING_SIZE - 1)];
+		socklen_t from_len = sizeof(f->from);
+		ssize_t length = recvfrom(fd, f->data, 1514, 0, (struct sockaddr *)&f->from, &from_len);
+		if (length < 0)
+			break;
+		if (length < 14)
+			continue;
+		f->length = length;
+		queued++;
+	}
+#endif
+
+	if (queued)
+		rx_ring_put(head + queued - 1);
+	return queued;
+}
+
+// Send the frames queued by ether_udp_write()
+static void udp_send_frames(void)
+{
+	for (;;) {
+		uint32 tail = udp_tx_tail;
+		uint32 head = __atomic_load_n(&udp_tx_head, __ATOMIC_SEQ_CST);
+		int n = head - tail;
+		if (n == 0)
+			return;
+
+#ifdef HAVE_SENDMMSG
+		struct mmsghdr msgs[UDP_TX_RING_SIZE];
+		struct iovec iov[UDP_TX_RING_SIZE];
+		memset(msgs, 0, n * sizeof(msgs[0]));
+		for (int i = 0; i < n; i++) {
+			udp_tx_frame *f = &udp_tx_ring[(tail + i) & (UDP_TX_RING_SIZE - 1)];
+			iov[i].iov_base = f->data;
+			iov[i].iov_len = f->length;
+			msgs[i].msg_hdr.msg_name = &f->to;
+			msgs[i].msg_hdr.msg_namelen = sizeof(f->to);
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		int sent = 0;
+		while (sent < n) {
+			int res = sendmmsg(fd, msgs + sent, n - sent, 0);
+			if (res < 0) {
+				if (errno == EINTR)
+					continue;
+				D(bug("WARNING: Couldn't transmit packet\n"));
+				res = 1;	// Drop the frame that failed
+			}
+			sent += res;
+		}
+#else
+		for (int i = 0; i < n; i++) {
+			udp_tx_frame *f = &udp_tx_ring[(tail + i) & (UDP_TX_RING_SIZE - 1)];
+			if (sendto(fd, f->data, f->length, 0, (struct sockaddr *)&f->to, sizeof(f->to)) < 0)
+				D(bug("WARNING: Couldn't transmit packet\n"));
+		}
+#endif
+
+		// Look for frames queued meanwhile before going to sleep
+		__atomic_store_n(&udp_tx_tail, head, __ATOMIC_SEQ_CST);
+	}
+}
+
+// Queue packet for sending to UDP tunnel peer
+int16 ether_udp_write(const uint8 *packet, int length, const struct sockaddr_in *to)
+{
+	uint32 head = udp_tx_head;
+	if (head - __atomic_load_n(&udp_tx_tail, __ATOMIC_SEQ_CST) >= UDP_TX_RING_SIZE) {
+		// Ring full, send directly
+		if (sendto(fd, packet, length, 0, (const struct sockaddr *)to, sizeof(*to)) < 0) {
+			D(bug("WARNING: Couldn't transmit packet\n"));
+			return excessCollsns;
+		}
+		return noErr;
+	}
+
+	udp_tx_frame *f = &udp_tx_ring[head & (UDP_TX_RING_SIZE - 1)];
+	f->to = *to;
+	f->length = length;
+	memcpy(f->data, packet, length);
+	__atomic_store_n(&udp_tx_head, head + 1, __ATOMIC_SEQ_CST);
+
+	// Wake up the reception thread if it may be done with the ring already
+	if (!udp_in_interrupt && __atomic_load_n(&udp_tx_tail, __ATOMIC_SEQ_CST) == head)
+		write(udp_wake_fds[1], "", 1);
+	return noErr;
+}
+#endif
+
+
 /*
  *  SLIRP output buffer glue
  */
@@ -949,18 +1406,109 @@ void ether_stop_udp_thread(void)
 #ifdef HAVE_SLIRP
 int slirp_can_output(void)
 {
-	return 1;
+	if (!rx_ring_full())
+		return 1;
+
+	// Have ether_do_interrupt() get slirp going again once it made room,
+	// unless it just did so
+	__atomic_store_n(&slirp_ring_stalled, true, __ATOMIC_SEQ_CST);
+	return !rx_ring_full();
 }
 
 void slirp_output(const uint8 *packet, int len)
 {
-	write(slirp_output_fd, packet, len);
+	// Frames that don't fit are dropped, as by a real network card
+	uint32 head = rx_ring_head;
+	if (len > 1514 || rx_ring_full() || !ether_accept_frame(packet, len))
+		return;
+	rx_frame *f = &rx_ring[head & (RX_RING_SIZE - 1)];
+	f->length = len;
+	memcpy(f->data, packet, len);
+	rx_ring_put(head);
+
+	// Wake up the reception thread if ether_do_interrupt() may be done
+	// with the ring already, otherwise it will find this frame too
+	if (__atomic_load_n(&rx_ring_tail, __ATOMIC_SEQ_CST) == head)
+		write(slirp_output_fd, "", 1);
+}
+
+// The slirp ring has been drained, restart slirp output if it had to stop.
+// A zero-length packet on the input pipe wakes the slirp thread up.
+static void slirp_ring_drained(void)
+{
+	if (__atomic_exchange_n(&slirp_ring_stalled, false, __ATOMIC_SEQ_CST)) {
+		int len = 0;
+		write(slirp_input_fds[1], &len, sizeof(len));
+	}
+}
+
+// Pass a packet from the input queue to slirp
+static void slirp_read_input(int slirp_input_fd)
+{
+	int len;
+	read(slirp_input_fd, &len, sizeof(len));
+	uint8 packet[1516];
+	assert(len <= (int)sizeof(packet));
+	read(slirp_input_fd, packet, len);
+	slirp_input(packet, len);
+}
+
+#ifdef SLIRP_USE_EPOLL
+// Wait for the input queue and the slirp sockets in one epoll_wait(),
+// the slirp sockets being registered once with slirp_epoll_fd()
+static void slirp_epoll_close(void *arg)
+{
+	close(*(int *)arg);
+}
+
+static bool slirp_epoll_loop(int slirp_input_fd)
+{
+	if (slirp_epoll_fd() < 0)
+		return false;
+	int epfd = epoll_create(2);
+	if (epfd < 0)
+		return false;
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = slirp_input_fd;
+	bool ok = epoll_ctl(epfd, EPOLL_CTL_ADD, slirp_input_fd, &ev) == 0;
+	ev.data.fd = slirp_epoll_fd();
+	ok = ok && epoll_ctl(epfd, EPOLL_CTL_ADD, slirp_epoll_fd(), &ev) == 0;
+	if (!ok) {
+		close(epfd);
+		return false;
+	}
+
+	pthread_cleanup_push(slirp_epoll_close, &epfd);
+	for (;;) {
+		int timeout = slirp_epoll_fill();
+#if ! USE_SLIRP_TIMEOUT
+		if (timeout > 0)
+			timeout = 10000;
+#endif
+		struct epoll_event events[2];
+		int n = epoll_wait(epfd, events, 2, (timeout + 999) / 1000);
+		for (int i = 0; i < n; i++) {
+			if (events[i].data.fd == slirp_input_fd)
+				slirp_read_input(slirp_input_fd);
+		}
+		slirp_epoll_poll();
+	}
+	pthread_cleanup_pop(1);
+	return true;
 }
+#endif
 
 void *slirp_receive_func(void *arg)
 {
 	const int slirp_input_fd = slirp_input_fds[0];
 
+#ifdef SLIRP_USE_EPOLL
+	if (slirp_epoll_loop(slirp_input_fd))
+		return NULL;
+#endif
+
 	for (;;) {
 		// Wait for packets to arrive
 		fd_set rfds, wfds, xfds;
@@ -972,14 +1520,8 @@ void *slirp_receive_func(void *arg)
 		FD_SET(slirp_input_fd, &rfds);
 		tv.tv_sec = 0;
 		tv.tv_usec = 0;
-		if (select(slirp_input_fd + 1, &rfds, NULL, NULL, &tv) > 0) {
-			int len;
-			read(slirp_input_fd, &len, sizeof(len));
-			uint8 packet[1516];
-			assert(len <= sizeof(packet));
-			read(slirp_input_fd, packet, len);
-			slirp_input(packet, len);
-		}
+		if (select(slirp_input_fd + 1, &rfds, NULL, NULL, &tv) > 0)
+			slirp_read_input(slirp_input_fd);
 
 		// ... in the output queue
 		nfds = -1;
@@ -1052,6 +1594,11 @@ static void *receive_func(void *arg)
 		}
 #endif
 		if (ether_driver_opened) {
+			// Read the frames, unless they are queued by slirp or left to
+			// ether_do_interrupt(). Don't bother the MacOS if none is wanted.
+			if (rx_ring && net_if_type != NET_IF_SLIRP && !udp_tunnel && ether_read_frames() == 0)
+				continue;
+
 			// Trigger Ethernet interrupt
 			D(bug(" packet received, triggering Ethernet interrupt\n"));
 			SetInterruptFlag(INTFLAG_ETHER);
@@ -1066,6 +1613,66 @@ static void *receive_func(void *arg)
 }
 
 
+/*
+ *  Packet reception and transmission thread (UDP tunnel)
+ */
+
+#ifndef SHEEPSHAVER
+static void *udp_receive_func(void *arg)
+{
+	for (;;) {
+
+		// Wait for packets to arrive or to be sent
+#if USE_POLL
+		struct pollfd pf[2] = {{fd, POLLIN, 0}, {udp_wake_fds[0], POLLIN, 0}};
+		int res = poll(pf, 2, -1);
+		if (res == -1 && errno == EINTR)
+			continue;
+		bool readable = pf[0].revents != 0;
+		bool woken = pf[1].revents != 0;
+#else
+		fd_set rfds;
+		FD_ZERO(&rfds);
+		FD_SET(fd, &rfds);
+		FD_SET(udp_wake_fds[0], &rfds);
+		// A NULL timeout could cause select() to block indefinitely,
+		// even if it is supposed to be a cancellation point [MacOS X]
+		struct timeval tv = { 0, 20000 };
+		int res = select((fd > udp_wake_fds[0] ? fd : udp_wake_fds[0]) + 1, &rfds, NULL, NULL, &tv);
+#ifdef HAVE_PTHREAD_TESTCANCEL
+		pthread_testcancel();
+#endif
+		if (res == 0 || (res == -1 && errno == EINTR))
+			continue;
+		bool readable = FD_ISSET(fd, &rfds);
+		bool woken = FD_ISSET(udp_wake_fds[0], &rfds);
+#endif
+		if (res <= 0)
+			break;
+
+		// Send queued frames
+		if (woken) {
+			char wakeups[64];
+			while (read(udp_wake_fds[0], wakeups, sizeof(wakeups)) > 0) ;
+			udp_send_frames();
+		}
+
+		// Read all frames that arrived and have the MacOS process them in
+		// one interrupt, frames arriving meanwhile wait for the next batch
+		if (readable && udp_read_frames() > 0) {
+			D(bug(" packet received, triggering Ethernet interrupt\n"));
+			SetInterruptFlag(INTFLAG_ETHER);
+			TriggerInterrupt();
+
+			// Wait for interrupt acknowledge by EtherInterrupt()
+			sem_wait(&int_ack);
+		}
+	}
+	return NULL;
+}
+#endif
+
+
 /*
  *  Ethernet interrupt - activate deferred tasks to call IODone or protocol handlers
  */
@@ -1076,17 +1683,33 @@ void ether_do_interrupt(void)
 	EthernetPacket ether_packet;
 	uint32 packet = ether_packet.addr();
 	ssize_t length;
+
+#ifdef HAVE_SLIRP
+	// Consume the wakeups, frames queued from now on send new ones
+	if (net_if_type == NET_IF_SLIRP) {
+		char wakeups[64];
+		while (read(fd, wakeups, sizeof(wakeups)) > 0) ;
+	}
+#endif
+
 	for (;;) {
 
 #ifndef SHEEPSHAVER
 		if (udp_tunnel) {
 
-			// Read packet from socket
+			// Take packet off the receive ring. The reception thread waits
+			// for the interrupt acknowledge, so the rings are ours meanwhile:
+			// once empty, send the replies and read the frames that arrived.
 			struct sockaddr_in from;
-			socklen_t from_len = sizeof(from);
-			length = recvfrom(fd, Mac2HostAddr(packet), 1514, 0, (struct sockaddr *)&from, &from_len);
-			if (length < 14)
+			length = rx_ring_get(Mac2HostAddr(packet), &from);
+			if (length == 0) {
+				udp_send_frames();
+				if (udp_read_frames() > 0)
+					continue;
+				udp_in_interrupt = false;
 				break;
+			}
+			udp_in_interrupt = true;
 			ether_udp_read(packet, length, &from);
 
 		} else
@@ -1104,19 +1727,12 @@ void ether_do_interrupt(void)
 		} else
 #endif
 		{
-#ifdef HAVE_LIBVDEPLUG
-			if (net_if_type == NET_IF_VDE) {
-				length = vde_recv(vde_conn, Mac2HostAddr(packet), 1514, 0);
-			} else
-#endif
-			{
-				// Read packet from sheep_net device
-#if defined(__linux__)
-				length = read(fd, Mac2HostAddr(packet), net_if_type == NET_IF_ETHERTAP ? 1516 : 1514);
-#else
-				length = read(fd, Mac2HostAddr(packet), 1514);
+			// Take packet off the receive ring
+			length = rx_ring_get(Mac2HostAddr(packet));
+#ifdef HAVE_SLIRP
+			if (length == 0 && net_if_type == NET_IF_SLIRP)
+				slirp_ring_drained();
 #endif
-			}
 
 			if (length < 14)
 				break;
@@ -1129,17 +1745,8 @@ void ether_do_interrupt(void)
 			bug("\n");
 #endif
 
-			// Pointer to packet data (Ethernet header)
-			uint32 p = packet;
-#if defined(__linux__)
-			if (net_if_type == NET_IF_ETHERTAP) {
-				p += 2;			// Linux ethertap has two random bytes before the packet
-				length -= 2;
-			}
-#endif
-
 			// Dispatch packet
-			ether_dispatch_packet(p, length);
+			ether_dispatch_packet(packet, length);
 		}
 	}
 }
@@ -31,7 +31,7 @@
 # include <SDL_main.h>
 #endif
 
-#ifndef USE_SDL_VIDEO
+#if !defined(USE_SDL_VIDEO) && !defined(USE_HEADLESS_VIDEO)
 # include <X11/Xlib.h>
 #endif
 
@@ -137,7 +137,7 @@ bool TwentyFourBitAddressing;
 
 
 // Global variables
-#ifndef USE_SDL_VIDEO
+#if !defined(USE_SDL_VIDEO) && !defined(USE_HEADLESS_VIDEO)
 extern char *x_display_name;						// X11 display name
 extern Display *x_display;							// X11 display handle
 #ifdef X11_LOCK_TYPE
@@ -152,14 +152,28 @@ static uint8 last_xpram[XPRAM_SIZE];				// Buffer for monitoring XPRAM changes
 static pthread_t emul_thread;						// Handle of MacOS emulation thread (main thread)
 #endif
 
-static bool xpram_thread_active = false;			// Flag: XPRAM watchdog installed
-static volatile bool xpram_thread_cancel = false;	// Flag: Cancel XPRAM thread
-static pthread_t xpram_thread;						// XPRAM watchdog
+static bool tick_thread_active = false;				// Flag: Tick scheduler thread installed
+static volatile bool tick_thread_cancel = false;	// Flag: Cancel tick scheduler thread
+static pthread_t tick_thread;						// Tick scheduler thread
+static pthread_attr_t tick_thread_attr;				// Tick scheduler thread attributes
 
-static bool tick_thread_active = false;				// Flag: 60Hz thread installed
-static volatile bool tick_thread_cancel = false;	// Flag: Cancel 60Hz thread
-static pthread_t tick_thread;						// 60Hz thread
-static pthread_attr_t tick_thread_attr;				// 60Hz thread attributes
+// Periodic and one-shot events served by the tick scheduler thread
+enum {
+	TICK_EVENT_60HZ,		// 60.15Hz VBL
+	TICK_EVENT_1HZ,			// 1Hz interrupt
+	TICK_EVENT_XPRAM,		// XPRAM watchdog
+	TICK_EVENT_TIMER,		// Earliest Time Manager task
+	NUM_TICK_EVENTS
+};
+
+struct TickEvent {
+	uint64 deadline;	// Absolute time in GetTicks_usec() units (0 = not scheduled)
+	uint64 period;		// Rearm interval in microseconds (0 = one-shot)
+};
+
+static TickEvent tick_events[NUM_TICK_EVENTS];
+static pthread_mutex_t tick_events_lock = PTHREAD_MUTEX_INITIALIZER;	// Protects tick_events[]
+static pthread_cond_t tick_events_cond = PTHREAD_COND_INITIALIZER;		// Signalled when a deadline moves earlier
 
 static pthread_mutex_t intflag_lock = PTHREAD_MUTEX_INITIALIZER;	// Mutex to protect InterruptFlags
 #define LOCK_INTFLAGS pthread_mutex_lock(&intflag_lock)
@@ -207,7 +221,6 @@ static const char *gui_connection_path = NULL;	// GUI connection identifier
 
 
 // Prototypes
-static void *xpram_func(void *arg);
 static void *tick_func(void *arg);
 static void one_tick(...);
 #if !EMULATED_68K
@@ -420,7 +433,7 @@ int main(int argc, char **argv)
 	for (int i=1; i<argc; i++) {
 		if (strcmp(argv[i], "--help") == 0) {
 			usage(argv[0]);
-#ifndef USE_SDL_VIDEO
+#if !defined(USE_SDL_VIDEO) && !defined(USE_HEADLESS_VIDEO)
 		} else if (strcmp(argv[i], "--display") == 0) {
 			i++; // don't remove the argument, gtk_init() needs it too
 			if (i < argc)
@@ -528,7 +541,7 @@ int main(int argc, char **argv)
 		}
 	}
 
-#ifndef USE_SDL_VIDEO
+#if !defined(USE_SDL_VIDEO) && !defined(USE_HEADLESS_VIDEO)
 	// Open display
 	x_display = XOpenDisplay(x_display_name);
 	if (x_display == NULL) {
@@ -814,7 +827,8 @@ int main(int argc, char **argv)
 #ifndef USE_CPU_EMUL_SERVICES
 #if defined(HAVE_PTHREADS)
 
-	// POSIX threads available, start 60Hz thread
+	// POSIX threads available, start tick scheduler thread
+	memcpy(last_xpram, XPRAM, XPRAM_SIZE);
 	Set_pthread_attr(&tick_thread_attr, 0);
 	tick_thread_active = (pthread_create(&tick_thread, &tick_thread_attr, tick_func, NULL) == 0);
 	if (!tick_thread_active) {
@@ -822,7 +836,7 @@ int main(int argc, char **argv)
 		ErrorAlert(str);
 		QuitEmulator();
 	}
-	D(bug("60Hz thread started\n"));
+	D(bug("Tick scheduler thread started\n"));
 
 #elif defined(HAVE_TIMER_CREATE) && defined(_POSIX_REALTIME_SIGNALS)
 
@@ -877,13 +891,6 @@ int main(int argc, char **argv)
 #endif
 #endif
 
-#ifdef USE_PTHREADS_SERVICES
-	// Start XPRAM watchdog thread
-	memcpy(last_xpram, XPRAM, XPRAM_SIZE);
-	xpram_thread_active = (pthread_create(&xpram_thread, NULL, xpram_func, NULL) == 0);
-	D(bug("XPRAM thread started\n"));
-#endif
-
 	// Start 68k and jump to ROM boot routine
 	D(bug("Starting emulation...\n"));
 	Start680x0();
@@ -913,12 +920,12 @@ void QuitEmulator(void)
 		  (long)emulated_ticks_count, (long)(emulated_ticks_end - emulated_ticks_start),
 		  emulated_ticks_count * 1000000.0 / (emulated_ticks_end - emulated_ticks_start), (long)n_check_ticks));
 #elif defined(USE_PTHREADS_SERVICES)
-	// Stop 60Hz thread
+	// Stop tick scheduler thread
 	if (tick_thread_active) {
+		pthread_mutex_lock(&tick_events_lock);
 		tick_thread_cancel = true;
-#ifdef HAVE_PTHREAD_CANCEL
-		pthread_cancel(tick_thread);
-#endif
+		pthread_cond_signal(&tick_events_cond);
+		pthread_mutex_unlock(&tick_events_lock);
 		pthread_join(tick_thread, NULL);
 	}
 #elif defined(HAVE_TIMER_CREATE) && defined(_POSIX_REALTIME_SIGNALS)
@@ -931,17 +938,6 @@ void QuitEmulator(void)
 	setitimer(ITIMER_REAL, &req, NULL);
 #endif
 
-#ifdef USE_PTHREADS_SERVICES
-	// Stop XPRAM watchdog thread
-	if (xpram_thread_active) {
-		xpram_thread_cancel = true;
-#ifdef HAVE_PTHREAD_CANCEL
-		pthread_cancel(xpram_thread);
-#endif
-		pthread_join(xpram_thread, NULL);
-	}
-#endif
-
 	// Deinitialize everything
 	ExitAll();
 
@@ -976,7 +972,7 @@ void QuitEmulator(void)
 	PrefsExit();
 
 	// Close X11 server connection
-#ifndef USE_SDL_VIDEO
+#if !defined(USE_SDL_VIDEO) && !defined(USE_HEADLESS_VIDEO)
 	if (x_display)
 		XCloseDisplay(x_display);
 #endif
@@ -1189,7 +1185,7 @@ void TriggerNMI(void)
 
 
 /*
- *  XPRAM watchdog thread (saves XPRAM every minute)
+ *  XPRAM watchdog (saves XPRAM every minute)
  */
 
 static void xpram_watchdog(void)
@@ -1200,21 +1196,9 @@ static void xpram_watchdog(void)
 	}
 }
 
-#ifdef USE_PTHREADS_SERVICES
-static void *xpram_func(void *arg)
-{
-	while (!xpram_thread_cancel) {
-		for (int i=0; i<60 && !xpram_thread_cancel; i++)
-			Delay_usec(999999);		// Only wait 1 second so we quit promptly when xpram_thread_cancel becomes true
-		xpram_watchdog();
-	}
-	return NULL;
-}
-#endif
-
 
 /*
- *  60Hz thread (really 60.15Hz)
+ *  60Hz (really 60.15Hz) and 1Hz interrupts
  */
 
 static void one_second(void)
@@ -1236,13 +1220,14 @@ static void one_second(void)
 
 static void one_tick(...)
 {
+#ifndef USE_PTHREADS_SERVICES
+	// Tick scheduler not used, derive 1Hz interrupt from 60Hz tick
 	static int tick_counter = 0;
 	if (++tick_counter > 60) {
 		tick_counter = 0;
 		one_second();
 	}
 
-#ifndef USE_PTHREADS_SERVICES
 	// Threads not used to trigger interrupts, perform video refresh from here
 	VideoRefresh();
 #endif
@@ -1259,26 +1244,122 @@ static void one_tick(...)
 	}
 }
 
+
+/*
+ *  Tick scheduler thread, sleeps until the earliest pending event deadline
+ *  (60Hz, 1Hz, XPRAM watchdog, Time Manager) and dispatches it
+ */
+
 #ifdef USE_PTHREADS_SERVICES
+static void tick_event_schedule(int event, uint64 deadline, uint64 period)
+{
+	pthread_mutex_lock(&tick_events_lock);
+	uint64 old_deadline = tick_events[event].deadline;
+	tick_events[event].deadline = deadline;
+	tick_events[event].period = period;
+	if (deadline && (old_deadline == 0 || deadline < old_deadline))
+		pthread_cond_signal(&tick_events_cond);
+	pthread_mutex_unlock(&tick_events_lock);
+}
+
+// Wait until deadline (0 = forever) or until tick_events_cond is signalled, tick_events_lock held
+static void tick_events_wait(uint64 deadline)
+{
+	if (deadline == 0) {
+		pthread_cond_wait(&tick_events_cond, &tick_events_lock);
+		return;
+	}
+
+	// pthread_cond_timedwait() wants the wall clock, which need not be the GetTicks_usec() time base
+	int64 delay = deadline - GetTicks_usec();
+	if (delay <= 0)
+		return;
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	uint64 abs_usec = (uint64)now.tv_sec * 1000000 + now.tv_usec + delay;
+	struct timespec abs_time;
+	abs_time.tv_sec = abs_usec / 1000000;
+	abs_time.tv_nsec = (abs_usec % 1000000) * 1000;
+	pthread_cond_timedwait(&tick_events_cond, &tick_events_lock, &abs_time);
+}
+
 static void *tick_func(void *arg)
 {
 	uint64 start = GetTicks_usec();
 	int64 ticks = 0;
-	uint64 next = GetTicks_usec();
+
+	tick_event_schedule(TICK_EVENT_60HZ, start, 16625);
+	tick_event_schedule(TICK_EVENT_1HZ, start + 1000000, 1000000);
+	tick_event_schedule(TICK_EVENT_XPRAM, start + 60000000, 60000000);
+
+	pthread_mutex_lock(&tick_events_lock);
 	while (!tick_thread_cancel) {
-		one_tick();
-		next += 16625;
-		int64 delay = next - GetTicks_usec();
-		if (delay > 0)
-			Delay_usec(delay);
-		else if (delay < -16625)
-			next = GetTicks_usec();
-		ticks++;
+
+		// Find earliest deadline
+		int event = -1;
+		for (int i = 0; i < NUM_TICK_EVENTS; i++)
+			if (tick_events[i].deadline && (event < 0 || tick_events[i].deadline < tick_events[event].deadline))
+				event = i;
+
+		uint64 now = GetTicks_usec();
+		if (event < 0 || tick_events[event].deadline > now) {
+			tick_events_wait(event < 0 ? 0 : tick_events[event].deadline);
+			continue;
+		}
+
+		// Deadline reached, rearm periodic events (resynchronize if we fell behind by more than one period)
+		TickEvent &e = tick_events[event];
+		if (e.period) {
+			e.deadline += e.period;
+			if (e.deadline + e.period < now)
+				e.deadline = now;
+		} else
+			e.deadline = 0;
+
+		pthread_mutex_unlock(&tick_events_lock);
+		switch (event) {
+			case TICK_EVENT_60HZ:
+				one_tick();
+				ticks++;
+				break;
+			case TICK_EVENT_1HZ:
+				one_second();
+				break;
+			case TICK_EVENT_XPRAM:
+				xpram_watchdog();
+				break;
+			case TICK_EVENT_TIMER:
+				SetInterruptFlag(INTFLAG_TIMER);
+				TriggerInterrupt();
+				break;
+		}
+		pthread_mutex_lock(&tick_events_lock);
 	}
+	pthread_mutex_unlock(&tick_events_lock);
+
 	uint64 end = GetTicks_usec();
 	D(bug("%lld ticks in %lld usec = %f ticks/sec\n", ticks, end - start, ticks * 1000000.0 / (end - start)));
 	return NULL;
 }
+
+
+/*
+ *  Schedule Time Manager interrupt for given wakeup time (NULL = no task pending)
+ */
+
+void timer_schedule_interrupt(const tm_time_t *wakeup)
+{
+	uint64 deadline = 0;
+	if (wakeup) {
+		// Round up so that the task has expired when the interrupt is triggered
+#if defined(HAVE_CLOCK_GETTIME) || defined(__MACH__)
+		deadline = (uint64)wakeup->tv_sec * 1000000 + (wakeup->tv_nsec + 999) / 1000;
+#else
+		deadline = (uint64)wakeup->tv_sec * 1000000 + wakeup->tv_usec + 1;
+#endif
+	}
+	tick_event_schedule(TICK_EVENT_TIMER, deadline, 0);
+}
 #endif
 
 
@@ -37,6 +37,9 @@ prefs_desc platform_prefs_items[] = {
 	{"idlewait", TYPE_BOOLEAN, false,      "sleep when idle"},
 #ifdef USE_SDL_VIDEO
 	{"sdlrender", TYPE_STRING, false,      "SDL_Renderer driver (\"auto\", \"software\" (may be faster), etc.)"},
+#endif
+#ifdef USE_HEADLESS_VIDEO
+	{"headlessshm", TYPE_STRING, false,    "name of the shared memory object the screen is exported to"},
 #endif
 	{NULL, TYPE_END, false, NULL} // End of list
 };
@@ -23,8 +23,8 @@
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/poll.h>
 #include <pthread.h>
-#include <semaphore.h>
 #include <termios.h>
 #include <errno.h>
 #ifdef __linux__
@@ -76,6 +76,60 @@ static int cfmakeraw(struct termios *termios_p)
 #endif
 
 
+// Size of input and output buffers, must be a power of 2
+const uint32 SERIAL_RING_SIZE = 8192;
+
+// Maximum time to wait for buffered output before changing port settings
+const int DRAIN_TIMEOUT_MS = 500;
+
+// Byte ring with one producer and one consumer thread
+struct serial_ring {
+	uint8 data[SERIAL_RING_SIZE];
+	uint32 head;						// Next byte to fill, advanced by the producer
+	uint32 tail;						// Next byte to take, advanced by the consumer
+
+	void reset(void) { head = tail = 0; }
+	uint32 count(void) const { return __atomic_load_n(&head, __ATOMIC_SEQ_CST) - __atomic_load_n(&tail, __ATOMIC_SEQ_CST); }
+	uint32 space(void) const { return SERIAL_RING_SIZE - count(); }
+	size_t put(const uint8 *buf, size_t length);
+	size_t get(uint8 *buf, size_t length);
+};
+
+// Copy data into ring (producer), returns number of bytes copied
+size_t serial_ring::put(const uint8 *buf, size_t length)
+{
+	uint32 h = head;
+	if (length > space())
+		length = space();
+	for (size_t done = 0; done < length; ) {
+		size_t chunk = SERIAL_RING_SIZE - ((h + done) & (SERIAL_RING_SIZE - 1));
+		if (chunk > length - done)
+			chunk = length - done;
+		memcpy(data + ((h + done) & (SERIAL_RING_SIZE - 1)), buf + done, chunk);
+		done += chunk;
+	}
+	__atomic_store_n(&head, h + length, __ATOMIC_SEQ_CST);
+	return length;
+}
+
+// Copy data out of ring (consumer), returns number of bytes copied
+size_t serial_ring::get(uint8 *buf, size_t length)
+{
+	uint32 t = tail;
+	if (length > count())
+		length = count();
+	for (size_t done = 0; done < length; ) {
+		size_t chunk = SERIAL_RING_SIZE - ((t + done) & (SERIAL_RING_SIZE - 1));
+		if (chunk > length - done)
+			chunk = length - done;
+		memcpy(buf + done, data + ((t + done) & (SERIAL_RING_SIZE - 1)), chunk);
+		done += chunk;
+	}
+	__atomic_store_n(&tail, t + length, __ATOMIC_SEQ_CST);
+	return length;
+}
+
+
 // Driver private variables
 class XSERDPort : public SERDPort {
 public:
@@ -86,30 +140,15 @@ public:
 		fd = -1;
 		pid = 0;
 		input_thread_active = output_thread_active = false;
+		input_wake_fds[0] = input_wake_fds[1] = -1;
+		output_wake_fds[0] = output_wake_fds[1] = -1;
 
 		Set_pthread_attr(&thread_attr, 2);
 	}
 
 	virtual ~XSERDPort()
 	{
-		if (input_thread_active) {
-			input_thread_cancel = true;
-#ifdef HAVE_PTHREAD_CANCEL
-			pthread_cancel(input_thread);
-#endif
-			pthread_join(input_thread, NULL);
-			sem_destroy(&input_signal);
-			input_thread_active = false;
-		}
-		if (output_thread_active) {
-			output_thread_cancel = true;
-#ifdef HAVE_PTHREAD_CANCEL
-			pthread_cancel(output_thread);
-#endif
-			pthread_join(output_thread, NULL);
-			sem_destroy(&output_signal);
-			output_thread_active = false;
-		}
+		stop_threads();
 	}
 
 	virtual int16 open(uint16 config);
@@ -123,6 +162,12 @@ private:
 	bool open_pty(void);
 	bool configure(uint16 config);
 	void set_handshake(uint32 s, bool with_dtr);
+	bool start_threads(void);
+	void stop_threads(void);
+	void drain_output(void);
+	void discard_output(void);
+	static void wake_thread(const int *wake_fds);
+	void read_input(uint32 pb);
 	static void *input_func(void *arg);
 	static void *output_func(void *arg);
 
@@ -132,22 +177,28 @@ private:
 	int fd;								// FD of device
 	pid_t pid;							// PID of child process
 
-	bool io_killed;						// Flag: KillIO called, I/O threads must not call deferred tasks
+	bool io_killed;						// Flag: KillIO called, I/O threads must not call deferred tasks, output thread drops output_ring
 	bool quitting;						// Flag: Quit threads
 
 	pthread_attr_t thread_attr;			// Input/output thread attributes
 
 	bool input_thread_active;			// Flag: Input thread installed
 	volatile bool input_thread_cancel;	// Flag: Cancel input thread
-	pthread_t input_thread;				// Data input thread
-	sem_t input_signal;					// Signal for input thread: execute command
+	pthread_t input_thread;				// Data input thread, keeps reading into input_ring
+	int input_wake_fds[2];				// Pipe for waking up input thread
 	uint32 input_pb;					// Command parameter for input thread
+	bool input_request;					// Flag: input_pb waits for data in input thread
+	bool input_error;					// Flag: Reading failed, input thread stopped reading
+	serial_ring input_ring;				// Data received but not read by MacOS yet
 
 	bool output_thread_active;			// Flag: Output thread installed
 	volatile bool output_thread_cancel;	// Flag: Cancel output thread
-	pthread_t output_thread;			// Data output thread
-	sem_t output_signal;				// Signal for output thread: execute command
+	pthread_t output_thread;			// Data output thread, keeps writing out output_ring
+	int output_wake_fds[2];				// Pipe for waking up output thread
 	uint32 output_pb;					// Command parameter for output thread
+	bool output_request;				// Flag: output_pb waits for room in output thread
+	bool output_error;					// Flag: Writing from output_ring failed
+	serial_ring output_ring;			// Data written by MacOS but not sent yet
 
 	struct termios mode;				// Terminal configuration
 };
@@ -234,37 +285,12 @@ int16 XSERDPort::open(uint16 config)
 	configure(config);
 
 	// Start input/output threads
-	input_thread_cancel = false;
-	output_thread_cancel = false;
-	if (sem_init(&input_signal, 0, 0) < 0)
-		goto open_error;
-	if (sem_init(&output_signal, 0, 0) < 0)
-		goto open_error; 
-	input_thread_active = (pthread_create(&input_thread, &thread_attr, input_func, this) == 0);
-	output_thread_active = (pthread_create(&output_thread, &thread_attr, output_func, this) == 0);
-	if (!input_thread_active || !output_thread_active)
+	if (!start_threads())
 		goto open_error;
 	return noErr;
 
 open_error:
-	if (input_thread_active) {
-		input_thread_cancel = true;
-#ifdef HAVE_PTHREAD_CANCEL
-		pthread_cancel(input_thread);
-#endif
-		pthread_join(input_thread, NULL);
-		sem_destroy(&input_signal);
-		input_thread_active = false;
-	}
-	if (output_thread_active) {
-		output_thread_cancel = true;
-#ifdef HAVE_PTHREAD_CANCEL
-		pthread_cancel(output_thread);
-#endif
-		pthread_join(output_thread, NULL);
-		sem_destroy(&output_signal);
-		output_thread_active = false;
-	}
+	stop_threads();
 	if (fd > 0) {
 		::close(fd);
 		fd = -1;
@@ -279,15 +305,37 @@ open_error:
 
 int16 XSERDPort::prime_in(uint32 pb, uint32 dce)
 {
+	// Data already received? Then complete the command right away
+	if (input_ring.count()) {
+		read_input(pb);
+		return noErr;
+	}
+
 	// Send input command to input_thread
 	read_done = false;
 	read_pending = true;
 	input_pb = pb;
 	WriteMacInt32(input_dt + serdtDCE, dce);
-	sem_post(&input_signal);
+	__atomic_store_n(&input_request, true, __ATOMIC_SEQ_CST);
+	wake_thread(input_wake_fds);
 	return 1;	// Command in progress
 }
 
+// Satisfy read command from input_ring, in the thread that owns the command
+void XSERDPort::read_input(uint32 pb)
+{
+	bool was_full = input_ring.space() == 0;
+	uint8 *buf = Mac2HostAddr(ReadMacInt32(pb + ioBuffer));
+	uint32 length = ReadMacInt32(pb + ioReqCount);
+	uint32 actual = input_ring.get(buf, length);
+	D(bug(" %ld bytes read from input buffer\n", actual));
+	WriteMacInt32(pb + ioActCount, actual);
+
+	// Input thread stops reading when the ring is full
+	if (was_full)
+		wake_thread(input_wake_fds);
+}
+
 
 /*
  *  Write data to port
@@ -295,12 +343,41 @@ int16 XSERDPort::prime_in(uint32 pb, uint32 dce)
 
 int16 XSERDPort::prime_out(uint32 pb, uint32 dce)
 {
+	// Report errors of data buffered before
+	if (__atomic_exchange_n(&output_error, false, __ATOMIC_SEQ_CST)) {
+		WriteMacInt32(pb + ioActCount, 0);
+		return writErr;
+	}
+
+	// Buffer data if it fits, and complete the command right away
+	uint8 *buf = Mac2HostAddr(ReadMacInt32(pb + ioBuffer));
+	uint32 length = ReadMacInt32(pb + ioReqCount);
+	if (length <= output_ring.space()) {
+#if MONITOR
+		bug("Sending serial data:\n");
+		for (uint32 i=0; i<length; i++) {
+			bug("%02x ", buf[i]);
+		}
+		bug("\n");
+#endif
+		uint32 head = output_ring.head;
+		output_ring.put(buf, length);
+		WriteMacInt32(pb + ioActCount, length);
+
+		// Wake up output thread if it may be done with the ring already,
+		// otherwise it will find this data too
+		if (__atomic_load_n(&output_ring.tail, __ATOMIC_SEQ_CST) == head)
+			wake_thread(output_wake_fds);
+		return noErr;
+	}
+
 	// Send output command to output_thread
 	write_done = false;
 	write_pending = true;
 	output_pb = pb;
 	WriteMacInt32(output_dt + serdtDCE, dce);
-	sem_post(&output_signal);
+	__atomic_store_n(&output_request, true, __ATOMIC_SEQ_CST);
+	wake_thread(output_wake_fds);
 	return 1;	// Command in progress
 }
 
@@ -312,16 +389,26 @@ int16 XSERDPort::prime_out(uint32 pb, uint32 dce)
 int16 XSERDPort::control(uint32 pb, uint32 dce, uint16 code)
 {
 	switch (code) {
-		case 1:			// KillIO
+		case 1: {		// KillIO
 			io_killed = true;
 			if (protocol == serial)
 				tcflush(fd, TCIOFLUSH);
-			while (read_pending || write_pending)
+			wake_thread(input_wake_fds);
+			discard_output();
+			while (__atomic_load_n(&input_request, __ATOMIC_SEQ_CST))
 				usleep(10000);
+
+			// Discard buffered input
+			bool was_full = input_ring.space() == 0;
+			__atomic_store_n(&input_ring.tail, __atomic_load_n(&input_ring.head, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+			if (was_full)
+				wake_thread(input_wake_fds);
 			io_killed = false;
 			return noErr;
+		}
 
 		case kSERDConfiguration:
+			drain_output();
 			if (configure(ReadMacInt16(pb + csParam)))
 				return noErr;
 			else
@@ -331,10 +418,12 @@ int16 XSERDPort::control(uint32 pb, uint32 dce, uint16 code)
 			return noErr;	// Not supported under Unix
 
 		case kSERDSerHShake:
+			drain_output();
 			set_handshake(pb + csParam, false);
 			return noErr;
 
 		case kSERDSetBreak:
+			drain_output();
 			if (protocol == serial)
 				tcsendbreak(fd, 0);
 			return noErr;
@@ -384,6 +473,7 @@ int16 XSERDPort::control(uint32 pb, uint32 dce, uint16 code)
 				rate = 57600; baud_rate = B57600;
 			}
 			WriteMacInt16(pb + csParam, rate);
+			drain_output();
 			cfsetispeed(&mode, baud_rate);
 			cfsetospeed(&mode, baud_rate);
 			tcsetattr(fd, TCSANOW, &mode);
@@ -392,6 +482,7 @@ int16 XSERDPort::control(uint32 pb, uint32 dce, uint16 code)
 
 		case kSERDHandshake:
 		case kSERDHandshakeRS232:
+			drain_output();
 			set_handshake(pb + csParam, true);
 			return noErr;
 
@@ -449,6 +540,7 @@ int16 XSERDPort::control(uint32 pb, uint32 dce, uint16 code)
 		case kSERD115KBaud:
 			if (protocol != serial)
 				return noErr;
+			drain_output();
 			cfsetispeed(&mode, B115200);
 			cfsetospeed(&mode, B115200);
 			tcsetattr(fd, TCSANOW, &mode);
@@ -458,6 +550,7 @@ int16 XSERDPort::control(uint32 pb, uint32 dce, uint16 code)
 		case kSERDSetHighSpeed:
 			if (protocol != serial)
 				return noErr;
+			drain_output();
 			cfsetispeed(&mode, B230400);
 			cfsetospeed(&mode, B230400);
 			tcsetattr(fd, TCSANOW, &mode);
@@ -478,9 +571,9 @@ int16 XSERDPort::status(uint32 pb, uint32 dce, uint16 code)
 {
 	switch (code) {
 		case kSERDInputCount: {
-			int num;
+			int num = 0;
 			ioctl(fd, FIONREAD, &num);
-			WriteMacInt32(pb + csParam, num);
+			WriteMacInt32(pb + csParam, num + input_ring.count());
 			return noErr;
 		}
 
@@ -523,21 +616,12 @@ int16 XSERDPort::status(uint32 pb, uint32 dce, uint16 code)
 
 int16 XSERDPort::close()
 {
-	// Kill threads
-	if (input_thread_active) {
-		quitting = true;
-		sem_post(&input_signal);
-		pthread_join(input_thread, NULL);
-		input_thread_active = false;
-		sem_destroy(&input_signal);
-	}
-	if (output_thread_active) {
-		quitting = true;
-		sem_post(&output_signal);
-		pthread_join(output_thread, NULL);
-		output_thread_active = false;
-		sem_destroy(&output_signal);
-	}
+	// Kill threads, data not sent yet is lost
+	quitting = true;
+	io_killed = true;
+	if (output_thread_active)
+		discard_output();
+	stop_threads();
 
 	// Close port
 	if (fd > 0)
@@ -714,6 +798,103 @@ void XSERDPort::set_handshake(uint32 s, bool with_dtr)
 }
 
 
+/*
+ *  Start input/output threads
+ */
+
+bool XSERDPort::start_threads(void)
+{
+	input_thread_cancel = false;
+	output_thread_cancel = false;
+	input_request = output_request = false;
+	input_error = output_error = false;
+	input_ring.reset();
+	output_ring.reset();
+
+	if (pipe(input_wake_fds) < 0 || pipe(output_wake_fds) < 0)
+		return false;
+	for (int i = 0; i < 2; i++) {
+		fcntl(input_wake_fds[i], F_SETFL, O_NONBLOCK);
+		fcntl(output_wake_fds[i], F_SETFL, O_NONBLOCK);
+	}
+
+	input_thread_active = (pthread_create(&input_thread, &thread_attr, input_func, this) == 0);
+	output_thread_active = (pthread_create(&output_thread, &thread_attr, output_func, this) == 0);
+	return input_thread_active && output_thread_active;
+}
+
+
+/*
+ *  Stop input/output threads
+ */
+
+void XSERDPort::stop_threads(void)
+{
+	if (input_thread_active) {
+		input_thread_cancel = true;
+		wake_thread(input_wake_fds);
+#ifdef HAVE_PTHREAD_CANCEL
+		pthread_cancel(input_thread);
+#endif
+		pthread_join(input_thread, NULL);
+		input_thread_active = false;
+	}
+	if (output_thread_active) {
+		output_thread_cancel = true;
+		wake_thread(output_wake_fds);
+#ifdef HAVE_PTHREAD_CANCEL
+		pthread_cancel(output_thread);
+#endif
+		pthread_join(output_thread, NULL);
+		output_thread_active = false;
+	}
+	for (int i = 0; i < 2; i++) {
+		if (input_wake_fds[i] >= 0) {
+			::close(input_wake_fds[i]);
+			input_wake_fds[i] = -1;
+		}
+		if (output_wake_fds[i] >= 0) {
+			::close(output_wake_fds[i]);
+			output_wake_fds[i] = -1;
+		}
+	}
+}
+
+// Wake up input or output thread waiting in poll()
+void XSERDPort::wake_thread(const int *wake_fds)
+{
+	if (wake_fds[1] >= 0)
+		write(wake_fds[1], "", 1);
+}
+
+// Wait until the buffered data has been handed to the device, but not for
+// longer than DRAIN_TIMEOUT_MS since this runs on the emulation thread. The
+// device queue is not drained, the new settings apply to it with TCSANOW.
+void XSERDPort::drain_output(void)
+{
+	for (int ms = 0; ms < DRAIN_TIMEOUT_MS; ms += 10) {
+		if (!output_thread_active || __atomic_load_n(&output_error, __ATOMIC_SEQ_CST))
+			break;
+		if (output_ring.count() == 0 && !__atomic_load_n(&output_request, __ATOMIC_SEQ_CST))
+			break;
+		usleep(10000);
+	}
+}
+
+// Drop the buffered data and the pending write command, with io_killed
+// set. The device output queue is flushed until the output thread is done,
+// so it is not left waiting in write() for a handshake.
+void XSERDPort::discard_output(void)
+{
+	wake_thread(output_wake_fds);
+	while (output_ring.count() || __atomic_load_n(&output_request, __ATOMIC_SEQ_CST)) {
+		if (protocol == serial)
+			tcflush(fd, TCOFLUSH);
+		usleep(10000);
+	}
+}
+
+
 /*
  *  Data input thread
  */
@@ -723,51 +904,76 @@ void *XSERDPort::input_func(void *arg)
 	XSERDPort *s = (XSERDPort *)arg;
 	while (!s->input_thread_cancel) {
 
-		// Wait for commands
-		sem_wait(&s->input_signal);
+		// Pending command? Then complete it with the data received so far
+		if (__atomic_load_n(&s->input_request, __ATOMIC_SEQ_CST)) {
+
+			// KillIO called? Then simply return
+			if (s->io_killed) {
+
+				WriteMacInt16(s->input_pb + ioResult, uint16(abortErr));
+				WriteMacInt32(s->input_pb + ioActCount, 0);
+				s->read_pending = s->read_done = false;
+				__atomic_store_n(&s->input_request, false, __ATOMIC_SEQ_CST);
+
+			} else if (s->input_ring.count() || s->input_error) {
+
+				// Set error code
+				if (s->input_ring.count()) {
+					s->read_input(s->input_pb);
+					WriteMacInt32(s->input_dt + serdtResult, noErr);
+				} else {
+					WriteMacInt32(s->input_pb + ioActCount, 0);
+					WriteMacInt32(s->input_dt + serdtResult, uint16(readErr));
+				}
+				__atomic_store_n(&s->input_request, false, __ATOMIC_SEQ_CST);
+
+				// Trigger serial interrupt
+				D(bug(" triggering serial interrupt\n"));
+				s->read_done = true;
+				SetInterruptFlag(INTFLAG_SERIAL);
+				TriggerInterrupt();
+			}
+		}
+
+		// Wait for data, unless the buffer is full, or for commands
+		struct pollfd pf[2] = {{s->input_wake_fds[0], POLLIN, 0}, {s->fd, POLLIN, 0}};
+		int nfds = (s->input_ring.space() == 0 || s->input_error) ? 1 : 2;
+		if (poll(pf, nfds, -1) < 0 && errno != EINTR)
+			break;
+		if (pf[0].revents & POLLIN) {
+			char wakeups[64];
+			while (read(s->input_wake_fds[0], wakeups, sizeof(wakeups)) > 0) ;
+		}
 		if (s->quitting)
 			break;
-
-		// Execute command
-		void *buf = Mac2HostAddr(ReadMacInt32(s->input_pb + ioBuffer));
-		uint32 length = ReadMacInt32(s->input_pb + ioReqCount);
-		D(bug("input_func waiting for %ld bytes of data...\n", length));
+		if (nfds < 2 || (pf[1].revents & (POLLIN | POLLHUP | POLLERR)) == 0)
+			continue;
+
+		// Read as much as fits in one piece of the buffer
+		serial_ring &r = s->input_ring;
+		uint32 head = r.head;
+		uint32 length = SERIAL_RING_SIZE - (head & (SERIAL_RING_SIZE - 1));
+		if (length > r.space())
+			length = r.space();
+		uint8 *buf = r.data + (head & (SERIAL_RING_SIZE - 1));
 		int32 actual = read(s->fd, buf, length);
-		D(bug(" %ld bytes received\n", actual));
+		D(bug("input_func: %ld bytes received\n", actual));
+		if (actual <= 0) {
+			if (actual < 0 && (errno == EINTR || errno == EAGAIN))
+				continue;
+			s->input_error = true;	// Device gone, or never readable (e.g. a printer)
+			continue;
+		}
 
 #if MONITOR
 		bug("Receiving serial data:\n");
-		uint8 *adr = (uint8 *)buf;
 		for (int i=0; i<actual; i++) {
-			bug("%02x ", adr[i]);
+			bug("%02x ", buf[i]);
 		}
 		bug("\n");
 #endif
 
-		// KillIO called? Then simply return
-		if (s->io_killed) {
-
-			WriteMacInt16(s->input_pb + ioResult, uint16(abortErr));
-			WriteMacInt32(s->input_pb + ioActCount, 0);
-			s->read_pending = s->read_done = false;
-
-		} else {
-
-			// Set error code
-			if (actual >= 0) {
-				WriteMacInt32(s->input_pb + ioActCount, actual);
-				WriteMacInt32(s->input_dt + serdtResult, noErr);
-			} else {
-				WriteMacInt32(s->input_pb + ioActCount, 0);
-				WriteMacInt32(s->input_dt + serdtResult, uint16(readErr));
-			}
-
-			// Trigger serial interrupt
-			D(bug(" triggering serial interrupt\n"));
-			s->read_done = true;
-			SetInterruptFlag(INTFLAG_SERIAL);
-			TriggerInterrupt();
-		}
+		__atomic_store_n(&r.head, head + actual, __ATOMIC_SEQ_CST);
 	}
 	return NULL;
 }
@@ -782,52 +988,90 @@ void *XSERDPort::output_func(void *arg)
 	XSERDPort *s = (XSERDPort *)arg;
 	while (!s->output_thread_cancel) {
 
-		// Wait for commands
-		sem_wait(&s->output_signal);
-		if (s->quitting)
-			break;
+		// Send buffered data
+		serial_ring &r = s->output_ring;
+		while (r.count()) {
 
-		// Execute command
-		void *buf = Mac2HostAddr(ReadMacInt32(s->output_pb + ioBuffer));
-		uint32 length = ReadMacInt32(s->output_pb + ioReqCount);
-		D(bug("output_func transmitting %ld bytes of data...\n", length));
+			// KillIO or close called? Then drop the buffered data
+			if (s->io_killed) {
+				__atomic_store_n(&r.tail, __atomic_load_n(&r.head, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+				break;
+			}
 
-#if MONITOR
-		bug("Sending serial data:\n");
-		uint8 *adr = (uint8 *)buf;
-		for (int i=0; i<length; i++) {
-			bug("%02x ", adr[i]);
+			uint32 tail = r.tail;
+			uint32 length = SERIAL_RING_SIZE - (tail & (SERIAL_RING_SIZE - 1));
+			if (length > r.count())
+				length = r.count();
+			int32 actual = write(s->fd, r.data + (tail & (SERIAL_RING_SIZE - 1)), length);
+			D(bug("output_func: %ld bytes transmitted\n", actual));
+			if (actual < 0) {
+				if (errno == EINTR)
+					continue;
+				actual = r.count();		// Drop buffered data, report error with next write
+				__atomic_store_n(&s->output_error, true, __ATOMIC_SEQ_CST);
+			}
+			__atomic_store_n(&r.tail, tail + actual, __ATOMIC_SEQ_CST);
 		}
-		bug("\n");
-#endif
 
-		int32 actual = write(s->fd, buf, length);
-		D(bug(" %ld bytes transmitted\n", actual));
+		// Pending command? Then send its data after the buffered data
+		if (__atomic_load_n(&s->output_request, __ATOMIC_SEQ_CST)) {
 
-		// KillIO called? Then simply return
-		if (s->io_killed) {
+			// Execute command
+			void *buf = Mac2HostAddr(ReadMacInt32(s->output_pb + ioBuffer));
+			uint32 length = ReadMacInt32(s->output_pb + ioReqCount);
+			D(bug("output_func transmitting %ld bytes of data...\n", length));
 
-			WriteMacInt16(s->output_pb + ioResult, uint16(abortErr));
-			WriteMacInt32(s->output_pb + ioActCount, 0);
-			s->write_pending = s->write_done = false;
+#if MONITOR
+			bug("Sending serial data:\n");
+			uint8 *adr = (uint8 *)buf;
+			for (int i=0; i<length; i++) {
+				bug("%02x ", adr[i]);
+			}
+			bug("\n");
+#endif
 
-		} else {
+			int32 actual = s->io_killed ? 0 : write(s->fd, buf, length);
+			D(bug(" %ld bytes transmitted\n", actual));
 
-			// Set error code
-			if (actual >= 0) {
-				WriteMacInt32(s->output_pb + ioActCount, actual);
-				WriteMacInt32(s->output_dt + serdtResult, noErr);
-			} else {
+			// KillIO called? Then simply return
+			if (s->io_killed) {
+
+				WriteMacInt16(s->output_pb + ioResult, uint16(abortErr));
 				WriteMacInt32(s->output_pb + ioActCount, 0);
-				WriteMacInt32(s->output_dt + serdtResult, uint16(writErr));
+				s->write_pending = s->write_done = false;
+				__atomic_store_n(&s->output_request, false, __ATOMIC_SEQ_CST);
+
+			} else {
+
+				// Set error code
+				if (actual >= 0) {
+					WriteMacInt32(s->output_pb + ioActCount, actual);
+					WriteMacInt32(s->output_dt + serdtResult, noErr);
+				} else {
+					WriteMacInt32(s->output_pb + ioActCount, 0);
+					WriteMacInt32(s->output_dt + serdtResult, uint16(writErr));
+				}
+				__atomic_store_n(&s->output_request, false, __ATOMIC_SEQ_CST);
+
+				// Trigger serial interrupt
+				D(bug(" triggering serial interrupt\n"));
+				s->write_done = true;
+				SetInterruptFlag(INTFLAG_SERIAL);
+				TriggerInterrupt();
 			}
-	
-			// Trigger serial interrupt
-			D(bug(" triggering serial interrupt\n"));
-			s->write_done = true;
-			SetInterruptFlag(INTFLAG_SERIAL);
-			TriggerInterrupt();
+			continue;
 		}
+
+		// All sent, quit if the port is closed
+		if (s->quitting)
+			break;
+
+		// Wait for data or commands
+		struct pollfd pf = {s->output_wake_fds[0], POLLIN, 0};
+		if (r.count() == 0 && poll(&pf, 1, -1) < 0 && errno != EINTR)
+			break;
+		char wakeups[64];
+		while (read(s->output_wake_fds[0], wakeups, sizeof(wakeups)) > 0) ;
 	}
 	return NULL;
 }
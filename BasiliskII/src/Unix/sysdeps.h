@@ -126,6 +126,11 @@
 #undef USE_PTHREADS_SERVICES
 #endif
 
+/* Wake up Time Manager tasks from the tick scheduler thread instead of the 60Hz tick? */
+#ifdef USE_PTHREADS_SERVICES
+#define PRECISE_TIMING 1
+#endif
+
 
 /* Data types */
 typedef unsigned char uint8;
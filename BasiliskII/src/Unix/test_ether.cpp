@@ -0,0 +1,682 @@
+/*
+ *  test_ether.cpp - Benchmark the Ethernet backends without MacOS
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  The Unix Ethernet driver (ether_unix.cpp, included below so that its
+ *  static functions are at hand) is run against synthetic traffic, without
+ *  MacOS and without CPU emulation. The main thread plays the MacOS: it
+ *  transmits frames with ether_write() (ether_udp_write() for the UDP
+ *  tunnel) and handles the Ethernet interrupt with EtherInterrupt(), whose
+ *  protocol handler calls end up in Execute68k() (ether_udp_read() for the
+ *  UDP tunnel). The other end of each backend echoes every frame back:
+ *
+ *    slirp     UDP datagrams to 10.0.2.2 go through the slirp stack to a
+ *              socket on the host loopback interface, which echoes them
+ *    tap       a socket pair stands in for the TUN/TAP device, a thread
+ *              echoes the frames written to the other end
+ *    udp       UDP tunnel over the loopback interface, echoed by a peer
+ *              socket
+ *    vde       VDE switch given with --switch, echoed by a second port
+ *
+ *  Each frame carries its sequence number and send time. Every backend is
+ *  run with a number of frame sizes, one frame in flight (ping-pong) and a
+ *  window of frames in flight. Reported: echoed frames per second, bytes
+ *  per second in each direction, round trip latency percentiles, and on
+ *  Linux the system calls made by the emulator side (the MacOS, reception
+ *  and slirp threads) per echoed frame, counted by intercepting the C
+ *  library entry points. Frames not echoed within a second are reported as
+ *  lost, and replaced by new ones.
+ *
+ *  Usage: test-ether [--switch vde-socket] [frames [backend...]]
+ */
+
+#include "sysdeps.h"
+
+#include <algorithm>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+#include <errno.h>
+#ifdef __linux__
+#include <dlfcn.h>
+#include <sys/epoll.h>
+#endif
+
+
+/*
+ *  System call counting
+ */
+
+static __thread bool network_thread = false;	// Flag: thread plays the other end of the network
+static long num_syscalls = 0;					// System calls made by the emulator side
+
+#ifdef __linux__
+#define COUNT_SYSCALLS 1
+#define COUNTED(ret, name, params, args) \
+	extern "C" ret name params \
+	{ \
+		static ret (*real) params = NULL; \
+		if (real == NULL) \
+			real = (ret (*) params)dlsym(RTLD_NEXT, #name); \
+		if (!network_thread) \
+			__atomic_add_fetch(&num_syscalls, 1, __ATOMIC_RELAXED); \
+		return real args; \
+	}
+COUNTED(ssize_t, read, (int fd, void *buf, size_t count), (fd, buf, count))
+COUNTED(ssize_t, write, (int fd, const void *buf, size_t count), (fd, buf, count))
+COUNTED(ssize_t, readv, (int fd, const struct iovec *iov, int iovcnt), (fd, iov, iovcnt))
+COUNTED(ssize_t, writev, (int fd, const struct iovec *iov, int iovcnt), (fd, iov, iovcnt))
+COUNTED(ssize_t, recv, (int fd, void *buf, size_t len, int flags), (fd, buf, len, flags))
+COUNTED(ssize_t, recvfrom, (int fd, void *buf, size_t len, int flags, struct sockaddr *from, socklen_t *from_len), (fd, buf, len, flags, from, from_len))
+COUNTED(ssize_t, recvmsg, (int fd, struct msghdr *msg, int flags), (fd, msg, flags))
+COUNTED(int, recvmmsg, (int fd, struct mmsghdr *msgs, unsigned int n, int flags, struct timespec *timeout), (fd, msgs, n, flags, timeout))
+COUNTED(ssize_t, send, (int fd, const void *buf, size_t len, int flags), (fd, buf, len, flags))
+COUNTED(ssize_t, sendto, (int fd, const void *buf, size_t len, int flags, const struct sockaddr *to, socklen_t to_len), (fd, buf, len, flags, to, to_len))
+COUNTED(ssize_t, sendmsg, (int fd, const struct msghdr *msg, int flags), (fd, msg, flags))
+COUNTED(int, sendmmsg, (int fd, struct mmsghdr *msgs, unsigned int n, int flags), (fd, msgs, n, flags))
+COUNTED(int, poll, (struct pollfd *fds, nfds_t nfds, int timeout), (fds, nfds, timeout))
+COUNTED(int, select, (int nfds, fd_set *r, fd_set *w, fd_set *e, struct timeval *timeout), (nfds, r, w, e, timeout))
+COUNTED(int, epoll_wait, (int epfd, struct epoll_event *events, int max, int timeout), (epfd, events, max, timeout))
+#endif
+
+
+/*
+ *  The driver under test
+ */
+
+#include "ether_unix.cpp"
+
+
+/*
+ *  MacOS glue
+ */
+
+// Mac memory, for the driver data, packet buffers and write data structures
+const uint32 MAC_RAM_SIZE = 0x10000;
+static uint8 *mac_ram;
+static uint32 mac_ram_top;
+#if DIRECT_ADDRESSING
+uintptr MEMBaseDiff;
+#endif
+
+static uint32 mac_alloc(uint32 size)
+{
+	uint32 addr = Host2MacAddr(mac_ram + mac_ram_top);
+	mac_ram_top += (size + 15) & ~15;
+	assert(mac_ram_top <= MAC_RAM_SIZE);
+	return addr;
+}
+
+uint8 ether_addr[6];
+uint32 ether_data;
+char *vde_sock = NULL;
+
+static uint32 rx_packet;				// Buffer of EthernetPacket
+static const uint32 PROTOCOL_HANDLER = 0x1234;
+
+EthernetPacket::EthernetPacket()
+{
+	packet = rx_packet;
+}
+
+EthernetPacket::~EthernetPacket()
+{
+}
+
+// Backend selected with the "ether" prefs item
+static const char *ether_pref = NULL;
+
+const char *PrefsFindString(const char *name, int index)
+{
+	if (strcmp(name, "ether") == 0 && index == 0)
+		return ether_pref;
+	return NULL;
+}
+
+extern "C" const char *PrefsFindStringC(const char *name, int index)
+{
+	return PrefsFindString(name, index);
+}
+
+void WarningAlert(const char *text)
+{
+	fprintf(stderr, "WARNING: %s\n", text);
+}
+
+void Set_pthread_attr(pthread_attr_t *attr, int priority)
+{
+}
+
+// The Ethernet interrupt is handled by the main thread
+static pthread_mutex_t irq_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t irq_cond = PTHREAD_COND_INITIALIZER;
+static bool irq_pending = false;
+
+void SetInterruptFlag(uint32 flag)
+{
+}
+
+void TriggerInterrupt(void)
+{
+	pthread_mutex_lock(&irq_lock);
+	irq_pending = true;
+	pthread_cond_signal(&irq_cond);
+	pthread_mutex_unlock(&irq_lock);
+}
+
+// Wait for the Ethernet interrupt, false on timeout
+static bool wait_interrupt(int seconds)
+{
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += seconds;
+	pthread_mutex_lock(&irq_lock);
+	while (!irq_pending && pthread_cond_timedwait(&irq_cond, &irq_lock, &deadline) != ETIMEDOUT) ;
+	bool pending = irq_pending;
+	irq_pending = false;
+	pthread_mutex_unlock(&irq_lock);
+	return pending;
+}
+
+
+/*
+ *  Traffic
+ */
+
+enum {
+	BACKEND_SLIRP,
+	BACKEND_TAP,
+	BACKEND_UDP,
+	BACKEND_VDE,
+	NUM_BACKENDS
+};
+
+static const char *backend_names[NUM_BACKENDS] = {
+	"slirp", "tap", "udp", "vde"
+};
+
+const uint16 TEST_TYPE = 0x88b5;		// Local experimental Ethertype
+const int SLIRP_HEADER = 14 + 20 + 8;	// Ethernet, IP and UDP headers
+static const uint8 peer_addr[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+static const uint8 slirp_addr[6] = {0x52, 0x54, 0x00, 0x12, 0x35, 0x00};
+
+// Payload of each frame
+struct test_payload {
+	uint32 run;
+	uint32 seq;
+	uint64 time;
+};
+
+static int backend;						// Backend under test
+static uint32 run_id;					// Current run, frames of earlier runs are ignored
+static uint32 num_received;				// Frames echoed back in the current run
+static uint32 first_seq;				// Frames sent before were given up as lost
+static std::vector<uint32> latencies;	// Round trip times in ns
+static struct sockaddr_in udp_peer_sa;	// Echo socket of the UDP tunnel
+static uint16 slirp_echo_port;			// Echo socket port on the host, for slirp
+
+static uint64 get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint16 ip_checksum(const uint8 *p, int len)
+{
+	uint32 sum = 0;
+	for (int i = 0; i < len; i += 2)
+		sum += (p[i] << 8) | p[i + 1];
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return ~sum;
+}
+
+// Build frame of given size, returns offset of payload
+static int build_frame(uint8 *frame, int size)
+{
+	memset(frame, 0, size);
+	memcpy(frame + 6, ether_addr, 6);
+	if (backend != BACKEND_SLIRP) {
+		memcpy(frame, peer_addr, 6);
+		frame[12] = TEST_TYPE >> 8;
+		frame[13] = TEST_TYPE & 0xff;
+		return 14;
+	}
+
+	// UDP datagram from 10.0.2.15:1024 to the echo socket at 10.0.2.2
+	memcpy(frame, slirp_addr, 6);
+	frame[12] = 0x08;
+	uint8 *ip = frame + 14, *udp = ip + 20;
+	int ip_len = size - 14;
+	ip[0] = 0x45;
+	ip[2] = ip_len >> 8; ip[3] = ip_len;
+	ip[8] = 64;
+	ip[9] = 17;
+	ip[12] = 10; ip[13] = 0; ip[14] = 2; ip[15] = 15;
+	ip[16] = 10; ip[17] = 0; ip[18] = 2; ip[19] = 2;
+	uint16 sum = ip_checksum(ip, 20);
+	ip[10] = sum >> 8; ip[11] = sum;
+	udp[0] = 1024 >> 8; udp[1] = 1024 & 0xff;
+	udp[2] = slirp_echo_port >> 8; udp[3] = slirp_echo_port;
+	udp[4] = (ip_len - 20) >> 8; udp[5] = ip_len - 20;
+	return SLIRP_HEADER;
+}
+
+// Echoed frame arrived at the MacOS
+static void frame_received(const uint8 *frame, int length)
+{
+	int offset = 14;
+	if (backend == BACKEND_SLIRP) {
+		if (length < SLIRP_HEADER || frame[12] != 0x08 || frame[13] != 0x00 || frame[14 + 9] != 17)
+			return;
+		offset = 14 + (frame[14] & 15) * 4 + 8;
+	}
+	if (length < offset + (int)sizeof(test_payload))
+		return;
+	test_payload p;
+	memcpy(&p, frame + offset, sizeof(p));
+	if (p.run != run_id || p.seq < first_seq)
+		return;
+	latencies.push_back(get_time_ns() - p.time);
+	num_received++;
+}
+
+// Protocol handler
+void Execute68k(uint32 addr, M68kRegisters *r)
+{
+	if (addr == PROTOCOL_HANDLER)
+		frame_received(Mac2HostAddr(r->a[0]) - 14, r->d[1] + 14);
+}
+
+// UDP tunnel reception
+void ether_udp_read(uint32 packet, int length, struct sockaddr_in *from)
+{
+	frame_received(Mac2HostAddr(packet), length);
+}
+
+
+/*
+ *  The other end of the network
+ */
+
+static volatile bool echo_quit;
+static pthread_t echo_thread;
+static int echo_fd = -1;
+#ifdef HAVE_LIBVDEPLUG
+static VDECONN *echo_vde;
+#endif
+
+static void swap_addresses(uint8 *frame)
+{
+	uint8 tmp[6];
+	memcpy(tmp, frame, 6);
+	memcpy(frame, frame + 6, 6);
+	memcpy(frame + 6, tmp, 6);
+}
+
+static void *echo_func(void *arg)
+{
+	network_thread = true;
+	uint8 frame[2048];
+	while (!echo_quit) {
+		struct pollfd pf = {echo_fd, POLLIN, 0};
+		if (poll(&pf, 1, 100) <= 0)
+			continue;
+		switch (backend) {
+		case BACKEND_SLIRP:
+		case BACKEND_UDP: {
+			struct sockaddr_in from;
+			socklen_t from_len = sizeof(from);
+			ssize_t len = recvfrom(echo_fd, frame, sizeof(frame), 0, (struct sockaddr *)&from, &from_len);
+			if (len <= 0)
+				break;
+			if (backend == BACKEND_UDP && len >= 12)
+				swap_addresses(frame);
+			sendto(echo_fd, frame, len, 0, (struct sockaddr *)&from, from_len);
+			break;
+		}
+		case BACKEND_TAP: {
+			ssize_t len = read(echo_fd, frame, sizeof(frame));
+			if (len < 14)
+				break;
+			swap_addresses(frame);
+			write(echo_fd, frame, len);
+			break;
+		}
+#ifdef HAVE_LIBVDEPLUG
+		case BACKEND_VDE: {
+			ssize_t len = vde_recv(echo_vde, frame, sizeof(frame), 0);
+			if (len < 14 || memcmp(frame, peer_addr, 6) != 0)
+				break;
+			swap_addresses(frame);
+			vde_send(echo_vde, frame, len, 0);
+			break;
+		}
+#endif
+		}
+	}
+	return NULL;
+}
+
+// Open a loopback UDP socket
+static int open_loopback_socket(struct sockaddr_in *sa)
+{
+	int s = socket(PF_INET, SOCK_DGRAM, 0);
+	if (s < 0)
+		return -1;
+	memset(sa, 0, sizeof(*sa));
+	sa->sin_family = AF_INET;
+	sa->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t sa_len = sizeof(*sa);
+	if (bind(s, (struct sockaddr *)sa, sizeof(*sa)) < 0 || getsockname(s, (struct sockaddr *)sa, &sa_len) < 0) {
+		close(s);
+		return -1;
+	}
+	int size = 1 << 20;
+	setsockopt(s, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	setsockopt(s, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+	return s;
+}
+
+// Bring up backend and the other end, returns false if unavailable here
+static bool backend_init(void)
+{
+	echo_quit = false;
+	switch (backend) {
+	case BACKEND_SLIRP: {
+#ifdef HAVE_SLIRP
+		struct sockaddr_in sa;
+		if ((echo_fd = open_loopback_socket(&sa)) < 0)
+			return false;
+		slirp_echo_port = ntohs(sa.sin_port);
+		ether_pref = "slirp";
+		if (!ether_init())
+			return false;
+		break;
+#else
+		return false;
+#endif
+	}
+
+	case BACKEND_TAP: {
+		// Like ether_init() for a TUN/TAP device
+		int sv[2];
+		if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0 && socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) < 0)
+			return false;
+		echo_fd = sv[1];
+		fd = sv[0];
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+		net_if_type = NET_IF_TUNTAP;
+		ether_addr[0] = 0xfe;
+		ether_addr[1] = 0xfd;
+		ether_addr[2] = ether_addr[3] = ether_addr[4] = 0;
+		ether_addr[5] = 1;
+		rx_ring = new rx_frame[RX_RING_SIZE];
+		rx_ring_head = rx_ring_tail = 0;
+		if (!start_thread())
+			return false;
+		break;
+	}
+
+	case BACKEND_UDP: {
+		// Like EtherInit() for the UDP tunnel
+		struct sockaddr_in sa;
+		if ((echo_fd = open_loopback_socket(&udp_peer_sa)) < 0)
+			return false;
+		int s = open_loopback_socket(&sa);
+		if (s < 0)
+			return false;
+		int on = 1;
+		ioctl(s, FIONBIO, &on);
+		ether_addr[0] = 'B';
+		ether_addr[1] = '2';
+		ether_addr[2] = 127;
+		ether_addr[3] = ether_addr[4] = 0;
+		ether_addr[5] = 1;
+		if (!ether_start_udp_thread(s))
+			return false;
+		break;
+	}
+
+	case BACKEND_VDE:
+#ifdef HAVE_LIBVDEPLUG
+	{
+		if (vde_sock == NULL)
+			return false;
+		struct vde_open_args args = {0, NULL, 0700};
+		echo_vde = vde_open(vde_sock, (char *)"test-ether", &args);
+		if (echo_vde == NULL)
+			return false;
+		echo_fd = vde_datafd(echo_vde);
+		ether_pref = "vde";
+		if (!ether_init())
+			return false;
+		break;
+	}
+#else
+		return false;
+#endif
+	}
+
+	ether_attach_ph(backend == BACKEND_SLIRP ? 0x0800 : TEST_TYPE, PROTOCOL_HANDLER);
+	return pthread_create(&echo_thread, NULL, echo_func, NULL) == 0;
+}
+
+static void backend_exit(void)
+{
+	echo_quit = true;
+	pthread_join(echo_thread, NULL);
+
+	switch (backend) {
+	case BACKEND_TAP:
+		stop_thread();
+		close(fd);
+		fd = -1;
+		delete[] rx_ring;
+		rx_ring = NULL;
+		break;
+	case BACKEND_UDP: {
+		int s = fd;
+		ether_stop_udp_thread();
+		close(s);
+		break;
+	}
+	default:
+		ether_exit();
+		break;
+	}
+	ether_reset();
+
+#ifdef HAVE_LIBVDEPLUG
+	if (backend == BACKEND_VDE) {
+		vde_close(echo_vde);
+		echo_fd = -1;
+	}
+#endif
+	if (echo_fd >= 0) {
+		close(echo_fd);
+		echo_fd = -1;
+	}
+}
+
+
+/*
+ *  Benchmark
+ */
+
+struct test_result {
+	uint32 frames;			// Frames echoed
+	uint32 lost;			// Frames not echoed in time
+	double seconds;			// Not counting the time waiting for lost frames
+	double syscalls;		// System calls per echoed frame
+	uint32 latency[4];		// 50th, 90th, 99th percentile and maximum in ns
+};
+
+static void run_benchmark(int size, int window, uint32 frames, test_result &res)
+{
+	run_id++;
+	num_received = 0;
+	first_seq = 0;
+	latencies.clear();
+	latencies.reserve(frames);
+
+	// Write data structure with header and data, as MacOS passes them
+	uint32 buf = mac_alloc(size);
+	uint32 wds = mac_alloc(18);
+	uint8 *frame = Mac2HostAddr(buf);
+	int offset = build_frame(frame, size);
+	WriteMacInt16(wds, 14);
+	WriteMacInt32(wds + 2, buf);
+	WriteMacInt16(wds + 6, size - 14);
+	WriteMacInt32(wds + 8, buf + 14);
+	WriteMacInt16(wds + 12, 0);
+
+	long syscalls_before = __atomic_load_n(&num_syscalls, __ATOMIC_RELAXED);
+	uint64 start = get_time_ns(), stalled = 0;
+	uint32 sent = 0, lost = 0;
+	int timeouts = 0;
+	while (num_received + lost < frames) {
+
+		// Fill the window
+		while (sent < frames && sent - num_received - lost < (uint32)window) {
+			test_payload p;
+			p.run = run_id;
+			p.seq = sent++;
+			p.time = get_time_ns();
+			memcpy(frame + offset, &p, sizeof(p));
+			if (backend == BACKEND_UDP)
+				ether_udp_write(frame, size, &udp_peer_sa);
+			else
+				ether_write(wds);
+		}
+
+		// Handle Ethernet interrupt. Without one for a second, the frames
+		// in flight are lost, send new ones (give up if nothing comes back)
+		uint64 wait = get_time_ns();
+		if (!wait_interrupt(1)) {
+			stalled += get_time_ns() - wait;
+			lost = sent - num_received;
+			first_seq = sent;
+			if (++timeouts == 3)
+				break;
+			continue;
+		}
+		timeouts = 0;
+		EtherInterrupt();
+	}
+	uint64 end = get_time_ns();
+	long syscalls = __atomic_load_n(&num_syscalls, __ATOMIC_RELAXED) - syscalls_before;
+
+	res.frames = num_received;
+	res.lost = frames - num_received;
+	res.seconds = (end - start - stalled) * 1e-9;
+	res.syscalls = num_received ? (double)syscalls / num_received : 0;
+	memset(res.latency, 0, sizeof(res.latency));
+	if (!latencies.empty()) {
+		std::sort(latencies.begin(), latencies.end());
+		size_t n = latencies.size();
+		res.latency[0] = latencies[n / 2];
+		res.latency[1] = latencies[n * 9 / 10];
+		res.latency[2] = latencies[n * 99 / 100];
+		res.latency[3] = latencies[n - 1];
+	}
+	mac_ram_top -= ((size + 15) & ~15) + 32;
+}
+
+int main(int argc, char *argv[])
+{
+	int arg = 1;
+	if (argc > arg + 1 && strcmp(argv[arg], "--switch") == 0) {
+		vde_sock = argv[arg + 1];
+		arg += 2;
+	}
+	uint32 frames = argc > arg ? atoi(argv[arg++]) : 20000;
+	if (frames == 0)
+		frames = 1;
+	bool selected[NUM_BACKENDS];
+	for (int b = 0; b < NUM_BACKENDS; b++)
+		selected[b] = (argc <= arg);
+	for (int i = arg; i < argc; i++) {
+		for (int b = 0; b < NUM_BACKENDS; b++) {
+			if (strcmp(argv[i], backend_names[b]) == 0)
+				selected[b] = true;
+		}
+	}
+
+	// Mac memory and driver data
+	mac_ram = (uint8 *)malloc(MAC_RAM_SIZE);
+	if (mac_ram == NULL) {
+		fprintf(stderr, "Not enough memory\n");
+		return 1;
+	}
+#if DIRECT_ADDRESSING
+	MEMBaseDiff = (uintptr)mac_ram;
+#endif
+	mac_ram_top = 0x100;
+	ether_data = mac_alloc(SIZEOF_etherdata);
+	rx_packet = mac_alloc(1516);
+
+	static const int sizes[] = { 64, 590, 1514 };
+	static const int windows[] = { 1, 32 };
+
+	printf("%-7s %5s %6s %10s %8s %8s %8s %8s %8s %8s\n", "backend", "size", "window", "frames/s", "MB/s", "p50 us", "p90 us", "p99 us", "max us", "syscalls");
+	for (backend = 0; backend < NUM_BACKENDS; backend++) {
+		if (!selected[backend])
+			continue;
+		if (!backend_init()) {
+			printf("%-7s not available\n", backend_names[backend]);
+			continue;
+		}
+
+		// Warm up (e.g. slirp creates its host socket with the first frame)
+		test_result res;
+		run_benchmark(sizes[0], 1, 10, res);
+
+		for (int s = 0; s < int(sizeof(sizes) / sizeof(sizes[0])); s++) {
+			for (int w = 0; w < int(sizeof(windows) / sizeof(windows[0])); w++) {
+				run_benchmark(sizes[s], windows[w], frames, res);
+				double fps = res.seconds > 0 ? res.frames / res.seconds : 0;
+#if COUNT_SYSCALLS
+				char syscalls[16];
+				sprintf(syscalls, "%8.2f", res.syscalls);
+#else
+				const char *syscalls = "     n/a";
+#endif
+				char lost[32] = "";
+				if (res.lost)
+					sprintf(lost, " (%u lost)", res.lost);
+				printf("%-7s %5d %6d %10.0f %8.2f %8.1f %8.1f %8.1f %8.1f %s%s\n",
+					backend_names[backend], sizes[s], windows[w], fps, fps * sizes[s] / 1e6,
+					res.latency[0] / 1e3, res.latency[1] / 1e3, res.latency[2] / 1e3, res.latency[3] / 1e3,
+					syscalls, lost);
+			}
+		}
+		backend_exit();
+	}
+	return 0;
+}
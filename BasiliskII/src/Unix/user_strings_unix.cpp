@@ -54,6 +54,8 @@ user_string_def platform_strings[] = {
 	{STR_SLIRP_NO_DNS_FOUND_WARN, "Cannot get DNS address. Ethernet will not be available."},
 	{STR_SCSI_DEVICE_OPEN_WARN, "Cannot open %s (%s). SCSI Manager access to this device will be disabled."},
 	{STR_SCSI_DEVICE_NOT_SCSI_WARN, "%s doesn't seem to comply to the Generic SCSI API. SCSI Manager access to this device will be disabled."},
+	{STR_SCSI_IMAGE_INVALID_WARN, "%s is not a valid disk image. SCSI Manager access to this device will be disabled."},
+	{STR_SCSI_IMAGE_SIZE_WARN, "%s is too small to be used as a disk image. SCSI Manager access to this device will be disabled."},
 	{STR_NO_AUDIO_DEV_WARN, "Cannot open %s (%s). Audio output will be disabled."},
 	{STR_NO_AUDIO_WARN, "No audio device found, audio output will be disabled."},
 	{STR_AUDIO_FORMAT_WARN, "Audio hardware doesn't seem to support necessary format. Audio output will be disabled."},
@@ -45,6 +45,8 @@ enum {
 	STR_SLIRP_NO_DNS_FOUND_WARN,
 	STR_SCSI_DEVICE_OPEN_WARN,
 	STR_SCSI_DEVICE_NOT_SCSI_WARN,
+	STR_SCSI_IMAGE_INVALID_WARN,
+	STR_SCSI_IMAGE_SIZE_WARN,
 	STR_NO_AUDIO_DEV_WARN,
 	STR_NO_AUDIO_WARN,
 	STR_AUDIO_FORMAT_WARN,
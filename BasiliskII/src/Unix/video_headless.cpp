@@ -0,0 +1,717 @@
+/*
+ *  video_headless.cpp - Video/graphics emulation, shared memory screen without a window
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  NOTES:
+ *    The Mac frame buffer is allocated in a POSIX shared memory object, so
+ *    that other processes can map it and read the screen without any copy
+ *    (see video_headless.h for the layout). This driver only reports which
+ *    parts of the screen changed: from the VOSF dirty pages when available,
+ *    so that an idle screen costs nothing, or else by comparing the frame
+ *    buffer with a private copy.
+ *
+ *    There is no window, and hence no keyboard or mouse input.
+ */
+
+#include "sysdeps.h"
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#ifdef HAVE_PTHREADS
+# include <pthread.h>
+#endif
+
+#include "cpu_emulation.h"
+#include "main.h"
+#include "prefs.h"
+#include "user_strings.h"
+#include "video.h"
+#include "video_blit.h"
+#include "video_headless.h"
+#include "vm_alloc.h"
+
+#define DEBUG 0
+#include "debug.h"
+
+
+// Supported video modes
+static vector<video_mode> VideoModes;
+
+// Global variables
+static uint32 frame_skip;							// Prefs items
+
+static bool redraw_thread_active = false;			// Flag: Redraw thread installed
+#ifdef USE_PTHREADS_SERVICES
+static volatile bool redraw_thread_cancel;			// Flag: Cancel Redraw thread
+static pthread_t redraw_thread;						// Redraw thread
+static pthread_attr_t redraw_thread_attr;			// Redraw thread attributes
+#endif
+
+#ifdef HAVE_PTHREADS
+static pthread_mutex_t screen_lock = PTHREAD_MUTEX_INITIALIZER;	// Mutex to protect the shared header and mode switches
+#define LOCK_SCREEN pthread_mutex_lock(&screen_lock)
+#define UNLOCK_SCREEN pthread_mutex_unlock(&screen_lock)
+#else
+#define LOCK_SCREEN
+#define UNLOCK_SCREEN
+#endif
+
+static uint8 *the_buffer = NULL;					// Mac frame buffer (where MacOS draws into)
+static uint8 *the_buffer_copy = NULL;				// Copy of Mac frame buffer (for refreshed modes)
+static uint32 the_buffer_size;						// Size of the frame buffer in the current mode
+
+static char shm_name[256];							// Name of the shared memory object
+static int shm_fd = -1;								// File descriptor of the shared memory object
+static headless_video_header *shm_header = NULL;	// Mapped header of the shared memory object
+static uint32 shm_header_size;						// Size of the header (page aligned)
+static uint32 shm_fb_size;							// Size of the frame buffer area (page aligned)
+
+static volatile bool full_refresh = true;			// Flag: report the whole screen as changed
+
+#ifdef ENABLE_VOSF
+static bool use_vosf = false;						// Flag: VOSF enabled
+#else
+static const bool use_vosf = false;					// VOSF not possible
+#endif
+
+// Prototypes
+static void video_refresh(void);
+#ifdef USE_PTHREADS_SERVICES
+static void *redraw_func(void *arg);
+#endif
+
+
+// Headless monitor
+class headless_monitor_desc : public monitor_desc {
+public:
+	headless_monitor_desc(const vector<video_mode> &available_modes, video_depth default_depth, uint32 default_id) : monitor_desc(available_modes, default_depth, default_id) {}
+	~headless_monitor_desc() {}
+
+	virtual void switch_to_current_mode(void);
+	virtual void set_palette(uint8 *pal, int num);
+	virtual void set_gamma(uint8 *gamma, int num);
+
+	bool video_open(void);
+	void video_close(void);
+};
+
+
+/*
+ *  Frame buffer update on SEGV signals
+ */
+
+#ifdef ENABLE_VOSF
+# include "video_vosf.h"
+#endif
+
+
+/*
+ *  Utility functions
+ */
+
+// Round size up to the host page size
+static uint32 page_align(uint32 size)
+{
+	const uint32 page_mask = vm_get_page_size() - 1;
+	return (size + page_mask) & ~page_mask;
+}
+
+// Add mode to list of supported modes
+static void add_mode(int width, int height, int resolution_id, video_depth depth)
+{
+	video_mode mode;
+	mode.x = width;
+	mode.y = height;
+	mode.resolution_id = resolution_id;
+	mode.bytes_per_row = TrivialBytesPerRow(width, depth);
+	mode.depth = depth;
+	mode.user_data = 0;
+	VideoModes.push_back(mode);
+}
+
+// Set Mac frame layout and base address (uses the_buffer/MacFrameBaseMac)
+static void set_mac_frame_buffer(headless_monitor_desc &monitor)
+{
+#if !REAL_ADDRESSING && !DIRECT_ADDRESSING
+	// The exported frame buffer is kept in Mac format
+	MacFrameLayout = FLAYOUT_DIRECT;
+	monitor.set_mac_frame_base(MacFrameBaseMac);
+
+	// Set variables used by UAE memory banking
+	const video_mode &mode = monitor.get_current_mode();
+	MacFrameBaseHost = the_buffer;
+	MacFrameSize = mode.bytes_per_row * mode.y;
+	InitFrameBufferMapping();
+#else
+	monitor.set_mac_frame_base(Host2MacAddr(the_buffer));
+#endif
+	D(bug("monitor.mac_frame_base = %08x\n", monitor.get_mac_frame_base()));
+}
+
+// Start and finish an update of the shared header (sequence lock, see video_headless.h)
+static inline void begin_header_update(void)
+{
+	__atomic_store_n(&shm_header->seq, shm_header->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void end_header_update(void)
+{
+	__atomic_store_n(&shm_header->seq, shm_header->seq + 1, __ATOMIC_RELEASE);
+}
+
+
+/*
+ *  Shared memory object
+ */
+
+// Create the shared memory object and map the frame buffer into it
+static bool shm_screen_open(uint32 fb_size)
+{
+	const char *name = PrefsFindString("headlessshm");
+	if (name && name[0])
+		snprintf(shm_name, sizeof(shm_name), "%s%s", name[0] == '/' ? "" : "/", name);
+	else
+		snprintf(shm_name, sizeof(shm_name), "/basilisk_ii-%d", int(getpid()));
+
+	shm_fd = shm_open(shm_name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (shm_fd < 0) {
+		printf("FATAL: Could not create shared memory object %s: %s\n", shm_name, strerror(errno));
+		return false;
+	}
+	shm_header_size = page_align(sizeof(headless_video_header));
+	shm_fb_size = page_align(fb_size);
+	if (ftruncate(shm_fd, shm_header_size + shm_fb_size) < 0) {
+		printf("FATAL: Could not resize shared memory object %s: %s\n", shm_name, strerror(errno));
+		return false;
+	}
+
+	void *header = mmap(NULL, shm_header_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+	if (header == MAP_FAILED) {
+		printf("FATAL: Could not map shared memory header: %s\n", strerror(errno));
+		return false;
+	}
+	shm_header = (headless_video_header *)header;
+
+	// The frame buffer must be addressable by the emulated CPU, so reserve
+	// it as any other frame buffer and map the shared object over it
+	void *fb = vm_acquire(shm_fb_size, VM_MAP_DEFAULT | VM_MAP_32BIT);
+	if (fb == VM_MAP_FAILED) {
+		printf("FATAL: Could not allocate frame buffer\n");
+		return false;
+	}
+	the_buffer = (uint8 *)fb;
+	if (mmap(fb, shm_fb_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, shm_fd, shm_header_size) == MAP_FAILED) {
+		printf("FATAL: Could not map shared memory frame buffer: %s\n", strerror(errno));
+		return false;
+	}
+
+	// The object is zero-filled, only set the constant fields and a gray palette
+	shm_header->magic = HEADLESS_VIDEO_MAGIC;
+	shm_header->version = HEADLESS_VIDEO_VERSION;
+	shm_header->fb_offset = shm_header_size;
+	shm_header->fb_size = shm_fb_size;
+	memset(shm_header->palette, 0x80, sizeof(shm_header->palette));
+
+	printf("Exporting screen to shared memory object %s\n", shm_name);
+	return true;
+}
+
+// Unmap and remove the shared memory object (readers may keep their mappings)
+static void shm_screen_close(void)
+{
+	if (the_buffer) {
+		vm_release(the_buffer, shm_fb_size);
+		the_buffer = NULL;
+	}
+	if (shm_header) {
+		munmap(shm_header, shm_header_size);
+		shm_header = NULL;
+	}
+	if (shm_fd >= 0) {
+		close(shm_fd);
+		shm_fd = -1;
+		shm_unlink(shm_name);
+	}
+}
+
+
+/*
+ *  Display "driver"
+ */
+
+// Open display for current mode
+bool headless_monitor_desc::video_open(void)
+{
+	D(bug("video_open()\n"));
+	const video_mode &mode = get_current_mode();
+
+	// The frame buffer stays in place across mode switches, the shared
+	// object is only resized by VideoInit()
+	the_buffer_size = page_align(mode.bytes_per_row * mode.y);
+	vm_protect(the_buffer, shm_fb_size, VM_PAGE_READ | VM_PAGE_WRITE);
+	memset(the_buffer, 0, shm_fb_size);
+
+#ifdef ENABLE_VOSF
+	use_vosf = true;
+	if (!video_vosf_init(*this)) {
+		ErrorAlert(STR_VOSF_INIT_ERR);
+		use_vosf = false;
+	}
+#endif
+	if (!use_vosf) {
+		if (the_buffer_copy == NULL)
+			the_buffer_copy = (uint8 *)malloc(shm_fb_size);
+		if (the_buffer_copy == NULL) {
+			ErrorAlert(STR_NO_MEM_ERR);
+			return false;
+		}
+		memset(the_buffer_copy, 0, shm_fb_size);
+	}
+	D(bug("the_buffer = %p, the_buffer_copy = %p, use_vosf = %d\n", the_buffer, the_buffer_copy, use_vosf));
+
+	// Publish the new mode
+	begin_header_update();
+	shm_header->width = mode.x;
+	shm_header->height = mode.y;
+	shm_header->depth = 1 << mode.depth;
+	shm_header->row_bytes = mode.bytes_per_row;
+	shm_header->nr_rects = 0;
+	end_header_update();
+	full_refresh = true;
+
+	set_mac_frame_buffer(*this);
+	return true;
+}
+
+// Close display
+void headless_monitor_desc::video_close(void)
+{
+	D(bug("video_close()\n"));
+
+#ifdef ENABLE_VOSF
+	if (use_vosf)
+		video_vosf_exit();
+#endif
+}
+
+
+/*
+ *  Initialization
+ */
+
+bool VideoInit(bool classic)
+{
+#ifdef ENABLE_VOSF
+	// Zero the mainBuffer structure
+	mainBuffer.dirtyPages = NULL;
+	mainBuffer.pageInfo = NULL;
+#endif
+
+	// Read prefs
+	frame_skip = PrefsFindInt32("frameskip");
+
+	// Get screen mode from preferences
+	int default_width = classic ? 512 : 640;
+	int default_height = classic ? 342 : 480;
+	const char *mode_str = PrefsFindString("screen");
+	if (!classic && mode_str) {
+		if (sscanf(mode_str, "win/%d/%d", &default_width, &default_height) != 2)
+			sscanf(mode_str, "dga/%d/%d", &default_width, &default_height);
+	}
+	if (default_width <= 0 || default_height <= 0) {
+		default_width = 640;
+		default_height = 480;
+	}
+
+	// Mac screen depth is any, 32-bit unless asked otherwise
+	video_depth default_depth = VDEPTH_32BIT;
+	switch (PrefsFindInt32("displaycolordepth")) {
+		case 1: default_depth = VDEPTH_1BIT; break;
+		case 2: default_depth = VDEPTH_2BIT; break;
+		case 4: default_depth = VDEPTH_4BIT; break;
+		case 8: default_depth = VDEPTH_8BIT; break;
+		case 15: case 16: default_depth = VDEPTH_16BIT; break;
+	}
+
+	// Construct list of supported modes
+	static const struct {
+		int w;
+		int h;
+		int resolution_id;
+	} video_modes[] = {
+		{  512,  384, 0x80 },
+		{  640,  480, 0x81 },
+		{  800,  600, 0x82 },
+		{ 1024,  768, 0x83 },
+		{ 1152,  870, 0x84 },
+		{ 1280, 1024, 0x85 },
+		{ 1600, 1200, 0x86 },
+		{ 0, }
+	};
+	uint32 default_id = 0x80;
+	if (classic) {
+		add_mode(512, 342, 0x80, VDEPTH_1BIT);
+		default_depth = VDEPTH_1BIT;
+	} else {
+		int resolution_id = 0x80;
+		for (int i = 0; video_modes[i].w != 0; i++) {
+			if (video_modes[i].w >= default_width || video_modes[i].h >= default_height)
+				break;
+			for (int d = VDEPTH_1BIT; d <= VDEPTH_32BIT; d++)
+				add_mode(video_modes[i].w, video_modes[i].h, video_modes[i].resolution_id, video_depth(d));
+			resolution_id = video_modes[i].resolution_id + 1;
+		}
+		default_id = resolution_id;
+		for (int d = VDEPTH_1BIT; d <= VDEPTH_32BIT; d++)
+			add_mode(default_width, default_height, default_id, video_depth(d));
+	}
+
+	// The shared memory object is sized for the largest mode
+	uint32 fb_size = 0;
+	for (vector<video_mode>::const_iterator i = VideoModes.begin(); i != VideoModes.end(); ++i) {
+		const uint32 size = i->bytes_per_row * i->y;
+		if (size > fb_size)
+			fb_size = size;
+	}
+	if (!shm_screen_open(fb_size)) {
+		ErrorAlert(STR_OPEN_SCREEN_ERR);
+		return false;
+	}
+
+	// Create headless_monitor_desc for this (the only) display
+	headless_monitor_desc *monitor = new headless_monitor_desc(VideoModes, default_depth, default_id);
+	VideoMonitors.push_back(monitor);
+	if (!monitor->video_open())
+		return false;
+
+	// Start redraw thread
+#ifdef USE_PTHREADS_SERVICES
+	redraw_thread_cancel = false;
+	Set_pthread_attr(&redraw_thread_attr, 0);
+	redraw_thread_active = (pthread_create(&redraw_thread, &redraw_thread_attr, redraw_func, NULL) == 0);
+	if (!redraw_thread_active) {
+		printf("FATAL: cannot create redraw thread\n");
+		return false;
+	}
+#else
+	redraw_thread_active = true;
+#endif
+	return true;
+}
+
+
+/*
+ *  Deinitialization
+ */
+
+void VideoExit(void)
+{
+	// Stop redraw thread
+#ifdef USE_PTHREADS_SERVICES
+	if (redraw_thread_active) {
+		redraw_thread_cancel = true;
+		pthread_join(redraw_thread, NULL);
+	}
+#endif
+	redraw_thread_active = false;
+
+	// Close displays
+	vector<monitor_desc *>::iterator i, end = VideoMonitors.end();
+	for (i = VideoMonitors.begin(); i != end; ++i)
+		dynamic_cast<headless_monitor_desc *>(*i)->video_close();
+
+	// Free frame buffer and remove the shared memory object
+	if (the_buffer_copy) {
+		free(the_buffer_copy);
+		the_buffer_copy = NULL;
+	}
+	shm_screen_close();
+}
+
+
+/*
+ *  Close down full-screen mode (if bringing up error alerts is unsafe while in full-screen mode)
+ */
+
+void VideoQuitFullScreen(void)
+{
+	D(bug("VideoQuitFullScreen()\n"));
+}
+
+
+/*
+ *  Mac VBL interrupt
+ */
+
+void VideoInterrupt(void)
+{
+}
+
+
+/*
+ *  Set palette
+ */
+
+void headless_monitor_desc::set_palette(uint8 *pal, int num)
+{
+	if (num > 256)
+		num = 256;
+
+	LOCK_SCREEN;
+	begin_header_update();
+	memcpy(shm_header->palette, pal, num * 3);
+	end_header_update();
+	UNLOCK_SCREEN;
+
+	// Indexed pixels change color without being written
+	if (!IsDirectMode(get_current_mode()))
+		full_refresh = true;
+}
+
+
+/*
+ *  Set gamma
+ */
+
+void headless_monitor_desc::set_gamma(uint8 *gamma, int num)
+{
+	// Not supported, readers get the raw pixel values
+}
+
+
+/*
+ *  Switch video mode
+ */
+
+void headless_monitor_desc::switch_to_current_mode(void)
+{
+	LOCK_SCREEN;
+	video_close();
+	if (!video_open()) {
+		UNLOCK_SCREEN;
+		ErrorAlert(STR_OPEN_SCREEN_ERR);
+		QuitEmulator();
+	}
+	UNLOCK_SCREEN;
+}
+
+
+/*
+ *  Record dirty area (for writes to the frame buffer that don't go
+ *  through the emulated CPU, as with the SheepShaver drivers)
+ */
+
+void video_set_dirty_area(int x, int y, int w, int h)
+{
+#ifdef ENABLE_VOSF
+	if (use_vosf) {
+		const video_mode &mode = VideoMonitors[0]->get_current_mode();
+		vosf_set_dirty_area(x, y, w, h, mode.x, mode.y, mode.bytes_per_row);
+	}
+#endif
+
+	// Without VOSF, the next refresh compares the whole frame buffer anyway
+}
+
+
+/*
+ *  Video refresh
+ */
+
+// Add rows y1..y2 (inclusive), bytes x1..x2 (exclusive) to the list of changed rectangles
+static int add_damage(headless_video_rect *rects, int n, const video_mode &mode, uint32 x1, uint32 x2, uint32 y1, uint32 y2)
+{
+	// Bytes to pixels, rounded outwards
+	const int bits = 1 << mode.depth;
+	x1 = x1 * 8 / bits;
+	x2 = (x2 * 8 + bits - 1) / bits;
+	if (x2 > mode.x)
+		x2 = mode.x;
+
+	// Rows are found top to bottom: extend the last rectangle if this one
+	// touches it, or when out of rectangles
+	if (n > 0) {
+		headless_video_rect &r = rects[n - 1];
+		if (y1 <= r.y + r.h || n == HEADLESS_VIDEO_MAX_RECTS) {
+			const uint32 rx2 = r.x + r.w;
+			if (x1 < r.x)
+				r.x = x1;
+			r.w = (x2 > rx2 ? x2 : rx2) - r.x;
+			if (y2 + 1 > r.y + r.h)
+				r.h = y2 + 1 - r.y;
+			return n;
+		}
+	}
+	headless_video_rect &r = rects[n];
+	r.x = x1;
+	r.y = y1;
+	r.w = x2 - x1;
+	r.h = y2 + 1 - y1;
+	return n + 1;
+}
+
+#ifdef ENABLE_VOSF
+// Collect rows of the pages written to since last time
+static int find_damage_vosf(headless_video_rect *rects, const video_mode &mode)
+{
+	int n = 0;
+	LOCK_VOSF;
+	if (mainBuffer.dirty) {
+		unsigned page = 0;
+		for (;;) {
+			const unsigned first_page = find_next_page_set(page);
+			if (first_page >= mainBuffer.pageCount)
+				break;
+
+			page = find_next_page_clear(first_page);
+			PFLAG_CLEAR_RANGE(first_page, page);
+
+			// Make the dirty pages read-only again
+			const int32 offset  = first_page << mainBuffer.pageBits;
+			const uint32 length = (page - first_page) << mainBuffer.pageBits;
+			vm_protect((char *)mainBuffer.memStart + offset, length, VM_PAGE_READ);
+
+			const uint32 y1 = mainBuffer.pageInfo[first_page].top;
+			const uint32 y2 = mainBuffer.pageInfo[page - 1].bottom;
+			n = add_damage(rects, n, mode, 0, mode.bytes_per_row, y1, y2);
+		}
+		mainBuffer.dirty = false;
+	}
+	UNLOCK_VOSF;
+	return n;
+}
+#endif
+
+// Compare the frame buffer with its copy, row by row
+static int find_damage_static(headless_video_rect *rects, const video_mode &mode)
+{
+	const uint32 bytes_per_row = mode.bytes_per_row;
+	int n = 0;
+	for (uint32 y = 0; y < mode.y; y++) {
+		uint8 *p = the_buffer + y * bytes_per_row;
+		uint8 *q = the_buffer_copy + y * bytes_per_row;
+		if (memcmp(p, q, bytes_per_row) == 0)
+			continue;
+
+		uint32 x1 = 0, x2 = bytes_per_row;
+		while (p[x1] == q[x1])
+			x1++;
+		while (p[x2 - 1] == q[x2 - 1])
+			x2--;
+		memcpy(q + x1, p + x1, x2 - x1);
+		n = add_damage(rects, n, mode, x1, x2, y, y);
+	}
+	return n;
+}
+
+static void video_refresh(void)
+{
+#ifndef USE_PTHREADS_SERVICES
+	static uint32 tick_counter = 0;
+	if (++tick_counter < frame_skip)
+		return;
+	tick_counter = 0;
+#endif
+
+	LOCK_SCREEN;
+	const video_mode &mode = VideoMonitors[0]->get_current_mode();
+	headless_video_rect rects[HEADLESS_VIDEO_MAX_RECTS];
+	int n = 0;
+	if (full_refresh) {
+		full_refresh = false;
+#ifdef ENABLE_VOSF
+		if (use_vosf) {
+			LOCK_VOSF;
+			PFLAG_CLEAR_ALL;
+			vm_protect((char *)mainBuffer.memStart, mainBuffer.memLength, VM_PAGE_READ);
+			mainBuffer.dirty = false;
+			UNLOCK_VOSF;
+		}
+#endif
+		if (!use_vosf)
+			memcpy(the_buffer_copy, the_buffer, mode.bytes_per_row * mode.y);
+		n = add_damage(rects, 0, mode, 0, mode.bytes_per_row, 0, mode.y - 1);
+	}
+#ifdef ENABLE_VOSF
+	else if (use_vosf)
+		n = find_damage_vosf(rects, mode);
+#endif
+	else
+		n = find_damage_static(rects, mode);
+
+	// Publish changes, nothing is written to the header when the screen is idle
+	if (n > 0) {
+		begin_header_update();
+		shm_header->frame++;
+		shm_header->nr_rects = n;
+		memcpy(shm_header->rects, rects, n * sizeof(headless_video_rect));
+		end_header_update();
+	}
+	UNLOCK_SCREEN;
+}
+
+// This function is called on non-threaded platforms from a timer interrupt
+void VideoRefresh(void)
+{
+	// We need to check redraw_thread_active to inhibit refreshed during
+	// mode changes on non-threaded platforms
+	if (!redraw_thread_active)
+		return;
+
+	video_refresh();
+}
+
+const int VIDEO_REFRESH_HZ = 60;
+const int VIDEO_REFRESH_DELAY = 1000000 / VIDEO_REFRESH_HZ;
+
+#ifdef USE_PTHREADS_SERVICES
+static void *redraw_func(void *arg)
+{
+	uint64 start = GetTicks_usec();
+	int64 ticks = 0;
+	uint64 next = GetTicks_usec() + VIDEO_REFRESH_DELAY;
+	uint32 tick_counter = 0;
+
+	while (!redraw_thread_cancel) {
+
+		// Wait
+		int64 delay = next - GetTicks_usec();
+		if (delay > 0)
+			Delay_usec(delay);
+		else if (delay < -VIDEO_REFRESH_DELAY)
+			next = GetTicks_usec();
+		next += VIDEO_REFRESH_DELAY;
+		ticks++;
+
+		// Update display
+		if (++tick_counter >= frame_skip) {
+			tick_counter = 0;
+			video_refresh();
+		}
+	}
+
+	uint64 end = GetTicks_usec();
+	D(bug("%lld refreshes in %lld usec = %f refreshes/sec\n", ticks, end - start, ticks * 1000000.0 / (end - start)));
+	return NULL;
+}
+#endif
@@ -0,0 +1,73 @@
+/*
+ *  video_headless.h - Layout of the shared memory screen exported by the headless display
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef VIDEO_HEADLESS_H
+#define VIDEO_HEADLESS_H
+
+/*
+ *  This file doesn't depend on sysdeps.h so that external viewers, encoders
+ *  or test tools can include it as is.
+ *
+ *  The POSIX shared memory object (named by the "headlessshm" prefs item,
+ *  "/basilisk_ii-<pid>" by default) starts with a headless_video_header,
+ *  followed by the Mac frame buffer at offset fb_offset. The frame buffer
+ *  is the one MacOS draws into, in Mac format: indexed pixels for depths
+ *  up to 8 (see palette[]), big-endian xRGB 1555 for 16 bits and big-endian
+ *  xRGB 8888 for 32 bits, row_bytes bytes per row.
+ *
+ *  The header is updated as a sequence lock: seq is odd while the emulator
+ *  rewrites it and is incremented to the next even value when done. Readers
+ *  copy the fields they need between two reads of seq and retry if the two
+ *  values differ or are odd. Each published update increments frame and
+ *  lists the rectangles that changed since the previous one; a reader that
+ *  missed frames (frame jumped by more than one) must refresh the whole
+ *  screen. Pixels are read straight from the frame buffer while MacOS keeps
+ *  drawing, so they can be newer than the update that reported them.
+ */
+
+#include <stdint.h>
+
+#define HEADLESS_VIDEO_MAGIC		0x42324653	// 'B2FS'
+#define HEADLESS_VIDEO_VERSION		1
+#define HEADLESS_VIDEO_MAX_RECTS	16
+
+struct headless_video_rect {
+	uint32_t x, y, w, h;
+};
+
+struct headless_video_header {
+	uint32_t magic;				// HEADLESS_VIDEO_MAGIC
+	uint32_t version;			// HEADLESS_VIDEO_VERSION
+	uint32_t fb_offset;			// Offset of the frame buffer in the object (page aligned)
+	uint32_t fb_size;			// Size of the frame buffer area (fits the largest mode)
+
+	uint32_t seq;				// Sequence lock, odd while the fields below are written
+	uint32_t frame;				// Number of updates published so far
+	uint32_t width, height;		// Current mode, in pixels
+	uint32_t depth;				// Bits per pixel (1, 2, 4, 8, 16 or 32)
+	uint32_t row_bytes;			// Bytes per frame buffer row
+
+	uint32_t nr_rects;			// Areas changed by this update
+	struct headless_video_rect rects[HEADLESS_VIDEO_MAX_RECTS];
+
+	uint8_t palette[256 * 3];	// RGB palette for indexed modes
+};
+
+#endif
@@ -560,11 +560,13 @@ class driver_window;
 static void update_display_window_vosf(driver_window *drv);
 static void update_display_dynamic(int ticker, driver_window *drv);
 static void update_display_static(driver_window *drv);
+static void update_static_area(driver_window *drv, int x1, int x2, int y1, int y2);
 
 class driver_window : public driver_base {
 	friend void update_display_window_vosf(driver_window *drv);
 	friend void update_display_dynamic(int ticker, driver_window *drv);
 	friend void update_display_static(driver_window *drv);
+	friend void update_static_area(driver_window *drv, int x1, int x2, int y1, int y2);
 
 public:
 	driver_window(X11_monitor_desc &monitor);
@@ -622,6 +624,9 @@ static driver_base *drv = NULL;	// Pointer to currently used driver object
 # include "video_vosf.h"
 #endif
 
+#define VIDEO_STATIC_DRV driver_window
+#include "video_static.h"
+
 driver_base::driver_base(X11_monitor_desc &m)
  : monitor(m), mode(m.get_current_mode()), init_ok(false), w(0)
 {
@@ -646,6 +651,7 @@ driver_base::~driver_base()
 
 	// Free frame buffer(s)
 	if (!use_vosf) {
+		video_static_exit();
 		if (the_buffer) {
 			free(the_buffer);
 			the_buffer = NULL;
@@ -2247,8 +2253,10 @@ static void handle_events(void)
 						for (x1=0; x1<16; x1++)
 							updt_box[x1][y1] = true;
 						nr_boxes = 16 * 16;
-					} else					// Static refresh
+					} else {				// Static refresh
 						memset(the_buffer_copy, 0, mode.bytes_per_row * mode.y);
+						tile_hashes_valid = false;
+					}
 				}
 				break;
 		}
@@ -2356,123 +2364,33 @@ static void update_display_dynamic(int ticker, driver_window *drv)
 	XDisplayUnlock();
 }
 
-// Static display update (fixed frame rate, but incremental)
-static void update_display_static(driver_window *drv)
+// Display an area of the_buffer, given in bytes
+static void update_static_area(driver_window *drv, int x1, int x2, int y1, int y2)
 {
-	// Incremental update code
-	unsigned wide = 0, high = 0, x1, x2, y1, y2, i, j;
 	const video_mode &mode = drv->monitor.get_current_mode();
-	int bytes_per_row = mode.bytes_per_row;
-	int bytes_per_pixel = mode.bytes_per_row / mode.x;
-	uint8 *p, *p2;
-
-	// Check for first line from top and first line from bottom that have changed
-	y1 = 0;
-	for (j=0; j<mode.y; j++) {
-		if (memcmp(&the_buffer[j * bytes_per_row], &the_buffer_copy[j * bytes_per_row], bytes_per_row)) {
-			y1 = j;
-			break;
-		}
-	}
-	y2 = y1 - 1;
-	for (j=mode.y-1; j>=y1; j--) {
-		if (memcmp(&the_buffer[j * bytes_per_row], &the_buffer_copy[j * bytes_per_row], bytes_per_row)) {
-			y2 = j;
-			break;
-		}
-	}
-	high = y2 - y1 + 1;
-
-	// Check for first column from left and first column from right that have changed
-	if (high) {
-		if (mode.depth == VDEPTH_1BIT) {
-			x1 = mode.x - 1;
-			for (j=y1; j<=y2; j++) {
-				p = &the_buffer[j * bytes_per_row];
-				p2 = &the_buffer_copy[j * bytes_per_row];
-				for (i=0; i<(x1>>3); i++) {
-					if (*p != *p2) {
-						x1 = i << 3;
-						break;
-					}
-					p++; p2++;
-				}
-			}
-			x2 = x1;
-			for (j=y1; j<=y2; j++) {
-				p = &the_buffer[j * bytes_per_row];
-				p2 = &the_buffer_copy[j * bytes_per_row];
-				p += bytes_per_row;
-				p2 += bytes_per_row;
-				for (i=(mode.x>>3); i>(x2>>3); i--) {
-					p--; p2--;
-					if (*p != *p2) {
-						x2 = (i << 3) + 7;
-						break;
-					}
-				}
-			}
-			wide = x2 - x1 + 1;
-
-			// Update copy of the_buffer
-			if (high && wide) {
-				for (j=y1; j<=y2; j++) {
-					i = j * bytes_per_row + (x1 >> 3);
-					memcpy(the_buffer_copy + i, the_buffer + i, wide >> 3);
-				}
-			}
-
-		} else {
-			x1 = mode.x;
-			for (j=y1; j<=y2; j++) {
-				p = &the_buffer[j * bytes_per_row];
-				p2 = &the_buffer_copy[j * bytes_per_row];
-				for (i=0; i<x1*bytes_per_pixel; i++) {
-					if (*p != *p2) {
-						x1 = i / bytes_per_pixel;
-						break;
-					}
-					p++; p2++;
-				}
-			}
-			x2 = x1;
-			for (j=y1; j<=y2; j++) {
-				p = &the_buffer[j * bytes_per_row];
-				p2 = &the_buffer_copy[j * bytes_per_row];
-				p += bytes_per_row;
-				p2 += bytes_per_row;
-				for (i=mode.x*bytes_per_pixel; i>x2*bytes_per_pixel; i--) {
-					p--;
-					p2--;
-					if (*p != *p2) {
-						x2 = i / bytes_per_pixel;
-						break;
-					}
-				}
-			}
-			wide = x2 - x1;
-
-			// Update copy of the_buffer
-			if (high && wide) {
-				for (j=y1; j<=y2; j++) {
-					i = j * bytes_per_row + x1 * bytes_per_pixel;
-					memcpy(the_buffer_copy + i, the_buffer + i, bytes_per_pixel * wide);
-				}
-			}
-		}
+	int px1, px2;
+	if (mode.depth == VDEPTH_1BIT) {
+		px1 = x1 * 8;
+		px2 = x2 * 8;
+	} else {
+		const int bytes_per_pixel = mode.bytes_per_row / mode.x;
+		px1 = x1 / bytes_per_pixel;
+		px2 = (x2 + bytes_per_pixel - 1) / bytes_per_pixel;
 	}
-
-	// Refresh display
 	XDisplayLock();
-	if (high && wide) {
-		if (drv->have_shm)
-			XShmPutImage(x_display, drv->w, drv->gc, drv->img, x1, y1, x1, y1, wide, high, 0);
-		else
-			XPutImage(x_display, drv->w, drv->gc, drv->img, x1, y1, x1, y1, wide, high);
-	}
+	if (drv->have_shm)
+		XShmPutImage(x_display, drv->w, drv->gc, drv->img, px1, y1, px1, y1, px2 - px1, y2 - y1 + 1, 0);
+	else
+		XPutImage(x_display, drv->w, drv->gc, drv->img, px1, y1, px1, y1, px2 - px1, y2 - y1 + 1);
 	XDisplayUnlock();
 }
 
+// Static display update (fixed frame rate, but incremental)
+static void update_display_static(driver_window *drv)
+{
+	update_static(drv, drv->monitor.get_current_mode(), drv->img->bytes_per_line);
+}
+
 
 /*
  *	Screen refresh functions
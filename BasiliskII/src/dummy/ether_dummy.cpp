@@ -127,6 +127,22 @@ int16 ether_write(uint32 wds)
 }
 
 
+#if SUPPORTS_UDP_TUNNEL
+/*
+ *  Send packet to UDP tunnel peer
+ */
+
+int16 ether_udp_write(const uint8 *packet, int length, const struct sockaddr_in *to)
+{
+	if (sendto(fd, packet, length, 0, (struct sockaddr *)to, sizeof(*to)) < 0) {
+		D(bug("WARNING: Couldn't transmit packet\n"));
+		return excessCollsns;
+	}
+	return noErr;
+}
+#endif
+
+
 /*
  *  Start UDP packet reception thread
  */
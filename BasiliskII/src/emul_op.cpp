@@ -476,6 +476,12 @@ void EmulOp(uint16 opcode, M68kRegisters *r)
 				}
 			}
 
+			if (InterruptFlags & INTFLAG_TIMER) {
+				ClearInterruptFlag(INTFLAG_TIMER);
+				if (HasMacStarted())
+					TimerInterrupt();
+			}
+
 			if (InterruptFlags & INTFLAG_SERIAL) {
 				ClearInterruptFlag(INTFLAG_SERIAL);
 				SerialInterrupt();
@@ -37,6 +37,7 @@
 #include <netdb.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stdlib.h>
 #endif
 
 #include "cpu_emulation.h"
@@ -78,6 +79,49 @@ uint32 ether_data = 0;
 // Attached network protocols for UDP tunneling, maps protocol type to MacOS handler address
 static map<uint16, uint32> udp_protocols;
 
+#if SUPPORTS_UDP_TUNNEL
+// UDP tunnel peers, maps Ethernet address to the socket address packets from
+// it were received from, so unicast packets go to that peer only
+static map<uint64, struct sockaddr_in> udp_peers;
+const int UDP_MAX_LEARNED_PEERS = 256;
+
+// Destinations for broadcast, multicast and unknown unicast packets: the IP
+// broadcast address, or the peers given by "udppeer" prefs items
+const int UDP_MAX_FLOOD = 32;
+static struct sockaddr_in udp_flood[UDP_MAX_FLOOD];
+static int udp_num_flood = 0;
+
+static inline uint64 udp_peer_key(const uint8 *addr)
+{
+	return ((uint64)addr[0] << 40) | ((uint64)addr[1] << 32) | ((uint32)addr[2] << 24) | (addr[3] << 16) | (addr[4] << 8) | addr[5];
+}
+
+// Add "host[:port]" to the flood destinations
+static bool udp_add_peer(const char *str)
+{
+	if (udp_num_flood == UDP_MAX_FLOOD)
+		return false;
+	char host[256];
+	strncpy(host, str, sizeof(host) - 1);
+	host[sizeof(host) - 1] = 0;
+	int port = udp_port;
+	char *colon = strrchr(host, ':');
+	if (colon) {
+		*colon = 0;
+		port = atoi(colon + 1);
+	}
+	struct hostent *h = gethostbyname(host);
+	if (h == NULL || h->h_addrtype != AF_INET || port <= 0 || port > 65535)
+		return false;
+	struct sockaddr_in *sa = &udp_flood[udp_num_flood++];
+	memset(sa, 0, sizeof(*sa));
+	sa->sin_family = AF_INET;
+	memcpy(&sa->sin_addr, h->h_addr_list[0], 4);
+	sa->sin_port = htons(port);
+	return true;
+}
+#endif
+
 
 /*
  *  Initialization
@@ -127,13 +171,40 @@ void EtherInit(void)
 		}
 		udp_ip = ntohl(udp_ip);
 
-		// Construct dummy Ethernet address from local IP address
+		// Collect explicit peers, broadcast on the local network otherwise
+		udp_peers.clear();
+		udp_num_flood = 0;
+		const char *str;
+		int index = 0;
+		while ((str = PrefsFindString("udppeer", index++)) != NULL) {
+			if (!udp_add_peer(str))
+				printf("WARNING: Invalid UDP tunnel peer '%s'\n", str);
+		}
+		bool have_peers = (udp_num_flood > 0);
+		if (!have_peers) {
+			memset(&udp_flood[0], 0, sizeof(udp_flood[0]));
+			udp_flood[0].sin_family = AF_INET;
+			udp_flood[0].sin_addr.s_addr = htonl(INADDR_BROADCAST);
+			udp_flood[0].sin_port = htons(udp_port);
+			udp_num_flood = 1;
+		}
+
+		// Construct dummy Ethernet address from local IP address, and port
+		// number when peers may be other instances on the same host
 		ether_addr[0] = 'B';
 		ether_addr[1] = '2';
 		ether_addr[2] = udp_ip >> 24;
 		ether_addr[3] = udp_ip >> 16;
 		ether_addr[4] = udp_ip >> 8;
 		ether_addr[5] = udp_ip;
+		if (have_peers) {
+			ether_addr[0] = 'b';
+			ether_addr[1] = udp_ip >> 16;
+			ether_addr[2] = udp_ip >> 8;
+			ether_addr[3] = udp_ip;
+			ether_addr[4] = udp_port >> 8;
+			ether_addr[5] = udp_port;
+		}
 		D(bug("Ethernet address %02x %02x %02x %02x %02x %02x\n", ether_addr[0], ether_addr[1], ether_addr[2], ether_addr[3], ether_addr[4], ether_addr[5]));
 
 		// Set socket options
@@ -193,23 +264,6 @@ void EtherReset(void)
 }
 
 
-/*
- *  Check whether Ethernet address is AppleTalk or Ethernet broadcast address
- */
-
-static inline bool is_apple_talk_broadcast(uint8 *p)
-{
-	return p[0] == 0x09 && p[1] == 0x00 && p[2] == 0x07
-	    && p[3] == 0xff && p[4] == 0xff && p[5] == 0xff;
-}
-
-static inline bool is_ethernet_broadcast(uint8 *p)
-{
-	return p[0] == 0xff && p[1] == 0xff && p[2] == 0xff
-	    && p[3] == 0xff && p[4] == 0xff && p[5] == 0xff;
-}
-
-
 /*
  *  Driver Open() routine
  */
@@ -325,14 +379,26 @@ int16 EtherControl(uint32 pb, uint32 dce)
 					uint8 packet[1514];
 					int len = ether_wds_to_buffer(wds, packet);
 
-					// Extract destination address
-					uint32 dest_ip;
-					if (len >= 6 && packet[0] == 'B' && packet[1] == '2')
-						dest_ip = (packet[2] << 24) | (packet[3] << 16) | (packet[4] << 8) | packet[5];
-					else if (is_apple_talk_broadcast(packet) || is_ethernet_broadcast(packet))
-						dest_ip = INADDR_BROADCAST;
-					else
-						return eMultiErr;
+					// Find destination peer: learned from received packets,
+					// or encoded in the Ethernet address of another Basilisk II,
+					// all peers otherwise
+					struct sockaddr_in sa;
+					const struct sockaddr_in *dest = udp_flood;
+					int num_dest = udp_num_flood;
+					if (!(packet[0] & 1)) {
+						map<uint64, struct sockaddr_in>::const_iterator it = udp_peers.find(udp_peer_key(packet));
+						if (it != udp_peers.end()) {
+							dest = &it->second;
+							num_dest = 1;
+						} else if (packet[0] == 'B' && packet[1] == '2') {
+							memset(&sa, 0, sizeof(sa));
+							sa.sin_family = AF_INET;
+							sa.sin_addr.s_addr = htonl((packet[2] << 24) | (packet[3] << 16) | (packet[4] << 8) | packet[5]);
+							sa.sin_port = htons(udp_port);
+							dest = &sa;
+							num_dest = 1;
+						}
+					}
 
 #if MONITOR
 					bug("Sending Ethernet packet:\n");
@@ -343,14 +409,13 @@ int16 EtherControl(uint32 pb, uint32 dce)
 #endif
 
 					// Send packet
-					struct sockaddr_in sa;
-					sa.sin_family = AF_INET;
-					sa.sin_addr.s_addr = htonl(dest_ip);
-					sa.sin_port = htons(udp_port);
-					if (sendto(udp_socket, packet, len, 0, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
-						D(bug("WARNING: Couldn't transmit packet\n"));
-						return excessCollsns;
+					int16 result = noErr;
+					for (int i=0; i<num_dest; i++) {
+						if (ether_udp_write(packet, len, &dest[i]) != noErr)
+							result = excessCollsns;
 					}
+					if (result != noErr)
+						return result;
 				} else
 #endif
 					return ether_write(wds);
@@ -410,9 +475,22 @@ void EtherReadPacket(uint32 &src, uint32 &dest, uint32 &len, uint32 &remaining)
 void ether_udp_read(uint32 packet, int length, struct sockaddr_in *from)
 {
 	// Drop packets sent by us
-	if (memcmp(Mac2HostAddr(packet) + 6, ether_addr, 6) == 0)
+	const uint8 *src = Mac2HostAddr(packet) + 6;
+	if (memcmp(src, ether_addr, 6) == 0)
 		return;
 
+	// Learn where the sender is
+	if (!(src[0] & 1)) {
+		uint64 key = udp_peer_key(src);
+		map<uint64, struct sockaddr_in>::iterator it = udp_peers.find(key);
+		if (it == udp_peers.end()) {
+			if (udp_peers.size() >= UDP_MAX_LEARNED_PEERS)
+				udp_peers.clear();
+			udp_peers[key] = *from;
+		} else if (it->second.sin_addr.s_addr != from->sin_addr.s_addr || it->second.sin_port != from->sin_port)
+			it->second = *from;
+	}
+
 #if MONITOR
 	bug("Receiving Ethernet packet:\n");
 	for (int i=0; i<length; i++) {
@@ -41,6 +41,7 @@ extern void timer_sub_time(tm_time_t &res, tm_time_t a, tm_time_t b);
 extern int timer_cmp_time(tm_time_t a, tm_time_t b);
 extern void timer_mac2host_time(tm_time_t &res, int32 mactime);
 extern int32 timer_host2mac_time(tm_time_t hosttime);
+extern void timer_schedule_interrupt(const tm_time_t *wakeup);	// Trigger INTFLAG_TIMER at wakeup (NULL = cancel), PRECISE_TIMING only
 
 // Suspend execution of emulator thread and resume it on events
 extern void idle_wait(void);
@@ -32,6 +32,10 @@
 
 #include <slirp.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 /*
  * Checksum routine for Internet Protocol family headers (Portable Version).
  *
@@ -39,99 +43,103 @@
  * code and should be modified for each CPU to be as fast as possible.
  * 
  * XXX Since we will never span more than 1 mbuf, we can optimise this
+ *
+ * The ones complement sum doesn't depend on the order the 16-bit
+ * words are added in, nor on the byte order they are added in as
+ * long as it's the same for all (RFC 1071). So whole 32-bit words
+ * are added into 64-bit sums, several at a time, and the SSE2 version
+ * adds eight 16-bit words at once. Loads go through memcpy(), the
+ * data needn't be aligned.
  */
 
-#define ADDCARRY(x)  (x > 65535 ? x -= 65535 : x)
-#define REDUCE {l_util.l = sum; sum = l_util.s[0] + l_util.s[1]; ADDCARRY(sum);}
-
-int cksum(struct mbuf *m, int len)
+static u_int32_t cksum_sum(const u_int8_t *p, int len)
 {
-	register u_int16_t *w;
-	register int sum = 0;
-	register int mlen = 0;
-	int byte_swapped = 0;
-
+	u_int64_t sum = 0, sum1 = 0, sum2 = 0, sum3 = 0;
 	union {
 		u_int8_t	c[2];
 		u_int16_t	s;
 	} s_util;
-	union {
-		u_int16_t s[2];
-		u_int32_t l;
-	} l_util;
-	
-	if (m->m_len == 0)
-	   goto cont;
-	w = mtod(m, u_int16_t *);
-	
-	mlen = m->m_len;
-	
-	if (len < mlen)
-	   mlen = len;
-	len -= mlen;
-	/*
-	 * Force to even boundary.
-	 */
-	if ((1 & (long) w) && (mlen > 0)) {
-		REDUCE;
-		sum <<= 8;
-		s_util.c[0] = *(u_int8_t *)w;
-		w = (u_int16_t *)((int8_t *)w + 1);
-		mlen--;
-		byte_swapped = 1;
+
+#ifdef __SSE2__
+	if (len >= 64) {
+		const __m128i zero = _mm_setzero_si128();
+		__m128i acc0 = zero, acc1 = zero;
+		u_int32_t lanes[4];
+
+		/*
+		 * Widen the 16-bit words to 32-bit lanes. Each lane gains
+		 * at most 2 * 0xffff per iteration, so IP packet sizes
+		 * are far from overflowing it
+		 */
+		while (len >= 32) {
+			__m128i a = _mm_loadu_si128((const __m128i *)p);
+			__m128i b = _mm_loadu_si128((const __m128i *)(p + 16));
+			acc0 = _mm_add_epi32(acc0, _mm_unpacklo_epi16(a, zero));
+			acc1 = _mm_add_epi32(acc1, _mm_unpackhi_epi16(a, zero));
+			acc0 = _mm_add_epi32(acc0, _mm_unpacklo_epi16(b, zero));
+			acc1 = _mm_add_epi32(acc1, _mm_unpackhi_epi16(b, zero));
+			p += 32;
+			len -= 32;
+		}
+		_mm_storeu_si128((__m128i *)lanes, acc0);
+		sum += (u_int64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+		_mm_storeu_si128((__m128i *)lanes, acc1);
+		sum += (u_int64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
 	}
-	/*
-	 * Unroll the loop to make overhead from
-	 * branches &c small.
-	 */
-	while ((mlen -= 32) >= 0) {
-		sum += w[0]; sum += w[1]; sum += w[2]; sum += w[3];
-		sum += w[4]; sum += w[5]; sum += w[6]; sum += w[7];
-		sum += w[8]; sum += w[9]; sum += w[10]; sum += w[11];
-		sum += w[12]; sum += w[13]; sum += w[14]; sum += w[15];
-		w += 16;
+#endif
+
+	while (len >= 16) {
+		u_int32_t w[4];
+		memcpy(w, p, 16);
+		sum += w[0]; sum1 += w[1]; sum2 += w[2]; sum3 += w[3];
+		p += 16;
+		len -= 16;
 	}
-	mlen += 32;
-	while ((mlen -= 8) >= 0) {
-		sum += w[0]; sum += w[1]; sum += w[2]; sum += w[3];
-		w += 4;
+	sum += sum1 + sum2 + sum3;
+	while (len >= 2) {
+		memcpy(&s_util.s, p, 2);
+		sum += s_util.s;
+		p += 2;
+		len -= 2;
 	}
-	mlen += 8;
-	if (mlen == 0 && byte_swapped == 0)
-	   goto cont;
-	REDUCE;
-	while ((mlen -= 2) >= 0) {
-		sum += *w++;
+	if (len) {
+		/* The odd byte is the first of a 16-bit word padded with zero */
+		s_util.c[0] = *p;
+		s_util.c[1] = 0;
+		sum += s_util.s;
 	}
-	
-	if (byte_swapped) {
-		REDUCE;
-		sum <<= 8;
-		byte_swapped = 0;
-		if (mlen == -1) {
-			s_util.c[1] = *(u_int8_t *)w;
-			sum += s_util.s;
-			mlen = 0;
-		} else
-		   
-		   mlen = -1;
-	} else if (mlen == -1)
-	   s_util.c[0] = *(u_int8_t *)w;
-	
-cont:
+
+	sum = (sum >> 32) + (sum & 0xffffffff);
+	sum = (sum >> 16) + (sum & 0xffff);
+	sum = (sum >> 16) + (sum & 0xffff);
+	sum = (sum >> 16) + (sum & 0xffff);
+	return (u_int32_t)sum;
+}
+
+int cksum(struct mbuf *m, int len)
+{
+	int mlen = m->m_len;
+
+	if (len < mlen)
+	   mlen = len;
 #ifdef DEBUG
-	if (len) {
+	if (len > mlen) {
 		DEBUG_ERROR((dfd, "cksum: out of data\n"));
-		DEBUG_ERROR((dfd, " len = %d\n", len));
+		DEBUG_ERROR((dfd, " len = %d\n", len - mlen));
 	}
 #endif
-	if (mlen == -1) {
-		/* The last mbuf has odd # of bytes. Follow the
-		 standard (the odd byte may be shifted left by 8 bits
-			   or not as determined by endian-ness of the machine) */
-		s_util.c[1] = 0;
-		sum += s_util.s;
-	}
-	REDUCE;
-	return (~sum & 0xffff);
+	return (~cksum_sum(mtod(m, u_int8_t *), mlen) & 0xffff);
+}
+
+/*
+ * Update checksum sum for a 16-bit word of the data it covers
+ * changing from old_word to new_word, all as stored in the packet (RFC 1624)
+ */
+u_int16_t cksum_adjust(u_int16_t sum, u_int16_t old_word, u_int16_t new_word)
+{
+	u_int32_t s = (u_int16_t)~sum + (u_int16_t)~old_word + new_word;
+
+	s = (s >> 16) + (s & 0xffff);
+	s = (s >> 16) + (s & 0xffff);
+	return ~s & 0xffff;
 }
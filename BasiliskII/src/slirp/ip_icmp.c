@@ -108,7 +108,12 @@ icmp_input(m, hlen)
   DEBUG_ARG("icmp_type = %d", icp->icmp_type);
   switch (icp->icmp_type) {
   case ICMP_ECHO:
-    icp->icmp_type = ICMP_ECHOREPLY;
+    {
+      /* The checksum was good, just account for the new type */
+      u_int16_t old_word = *(u_int16_t *)icp;
+      icp->icmp_type = ICMP_ECHOREPLY;
+      icp->icmp_cksum = cksum_adjust(icp->icmp_cksum, old_word, *(u_int16_t *)icp);
+    }
     ip->ip_len += hlen;	             /* since ip_input subtracts this */
     if (ip->ip_dst.s_addr == alias_addr.s_addr) {
       icmp_reflect(m);
@@ -128,6 +133,7 @@ icmp_input(m, hlen)
       so->so_fport = htons(7);
       so->so_laddr = ip->ip_src;
       so->so_lport = htons(9);
+      sohash(&udb, so);
       so->so_iptos = ip->ip_tos;
       so->so_type = IPPROTO_ICMP;
       so->so_state = SS_ISFCONNECTED;
@@ -327,21 +333,12 @@ icmp_reflect(m)
   register struct ip *ip = mtod(m, struct ip *);
   int hlen = ip->ip_hl << 2;
   int optlen = hlen - sizeof(struct ip );
-  register struct icmp *icp;
 
   /*
-   * Send an icmp packet back to the ip level,
-   * after supplying a checksum.
+   * Send an icmp packet back to the ip level. The icmp
+   * checksum is up to date already (see icmp_input()),
+   * only the ip header changes here.
    */
-  m->m_data += hlen;
-  m->m_len -= hlen;
-  icp = mtod(m, struct icmp *);
-
-  icp->icmp_cksum = 0;
-  icp->icmp_cksum = cksum(m, ip->ip_len - hlen);
-
-  m->m_data -= hlen;
-  m->m_len += hlen;
 
   /* fill in ip */
   if (optlen > 0) {
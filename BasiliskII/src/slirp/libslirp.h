@@ -29,6 +29,19 @@ int slirp_select_fill(int *pnfds,
 
 void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds);
 
+#if defined(HAVE_SYS_EPOLL_H) && !defined(_WIN32)
+#ifndef SLIRP_USE_EPOLL
+#define SLIRP_USE_EPOLL 1
+#endif
+/* epoll alternative to slirp_select_fill() and slirp_select_poll():
+   wait until slirp_epoll_fd() is readable or the timeout (in us)
+   returned by slirp_epoll_fill() expires, then call slirp_epoll_poll().
+   slirp_epoll_fd() returns -1 if epoll is not available */
+int slirp_epoll_fd(void);
+int slirp_epoll_fill(void);
+void slirp_epoll_poll(void);
+#endif
+
 void slirp_input(const uint8 *pkt, int pkt_len);
 
 /* you must provide the following functions: */
@@ -22,10 +22,13 @@ struct	mbuf *mbutl;
 char	*mclrefcnt;
 int mbuf_alloced = 0;
 struct mbuf m_freelist, m_usedlist;
-int mbuf_thresh = 30;
+int mbuf_thresh = MBUF_THRESH;
 int mbuf_max = 0;
 int msize;
 
+#define MBUF_ALIGN 64		/* Cache line size, mbufs start on one */
+#define MBUF_SLAB 32		/* Mbufs carved out of each slab */
+
 void
 m_init()
 {
@@ -43,15 +46,52 @@ msize_init()
 	 */
 	msize = (if_mtu>if_mru?if_mtu:if_mru) + 
 			if_maxlinkhdr + sizeof(struct m_hdr ) + 6;
+	msize = (msize + MBUF_ALIGN - 1) & ~(MBUF_ALIGN - 1);
+}
+
+/*
+ * Carve up to MBUF_SLAB mbufs out of one malloc()ed slab, keep
+ * one and put the others on the free list. Slabs are never freed,
+ * their mbufs go back to the free list
+ */
+static struct mbuf *
+m_slab()
+{
+	struct mbuf *m;
+	char *slab;
+	int i, n;
+
+	n = mbuf_thresh - mbuf_alloced;
+	if (n > MBUF_SLAB)
+		n = MBUF_SLAB;
+	slab = (char *)malloc(n * msize + MBUF_ALIGN - 1);
+	if (slab == NULL)
+		return NULL;
+	slab = (char *)(((uintptr_t)slab + MBUF_ALIGN - 1) & ~(uintptr_t)(MBUF_ALIGN - 1));
+
+	for (i = 1; i < n; i++) {
+		m = (struct mbuf *)(slab + i * msize);
+		m->m_flags = M_FREELIST;
+		m->m_next = m_freelist.m_next;
+		m_freelist.m_next = m;
+	}
+	mbuf_alloced += n;
+	if (mbuf_alloced > mbuf_max)
+		mbuf_max = mbuf_alloced;
+	return (struct mbuf *)slab;
 }
 
 /*
  * Get an mbuf from the free list, if there are none
- * malloc one
+ * carve a slab of them until there are mbuf_thresh
+ * mbufs, then malloc one
  * 
  * Because fragmentation can occur if we alloc new mbufs and
  * free old mbufs, we mark all mbufs above mbuf_thresh as M_DOFREE,
  * which tells m_free to actually free() it
+ *
+ * The free list is a stack linked through m_next, so the mbuf
+ * handed out is the one most recently freed, likely still in cache
  */
 struct mbuf *
 m_get()
@@ -61,17 +101,18 @@ m_get()
 	
 	DEBUG_CALL("m_get");
 	
-	if (m_freelist.m_next == &m_freelist) {
+	if (m_freelist.m_next != &m_freelist) {
+		m = m_freelist.m_next;
+		m_freelist.m_next = m->m_next;
+	} else if (mbuf_alloced < mbuf_thresh && (m = m_slab()) != NULL) {
+		/* Fresh from a slab */
+	} else {
 		m = (struct mbuf *)malloc(msize);
 		if (m == NULL) goto end_error;
 		mbuf_alloced++;
-		if (mbuf_alloced > mbuf_thresh)
-			flags = M_DOFREE;
+		flags = M_DOFREE;
 		if (mbuf_alloced > mbuf_max)
 			mbuf_max = mbuf_alloced;
-	} else {
-		m = m_freelist.m_next;
-		remque(m);
 	}
 	
 	/* Insert it in the used list */
@@ -113,7 +154,8 @@ m_free(m)
 		free(m);
 		mbuf_alloced--;
 	} else if ((m->m_flags & M_FREELIST) == 0) {
-		insque(m,&m_freelist);
+		m->m_next = m_freelist.m_next;
+		m_freelist.m_next = m;
 		m->m_flags = M_FREELIST; /* Clobber other flags */
 	}
   } /* if(m) */
@@ -416,6 +416,7 @@ fork_exec(so, ex, do_pty)
 			setsockopt(so->s,SOL_SOCKET,SO_OOBINLINE,(char *)&opt,sizeof(int));
 		}
 		fd_nonblock(so->s);
+		sopoll_add(so);
 		
 		/* Append the telnet options now */
 		if (so->so_m != 0 && do_pty == 1)  {
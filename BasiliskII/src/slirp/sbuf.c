@@ -128,6 +128,9 @@ sbappend(so, m)
 	} /* else */
 	/* Whatever happened, we free the mbuf */
 	m_free(m);
+	
+	if (so->so_rcv.sb_cc)
+	   sorwakeup(so);
 }
 
 /*
@@ -131,6 +131,8 @@ void slirp_cleanup(void)
 }
 #endif
 
+static void updtime(void);
+
 int slirp_init(void)
 {
     //    debug_init("/tmp/slirp.log", DEBUG_DEFAULT);
@@ -147,8 +149,13 @@ int slirp_init(void)
 
     link_up = 1;
 
+    /* Packets may arrive before the first slirp_select_fill(), don't let
+       them create sockets that expire at once */
+    updtime();
+
     if_init();
     ip_init();
+    so_init();
 
     /* Initialise mbufs *after* setting the MTU */
     m_init();
@@ -194,12 +201,14 @@ static void updtime(void)
 }
 #endif
 
+static int slirp_timeout(void);
+static void slirp_timers(void);
+
 int slirp_select_fill(int *pnfds, 
 					  fd_set *readfds, fd_set *writefds, fd_set *xfds)
 {
     struct socket *so, *so_next;
     int nfds;
-    int timeout, tmp_time;
 
     /* fail safe */
     global_readfds = NULL;
@@ -305,11 +314,27 @@ int slirp_select_fill(int *pnfds,
 				UPD_NFDS(so->s);
 			}
 		}
+
+		/*
+		 * Host DNS lookups being done
+		 */
+		if (dns_wakeup_fd >= 0) {
+			FD_SET(dns_wakeup_fd, readfds);
+			UPD_NFDS(dns_wakeup_fd);
+		}
 	}
 	
-	/*
-	 * Setup timeout to use minimum CPU usage, especially when idle
-	 */
+	*pnfds = nfds;
+
+	return slirp_timeout();
+}
+
+/*
+ * Setup timeout to use minimum CPU usage, especially when idle
+ */
+static int slirp_timeout(void)
+{
+	int timeout, tmp_time;
 
 	timeout = -1;
 
@@ -338,7 +363,6 @@ int slirp_select_fill(int *pnfds,
 			   timeout = tmp_time;
 		}
 	}
-	*pnfds = nfds;
 
 	/*
 	 * Adjust the timeout to make the minimum timeout
@@ -365,17 +389,7 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
 	/*
 	 * See if anything has timed out 
 	 */
-	if (link_up) {
-		if (time_fasttimo && ((curtime - time_fasttimo) >= FAST_TIMO)) {
-			tcp_fasttimo();
-			time_fasttimo = 0;
-		}
-		if (do_slowtimo && ((curtime - last_slowtimo) >= SLOW_TIMO)) {
-			ip_slowtimo();
-			tcp_slowtimo();
-			last_slowtimo = curtime;
-		}
-	}
+	slirp_timers();
 	
 	/*
 	 * Check sockets
@@ -505,6 +519,12 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
                             sorecvfrom(so);
                         }
 		}
+
+		/*
+		 * Answer the DNS queries whose host lookups are done
+		 */
+		if (dns_wakeup_fd >= 0 && FD_ISSET(dns_wakeup_fd, readfds))
+			dns_poll();
 	}
 	
 	/*
@@ -523,6 +543,229 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
 	 global_xfds = NULL;
 }
 
+static void slirp_timers(void)
+{
+	if (link_up) {
+		if (time_fasttimo && ((curtime - time_fasttimo) >= FAST_TIMO)) {
+			tcp_fasttimo();
+			time_fasttimo = 0;
+		}
+		if (do_slowtimo && ((curtime - last_slowtimo) >= SLOW_TIMO)) {
+			ip_slowtimo();
+			tcp_slowtimo();
+			last_slowtimo = curtime;
+		}
+	}
+}
+
+#ifdef SLIRP_USE_EPOLL
+/*
+ * epoll backend
+ *
+ * Sockets register with so_epollfd once (see sopoll_add()), and the
+ * readiness it reports is latched in so_pollev. Only the sockets on
+ * so_pollq, those with latched readiness they may be able to act on,
+ * are looked at on each iteration, instead of every socket as with
+ * slirp_select_fill() and slirp_select_poll(). Sockets that can't act
+ * on their readiness yet (e.g. so_snd is full) leave the queue, and
+ * are queued again by sorwakeup(), sowwakeup() or soisfconnected().
+ */
+
+#define UDP_EXPIRE_SCAN 1000	/* Look for expired UDP sockets every second */
+
+static u_int last_udp_expire_scan;
+
+int slirp_epoll_fd(void)
+{
+	return so_epollfd;
+}
+
+/* Can so act on its latched readiness now? */
+static int sopoll_wanted(struct socket *so)
+{
+	int ev = so->so_pollev;
+
+	if (so->so_state & SS_NOFDREF || so->s == -1)
+		return 0;
+	if (so->so_state & SS_FACCEPTCONN)
+		return ev & SO_POLLIN;
+	if (so->so_tcpcb == NULL)	/* UDP */
+		return (ev & SO_POLLIN) && (so->so_state & SS_ISFCONNECTED) && so->so_queued <= 4;
+	if (so->so_state & SS_ISFCONNECTING)
+		return ev & SO_POLLOUT;
+	if ((ev & SO_POLLOUT) && CONN_CANFSEND(so) && so->so_rcv.sb_cc)
+		return 1;
+	if ((ev & (SO_POLLIN|SO_POLLPRI)) && CONN_CANFRCV(so) &&
+	    (so->so_snd.sb_cc < (so->so_snd.sb_datalen/2)))
+		return 1;
+	return 0;
+}
+
+/* Expire UDP sockets, see slirp_select_fill() */
+static void udp_expire(void)
+{
+	struct socket *so, *so_next;
+
+	for (so = udb.so_next; so != &udb; so = so_next) {
+		so_next = so->so_next;
+		if (so->so_expire && so->so_expire <= curtime)
+			udp_detach(so);
+	}
+	last_udp_expire_scan = curtime;
+}
+
+int slirp_epoll_fill(void)
+{
+	struct socket *so, *so_next;
+
+	do_slowtimo = 0;
+	if (link_up) {
+		do_slowtimo = ((tcb.so_next != &tcb) ||
+			 (&ipq.ip_link != ipq.ip_link.next));
+
+		for (so = so_pollq.so_pnext; so != &so_pollq; so = so_next) {
+			so_next = so->so_pnext;
+			if (!sopoll_wanted(so))
+				sopoll_dequeue(so);
+		}
+		if (so_pollq.so_pnext != &so_pollq)
+			return 0;
+	}
+	return slirp_timeout();
+}
+
+/* Service a connected or connecting TCP socket, see slirp_select_poll() */
+static void sopoll_tcp(struct socket *so)
+{
+	int ret;
+
+	if (so->so_state & SS_ISFCONNECTING) {
+		/* Connected */
+		so->so_state &= ~SS_ISFCONNECTING;
+		ret = send(so->s, NULL, 0, 0);
+		if (ret < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK ||
+			    errno == EINPROGRESS || errno == ENOTCONN) {
+				so->so_pollev &= ~SO_POLLOUT;
+				return;
+			}
+			/* else failed */
+			so->so_state = SS_NOFDREF;
+		}
+		/* Continue tcp_input */
+		tcp_input((struct mbuf *)NULL, sizeof(struct ip), so);
+		return;
+	}
+
+	if (CONN_CANFRCV(so) && (so->so_snd.sb_cc < (so->so_snd.sb_datalen/2))) {
+		/* Check for URG data, this will soread as well */
+		if (so->so_pollev & SO_POLLPRI) {
+			so->so_pollev &= ~SO_POLLPRI;
+			sorecvoob(so);
+			return;
+		}
+		if (so->so_pollev & SO_POLLIN) {
+			ret = soread(so);
+			if (ret < 0)
+				return;			/* Disconnected, so may be gone */
+			if (ret == 0)
+				so->so_pollev &= ~SO_POLLIN;	/* Would block */
+			else
+				tcp_output(sototcpcb(so));
+		}
+	}
+
+	if ((so->so_pollev & SO_POLLOUT) && CONN_CANFSEND(so) && so->so_rcv.sb_cc) {
+		ret = sowrite(so);
+		if (ret == 0 && so->so_rcv.sb_cc)
+			so->so_pollev &= ~SO_POLLOUT;	/* Would block */
+	}
+}
+
+void slirp_epoll_poll(void)
+{
+	struct epoll_event events[64];
+	struct socket work, *so;
+	int i, n, dns_ready = 0;
+
+	/* Update time */
+	updtime();
+	
+	/*
+	 * See if anything has timed out 
+	 */
+	slirp_timers();
+	if (link_up && (curtime - last_udp_expire_scan) >= UDP_EXPIRE_SCAN)
+		udp_expire();
+
+	/*
+	 * Latch the readiness reported since the last call. Sockets
+	 * unregister before they are freed, so the events only refer
+	 * to live sockets
+	 */
+	n = epoll_wait(so_epollfd, events, 64, 0);
+	for (i = 0; i < n; i++) {
+		so = (struct socket *)events[i].data.ptr;
+		if (so == NULL) {		/* dns_wakeup_fd */
+			dns_ready = 1;
+			continue;
+		}
+		if (events[i].events & (EPOLLIN|EPOLLERR|EPOLLHUP))
+			so->so_pollev |= SO_POLLIN;
+		if ((so->so_pollev & SO_POLLET) && (events[i].events & (EPOLLOUT|EPOLLERR|EPOLLHUP)))
+			so->so_pollev |= SO_POLLOUT;
+		if (events[i].events & EPOLLPRI)
+			so->so_pollev |= SO_POLLPRI;
+		sopoll_queue(so);
+	}
+
+	/*
+	 * Check sockets. Take the whole queue first: edge-triggered
+	 * sockets go back to so_pollq before they are serviced, as they
+	 * may be freed meanwhile, and are looked at again next time.
+	 * Freeing a socket takes it off whichever list it is on
+	 */
+	if (link_up && so_pollq.so_pnext != &so_pollq) {
+		work.so_pnext = so_pollq.so_pnext;
+		work.so_pprev = so_pollq.so_pprev;
+		work.so_pnext->so_pprev = &work;
+		work.so_pprev->so_pnext = &work;
+		so_pollq.so_pnext = so_pollq.so_pprev = &so_pollq;
+
+		while ((so = work.so_pnext) != &work) {
+			sopoll_dequeue(so);
+			if (!sopoll_wanted(so)) {
+				if ((so->so_pollev & SO_POLLET) == 0)
+					so->so_pollev = 0;	/* Reported again if still ready */
+				continue;
+			}
+			if (so->so_pollev & SO_POLLET) {
+				sopoll_queue(so);
+				sopoll_tcp(so);
+			} else {
+				so->so_pollev = 0;
+				if (so->so_state & SS_FACCEPTCONN)
+					tcp_connect(so);
+				else
+					sorecvfrom(so);
+			}
+		}
+	}
+
+	/*
+	 * Answer the DNS queries whose host lookups are done
+	 */
+	if (dns_ready)
+		dns_poll();
+	
+	/*
+	 * See if we can start outputting
+	 */
+	if (if_queued && link_up)
+	   if_start();
+}
+#endif
+
 #define ETH_ALEN 6
 #define ETH_HLEN 14
 
@@ -198,6 +198,11 @@ int inet_aton _P((const char *cp, struct in_addr *ia));
 # include <sys/select.h>
 #endif
 
+#if defined(HAVE_SYS_EPOLL_H) && !defined(_WIN32)
+# include <sys/epoll.h>
+# define SLIRP_USE_EPOLL 1
+#endif
+
 #ifdef HAVE_SYS_WAIT_H
 # include <sys/wait.h>
 #endif
@@ -324,6 +329,7 @@ extern int do_echo;
 
 /* cksum.c */
 int cksum(struct mbuf *m, int len);
+u_int16_t cksum_adjust(u_int16_t sum, u_int16_t old_word, u_int16_t new_word);
 
 /* if.c */
 void if_init _P((void));
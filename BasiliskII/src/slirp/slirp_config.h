@@ -18,6 +18,10 @@
 #define MAX_INTERFACES 1
 #define MAX_PPP_INTERFACES 1
 
+/* Define to the number of mbufs kept for reuse, more are malloc()ed and freed as needed */
+/* Bulk TCP transfers keep a window's worth of segments in flight each way */
+#define MBUF_THRESH 256
+
 /* Define if you want slirp's socket in /tmp */
 /* XXXXXX Do this in ./configure */
 #undef USE_TMPSOCKET
@@ -64,6 +68,9 @@
 
 /* Define if you have readv */
 #undef HAVE_READV
+#ifndef _WIN32
+#define HAVE_READV
+#endif
 
 /* Define if iovec needs to be declared */
 #undef DECLARE_IOVEC
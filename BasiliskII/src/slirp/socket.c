@@ -114,12 +114,77 @@ void unload_host_domains() {
 	}
 }
 
+#ifdef SLIRP_USE_EPOLL
+int so_epollfd = -1;		/* epoll instance all sockets are registered with */
+struct socket so_pollq;		/* Sockets with latched readiness to service */
+#endif
+
 void
 so_init()
 {
-	/* Nothing yet */
+#ifdef SLIRP_USE_EPOLL
+	so_pollq.so_pnext = so_pollq.so_pprev = &so_pollq;
+	if (so_epollfd < 0) {
+		so_epollfd = epoll_create(64);
+		if (so_epollfd >= 0)
+			fcntl(so_epollfd, F_SETFD, FD_CLOEXEC);
+	}
+#endif
 }
 
+/*
+ * Socket lookup hash chains
+ * TCP sockets are hashed by both their ends, UDP sockets by
+ * their local end only: that's what udp_input() looks them up
+ * by, the foreign end of a UDP socket follows every datagram.
+ * Sockets must be sohash()ed again whenever their key changes.
+ */
+#define SO_HASH_SIZE 256	/* Must be a power of 2 */
+
+static struct socket *tcb_hash[SO_HASH_SIZE];
+static struct socket *udb_hash[SO_HASH_SIZE];
+
+static inline struct socket **
+sohash_chain(struct socket *head, struct in_addr laddr, u_int lport,
+	     struct in_addr faddr, u_int fport)
+{
+	u_int32_t h = ntohl(laddr.s_addr) * 0x9e3779b1 + lport;
+	
+	if (head == &udb)
+		return &udb_hash[(h ^ (h >> 16)) & (SO_HASH_SIZE - 1)];
+	h = (h ^ ntohl(faddr.s_addr)) * 0x9e3779b1 + fport;
+	return &tcb_hash[(h ^ (h >> 16)) & (SO_HASH_SIZE - 1)];
+}
+
+void
+sohash(head, so)
+	struct socket *head;
+	struct socket *so;
+{
+	struct socket **chain;
+	
+	sounhash(so);
+	chain = sohash_chain(head, so->so_laddr, so->so_lport,
+			     so->so_faddr, so->so_fport);
+	so->so_hnext = *chain;
+	if (so->so_hnext)
+	   so->so_hnext->so_hprev = &so->so_hnext;
+	so->so_hprev = chain;
+	*chain = so;
+}
+
+void
+sounhash(so)
+	struct socket *so;
+{
+	if (so->so_hprev == NULL)
+	   return;
+	*so->so_hprev = so->so_hnext;
+	if (so->so_hnext)
+	   so->so_hnext->so_hprev = so->so_hprev;
+	so->so_hnext = NULL;
+	so->so_hprev = NULL;
+}
 
 struct socket *
 solookup(head, laddr, lport, faddr, fport)
@@ -131,7 +196,7 @@ solookup(head, laddr, lport, faddr, fport)
 {
 	struct socket *so;
 	
-	for (so = head->so_next; so != head; so = so->so_next) {
+	for (so = *sohash_chain(head, laddr, lport, faddr, fport); so; so = so->so_hnext) {
 		if (so->so_lport == lport && 
 		    so->so_laddr.s_addr == laddr.s_addr &&
 		    so->so_faddr.s_addr == faddr.s_addr &&
@@ -139,12 +204,118 @@ solookup(head, laddr, lport, faddr, fport)
 		   break;
 	}
 	
-	if (so == head)
-	   return (struct socket *)NULL;
 	return so;
+}
+
+/*
+ * Find a UDP socket by its local address and port
+ */
+struct socket *
+solookup_local(head, laddr, lport)
+	struct socket *head;
+	struct in_addr laddr;
+	u_int lport;
+{
+	struct socket *so;
+	
+	for (so = *sohash_chain(head, laddr, lport, laddr, lport); so; so = so->so_hnext) {
+		if (so->so_lport == lport &&
+		    so->so_laddr.s_addr == laddr.s_addr)
+		   break;
+	}
+	
+	return so;
+}
+
+#ifdef SLIRP_USE_EPOLL
+/*
+ * Register so->s with the epoll backend, once per descriptor
+ * Connected TCP sockets are non-blocking: they are registered
+ * edge-triggered, and their readiness stays latched in so_pollev
+ * until a read or write would block. Listening TCP sockets and
+ * UDP sockets are blocking, so they are registered level-triggered
+ * and serviced once per reported event, as select() would.
+ */
+void
+sopoll_add(so)
+	struct socket *so;
+{
+	struct epoll_event ev;
+	int saved_errno = errno;
+	
+	sopoll_del(so);
+	if (so_epollfd < 0 || so->s < 0)
+	   return;
 	
+	memset(&ev, 0, sizeof(ev));
+	if (so->so_tcpcb && (so->so_state & SS_FACCEPTCONN) == 0) {
+		ev.events = EPOLLIN | EPOLLPRI | EPOLLOUT | EPOLLET;
+		so->so_pollev = SO_POLLET;
+	} else
+		ev.events = EPOLLIN;
+	ev.data.ptr = so;
+	if (epoll_ctl(so_epollfd, EPOLL_CTL_ADD, so->s, &ev) == 0)
+	   so->so_pollfd = so->s;
+	errno = saved_errno;
 }
 
+/*
+ * Unregister so from the epoll backend, before its descriptor is closed
+ */
+void
+sopoll_del(so)
+	struct socket *so;
+{
+	struct epoll_event ev;
+	int saved_errno;
+	
+	sopoll_dequeue(so);
+	so->so_pollev = 0;
+	if (so->so_pollfd < 0)
+	   return;
+	
+	saved_errno = errno;
+	memset(&ev, 0, sizeof(ev));
+	epoll_ctl(so_epollfd, EPOLL_CTL_DEL, so->so_pollfd, &ev);
+	so->so_pollfd = -1;
+	errno = saved_errno;
+}
+
+void
+sopoll_queue(so)
+	struct socket *so;
+{
+	if (so->so_pnext)
+	   return;
+	so->so_pnext = &so_pollq;
+	so->so_pprev = so_pollq.so_pprev;
+	so_pollq.so_pprev->so_pnext = so;
+	so_pollq.so_pprev = so;
+}
+
+void
+sopoll_dequeue(so)
+	struct socket *so;
+{
+	if (so->so_pnext == NULL)
+	   return;
+	so->so_pnext->so_pprev = so->so_pprev;
+	so->so_pprev->so_pnext = so->so_pnext;
+	so->so_pnext = so->so_pprev = NULL;
+}
+
+/*
+ * so may be able to use its latched readiness now
+ */
+static void
+sopoll_wakeup(so)
+	struct socket *so;
+{
+	if (so->so_pollev & (SO_POLLIN|SO_POLLOUT|SO_POLLPRI))
+	   sopoll_queue(so);
+}
+#endif
+
 /*
  * Create a new socket, initialise the fields
  * It is the responsibility of the caller to
@@ -160,6 +331,9 @@ socreate()
     memset(so, 0, sizeof(struct socket));
     so->so_state = SS_NOFDREF;
     so->s = -1;
+#ifdef SLIRP_USE_EPOLL
+    so->so_pollfd = -1;
+#endif
   }
   return(so);
 }
@@ -179,6 +353,9 @@ sofree(so)
     tcp_last_so = &tcb;
   else if (so == udp_last_so)
     udp_last_so = &udb;
+  sounhash(so);
+  sopoll_del(so);
+  dns_cancel(so);
 	
   m_free(so->so_m);
 	
@@ -573,6 +750,14 @@ sorecvfrom(so)
 	     *		}
 	     */
 	    
+	    /*
+	     * Remember the answers the DNS server gave us for the guest,
+	     * see resolve_dns_request()
+	     */
+	    if (so->so_fport == htons(53) &&
+		so->so_faddr.s_addr == (special_addr.s_addr | htonl(CTL_DNS)))
+	      dns_cache_reply(m->m_data, m->m_len);
+
 	    /* 
 	     * If this packet was destined for CTL_ADDR,
 	     * make it look like that's where it came from, done by udp_output
@@ -706,6 +891,496 @@ static char * decode_dns_name(const char * data) {
 	return decoded_name_str;
 }
 
+/*
+ * DNS answer cache and host resolver
+ *
+ * Answers to single A/IN questions sent to CTL_DNS are kept for the
+ * TTL the answering server gave them (see dns_cache_reply()), so the
+ * guest asking again is answered without leaving the host. Names
+ * looked up on the host (see host_resolved_domain_suffixes) go to a
+ * pool of resolver threads, the guest is answered from dns_poll() once
+ * the lookup is done. The host resolver doesn't tell how long its
+ * answers are good for, so they are kept for HOST_DOMAIN_TTL seconds.
+ */
+#if defined(HAVE_PTHREADS) && !defined(_WIN32)
+#define DNS_ASYNC 1
+#include <pthread.h>
+#endif
+
+#define DNS_HASH_SIZE 64	/* Must be a power of 2 */
+#define DNS_CACHE_MAX 512	/* Entries kept at most */
+#define DNS_MAX_ADDRS 8		/* Addresses kept per name */
+#define DNS_NEGATIVE_TTL 10	/* Seconds a failed lookup is remembered */
+#define DNS_MAX_TTL 3600	/* Seconds an answer is kept at most */
+#define DNS_WORKERS 4		/* Resolver threads */
+
+struct dns_waiter {
+	struct dns_waiter *next;
+	struct socket *so;		/* Socket the query came in on */
+	struct sockaddr_in addr;	/* Where the answer comes from */
+	int len;
+	char packet[1];			/* The query, len bytes */
+};
+
+struct dns_entry {
+	struct dns_entry *next;		/* Hash chain */
+	struct dns_entry *qnext;	/* Resolver job or done queue */
+	u_int expire;			/* curtime the answer goes stale */
+	int pending;			/* Host lookup not done yet */
+	int rcode;			/* Response code to answer with */
+	int naddrs;
+	struct in_addr addrs[DNS_MAX_ADDRS];
+	struct dns_waiter *waiters;	/* Queries waiting for the lookup */
+	char name[1];			/* Lowercase, with the trailing dot */
+};
+
+static struct dns_entry *dns_hash[DNS_HASH_SIZE];
+static int dns_entries;
+static int dns_waiting;			/* Queries in all waiters lists */
+
+int dns_wakeup_fd = -1;			/* Readable when host lookups are done */
+
+static inline struct dns_entry **
+dns_bucket(const char *name)
+{
+	u_int h = 0;
+
+	while (*name)
+		h = h * 31 + (u_char)*name++;
+	return &dns_hash[h & (DNS_HASH_SIZE - 1)];
+}
+
+static void
+dns_free_entry(struct dns_entry *e)
+{
+	struct dns_entry **ep;
+
+	for (ep = dns_bucket(e->name); *ep != NULL; ep = &(*ep)->next) {
+		if (*ep == e) {
+			*ep = e->next;
+			break;
+		}
+	}
+	dns_entries--;
+	free(e);
+}
+
+/* Find the entry for name, dropping it if stale */
+static struct dns_entry *
+dns_cache_find(const char *name)
+{
+	struct dns_entry *e;
+
+	for (e = *dns_bucket(name); e != NULL; e = e->next) {
+		if (strcmp(e->name, name) == 0)
+			break;
+	}
+	if (e && !e->pending && (int)(e->expire - curtime) <= 0) {
+		dns_free_entry(e);
+		e = NULL;
+	}
+	return e;
+}
+
+/* Make room for one more entry: drop the stale ones, else the oldest */
+static void
+dns_cache_trim(void)
+{
+	struct dns_entry *e, *next, *oldest = NULL;
+	int i;
+
+	for (i = 0; i < DNS_HASH_SIZE; i++) {
+		for (e = dns_hash[i]; e != NULL; e = next) {
+			next = e->next;
+			if (e->pending)
+				continue;
+			if ((int)(e->expire - curtime) <= 0)
+				dns_free_entry(e);
+			else if (oldest == NULL || (int)(e->expire - oldest->expire) < 0)
+				oldest = e;
+		}
+	}
+	if (dns_entries >= DNS_CACHE_MAX && oldest)
+		dns_free_entry(oldest);
+}
+
+static struct dns_entry *
+dns_cache_add(const char *name)
+{
+	struct dns_entry **ep, *e;
+	int name_len = strlen(name);
+
+	if (dns_entries >= DNS_CACHE_MAX)
+		dns_cache_trim();
+	e = (struct dns_entry *)malloc(sizeof(struct dns_entry) + name_len);
+	if (e == NULL)
+		return NULL;
+	memset(e, 0, sizeof(struct dns_entry));
+	memcpy(e->name, name, name_len + 1);
+	ep = dns_bucket(name);
+	e->next = *ep;
+	*ep = e;
+	dns_entries++;
+	return e;
+}
+
+/* Set the answer of e, good for ttl seconds */
+static void
+dns_cache_set(struct dns_entry *e, int rcode, const struct in_addr *addrs, int naddrs, u_int ttl)
+{
+	if (naddrs > DNS_MAX_ADDRS)
+		naddrs = DNS_MAX_ADDRS;
+	if (ttl > DNS_MAX_TTL)
+		ttl = DNS_MAX_TTL;
+	if (addrs != e->addrs)
+		memcpy(e->addrs, addrs, naddrs * sizeof(struct in_addr));
+	e->naddrs = naddrs;
+	e->rcode = rcode;
+	e->expire = curtime + ttl * 1000;
+}
+
+/*
+ * Answer the query in packet from e, with the TTL it has left.
+ * The question must have been checked by resolve_dns_request()
+ */
+static void
+dns_send_answer(struct socket *so, struct sockaddr_in addr, const char *packet, int packet_len, struct dns_entry *e)
+{
+	const char *query_str = packet + sizeof(struct DNS_HEADER);
+	int query_str_size = strlen(query_str) + 1;
+	int response_size = packet_len + e->naddrs * (query_str_size + sizeof(struct R_DATA) + sizeof(struct in_addr));
+	int ttl = (int)(e->expire - curtime) / 1000;
+	int i;
+
+	caddr_t response_packet = malloc(response_size);
+	if (response_packet == NULL) {
+		D("DNS host query for %s: Out of memory while allocating DNS response packet\n", e->name);
+		return;
+	}
+
+	// the request is our starting point for the response
+	memcpy(response_packet, packet, packet_len);
+
+	// flags, byte by byte as the header bitfields are only right on little-endian hosts
+	struct DNS_HEADER *h = (struct DNS_HEADER *)response_packet;
+	response_packet[2] |= 0x80;		/* QR: response */
+	response_packet[3] = (response_packet[3] & 0x10) | 0x80 | e->rcode;	/* CD kept, RA, RCODE */
+	h->ans_count = htons(e->naddrs);
+
+	int response_pos = packet_len;
+
+	for (i = 0; i < e->naddrs; i++) {
+		// answer string is verbatim from question
+		memcpy(response_packet + response_pos, query_str, query_str_size);
+		response_pos += query_str_size;
+
+		struct R_DATA resource;
+		resource.type = htons(1);
+		resource._class = htons(1);
+		resource.ttl = htonl(ttl > 0 ? ttl : 0);
+		resource.data_len = htons(sizeof(struct in_addr));
+
+		memcpy(response_packet + response_pos, &resource, sizeof(struct R_DATA));
+		response_pos += sizeof(struct R_DATA);
+
+		memcpy(response_packet + response_pos, &e->addrs[i], sizeof(struct in_addr));
+		response_pos += sizeof(struct in_addr);
+	}
+
+	assert(response_pos == response_size);
+
+	D("DNS query for %s: Injecting DNS response directly to guest\n", e->name);
+	inject_udp_packet_to_guest(so, addr, response_packet, response_size);
+
+	free(response_packet);
+}
+
+/* Look name up on the host, filling in the answer of e but its expiry */
+static void
+dns_host_lookup(struct dns_entry *e)
+{
+	struct addrinfo hints, *res, *ai;
+	char name[256];
+	int name_len;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;	/* One result per address */
+
+	e->naddrs = 0;
+	e->rcode = 0;
+
+	// without the trailing dot, host files don't match a fully qualified name
+	name_len = strlen(e->name);
+	if (name_len < 2 || name_len > sizeof(name))
+		return;
+	memcpy(name, e->name, name_len - 1);
+	name[name_len - 1] = '\0';
+
+	if (getaddrinfo(name, NULL, &hints, &res) != 0)
+		return;
+	for (ai = res; ai != NULL && e->naddrs < DNS_MAX_ADDRS; ai = ai->ai_next) {
+		if (ai->ai_family == AF_INET)
+			e->addrs[e->naddrs++] = ((struct sockaddr_in *)ai->ai_addr)->sin_addr;
+	}
+	freeaddrinfo(res);
+}
+
+/* The host lookup for e is done, answer whoever asked */
+static void
+dns_lookup_done(struct dns_entry *e)
+{
+	struct dns_waiter *w;
+
+	D("DNS host query for %s: result count %d\n", e->name, e->naddrs);
+
+	e->pending = 0;
+	dns_cache_set(e, e->rcode, e->addrs, e->naddrs, e->naddrs ? HOST_DOMAIN_TTL : DNS_NEGATIVE_TTL);
+	while ((w = e->waiters) != NULL) {
+		e->waiters = w->next;
+		dns_waiting--;
+		dns_send_answer(w->so, w->addr, w->packet, w->len, e);
+		free(w);
+	}
+}
+
+#ifdef DNS_ASYNC
+static pthread_mutex_t dns_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dns_job_cond = PTHREAD_COND_INITIALIZER;
+static struct dns_entry *dns_jobs, **dns_jobs_tail = &dns_jobs;
+static struct dns_entry *dns_done;
+static int dns_pipe_w = -1;
+static int dns_workers;
+
+static void *
+dns_worker(void *arg)
+{
+	struct dns_entry *e;
+
+	for (;;) {
+		pthread_mutex_lock(&dns_lock);
+		while ((e = dns_jobs) == NULL)
+			pthread_cond_wait(&dns_job_cond, &dns_lock);
+		if ((dns_jobs = e->qnext) == NULL)
+			dns_jobs_tail = &dns_jobs;
+		pthread_mutex_unlock(&dns_lock);
+
+		/* e is left alone by the slirp thread while it's pending */
+		dns_host_lookup(e);
+
+		pthread_mutex_lock(&dns_lock);
+		e->qnext = dns_done;
+		dns_done = e;
+		pthread_mutex_unlock(&dns_lock);
+		write(dns_pipe_w, "", 1);
+	}
+	return NULL;
+}
+
+/* Start the resolver threads, returns 0 if there are none */
+static int
+dns_start_workers(void)
+{
+	pthread_attr_t attr;
+	pthread_t thread;
+	int fds[2];
+
+	if (dns_workers)
+		return 1;
+	if (pipe(fds) < 0)
+		return 0;
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	while (dns_workers < DNS_WORKERS && pthread_create(&thread, &attr, dns_worker, NULL) == 0)
+		dns_workers++;
+	pthread_attr_destroy(&attr);
+	if (dns_workers == 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return 0;
+	}
+
+	dns_pipe_w = fds[1];
+	dns_wakeup_fd = fds[0];
+#ifdef SLIRP_USE_EPOLL
+	if (so_epollfd >= 0) {
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.ptr = NULL;	/* Not a socket, see slirp_epoll_poll() */
+		epoll_ctl(so_epollfd, EPOLL_CTL_ADD, dns_wakeup_fd, &ev);
+	}
+#endif
+	return 1;
+}
+#endif
+
+/* Start looking up e on the host */
+static void
+dns_lookup_start(struct dns_entry *e)
+{
+	e->pending = 1;
+#ifdef DNS_ASYNC
+	if (dns_start_workers()) {
+		pthread_mutex_lock(&dns_lock);
+		e->qnext = NULL;
+		*dns_jobs_tail = e;
+		dns_jobs_tail = &e->qnext;
+		pthread_cond_signal(&dns_job_cond);
+		pthread_mutex_unlock(&dns_lock);
+		return;
+	}
+#endif
+	dns_host_lookup(e);
+	dns_lookup_done(e);
+}
+
+/*
+ * Answer the queries whose host lookups are done, called when
+ * dns_wakeup_fd is readable
+ */
+void
+dns_poll()
+{
+#ifdef DNS_ASYNC
+	struct dns_entry *e;
+	char buf[64];
+
+	while (read(dns_wakeup_fd, buf, sizeof(buf)) > 0)
+		;
+	pthread_mutex_lock(&dns_lock);
+	e = dns_done;
+	dns_done = NULL;
+	pthread_mutex_unlock(&dns_lock);
+
+	while (e != NULL) {
+		struct dns_entry *next = e->qnext;
+		dns_lookup_done(e);
+		e = next;
+	}
+#endif
+}
+
+/* so is going away, forget about the queries it is waiting on */
+void
+dns_cancel(so)
+	struct socket *so;
+{
+	struct dns_entry *e;
+	struct dns_waiter **wp, *w;
+	int i;
+
+	if (dns_waiting == 0)
+		return;
+	for (i = 0; i < DNS_HASH_SIZE; i++) {
+		for (e = dns_hash[i]; e != NULL; e = e->next) {
+			for (wp = &e->waiters; (w = *wp) != NULL; ) {
+				if (w->so == so) {
+					*wp = w->next;
+					dns_waiting--;
+					free(w);
+				} else
+					wp = &w->next;
+			}
+		}
+	}
+}
+
+/* Skip a possibly compressed name, returns its length or -1 */
+static int
+dns_skip_name(const u_char *p, int len)
+{
+	int pos = 0;
+
+	while (pos < len) {
+		if (p[pos] == 0)
+			return pos + 1;
+		if ((p[pos] & 0xc0) == 0xc0)
+			return pos + 2 <= len ? pos + 2 : -1;
+		pos += p[pos] + 1;
+	}
+	return -1;
+}
+
+/*
+ * Cache the answer in a reply from the real DNS server, if it is
+ * for a single A/IN question. Answers are kept for the lowest TTL of
+ * the records, name errors for DNS_NEGATIVE_TTL seconds
+ */
+void
+dns_cache_reply(data, len)
+	caddr_t data;
+	int len;
+{
+	const u_char *p = (const u_char *)data;
+	struct in_addr addrs[DNS_MAX_ADDRS];
+	struct dns_entry *e;
+	u_int ttl = DNS_MAX_TTL;
+	int pos, n, i, naddrs = 0, rcode;
+	char *name;
+
+	if (len < sizeof(struct DNS_HEADER))
+		return;
+	if ((p[2] & 0xfa) != 0x80)		/* QR, standard query, not truncated */
+		return;
+	rcode = p[3] & 0x0f;
+	if (rcode != 0 && rcode != 3)		/* NOERROR, NXDOMAIN */
+		return;
+	if (((p[4] << 8) | p[5]) != 1)
+		return;
+
+	pos = sizeof(struct DNS_HEADER);
+	if ((n = dns_skip_name(p + pos, len - pos)) < 0 || (p[pos + n - 1] != 0))
+		return;				/* Compressed question, never mind */
+	if (pos + n + 4 > len)
+		return;
+	if (((p[pos + n] << 8) | p[pos + n + 1]) != 1 || ((p[pos + n + 2] << 8) | p[pos + n + 3]) != 1)
+		return;
+	if ((name = decode_dns_name(data + pos)) == NULL)
+		return;
+	pos += n + 4;
+
+	for (i = (p[6] << 8) | p[7]; i > 0; i--) {
+		u_int rttl;
+		int rdlen;
+
+		if ((n = dns_skip_name(p + pos, len - pos)) < 0 || pos + n + 10 > len)
+			goto out;
+		pos += n;
+		rttl = (p[pos + 4] << 24) | (p[pos + 5] << 16) | (p[pos + 6] << 8) | p[pos + 7];
+		rdlen = (p[pos + 8] << 8) | p[pos + 9];
+		if (pos + 10 + rdlen > len)
+			goto out;
+		if (rttl < ttl)
+			ttl = rttl;
+		if (p[pos] == 0 && p[pos + 1] == 1 && p[pos + 2] == 0 && p[pos + 3] == 1 &&
+		    rdlen == 4 && naddrs < DNS_MAX_ADDRS)
+			memcpy(&addrs[naddrs++], p + pos + 10, 4);
+		pos += 10 + rdlen;
+	}
+
+	if (rcode == 0 && naddrs == 0)
+		goto out;			/* Nothing worth keeping */
+	if (rcode == 3)
+		ttl = DNS_NEGATIVE_TTL;
+	if (ttl == 0)
+		goto out;
+
+	for (i = 0; name[i]; i++)
+		name[i] = tolower((u_char)name[i]);
+	if ((e = dns_cache_find(name)) == NULL)
+		e = dns_cache_add(name);
+	if (e && !e->pending) {
+		D("DNS query for %s: caching %d addresses for %u seconds\n", name, naddrs, ttl);
+		dns_cache_set(e, rcode, addrs, naddrs, ttl);
+	}
+out:
+	free(name);
+}
+
 /** Take a look at a UDP DNS request the client has made and see if we want to resolve it internally.
  * Returns true if the request has been internally and can be dropped,
  *         false otherwise
@@ -773,11 +1448,15 @@ static bool resolve_dns_request(struct socket * so, struct sockaddr_in addr, cad
 		return false;
 	}
 
+	// names are case-insensitive, suffixes and the cache keep them in lowercase
+	for (char * p = decoded_name_str; *p != '\0'; p++)
+		*p = tolower((u_char)*p);
+
 	D("DNS host query for %s: Request is eligible to check for host resolution suffix\n", decoded_name_str);
 
 	const char * matched_suffix = NULL;
 
-	for (const char ** suffix_ptr = host_resolved_domain_suffixes; *suffix_ptr != NULL; suffix_ptr++) {
+	for (const char ** suffix_ptr = host_resolved_domain_suffixes; suffix_ptr != NULL && *suffix_ptr != NULL; suffix_ptr++) {
 		const char * suffix = *suffix_ptr;
 
 		// ends with suffix?
@@ -794,80 +1473,43 @@ static bool resolve_dns_request(struct socket * so, struct sockaddr_in addr, cad
 		}
 	}
 
-	if (matched_suffix == NULL) {
+	struct dns_entry * entry = dns_cache_find(decoded_name_str);
+
+	if (entry != NULL && !entry->pending) {
+		D("DNS host query for %s: Answering from cache\n", decoded_name_str);
+		drop_dns_request = true;
+		dns_send_answer(so, addr, packet, packet_len, entry);
+	} else if (matched_suffix == NULL) {
 		D("DNS host query for %s: No suffix matched\n", decoded_name_str);
 	} else {
 
 		D("DNS host query for %s: Matched for suffix: %s\n", decoded_name_str, matched_suffix);
 
-		// we are going to take this request and resolve it on the host
-		drop_dns_request = true;
-
-		D("DNS host query for %s: Doing lookup on host\n", decoded_name_str);
-
-		int results_count = 0;
-		struct hostent * host_lookup_result = gethostbyname(decoded_name_str);
-
-		if (host_lookup_result && host_lookup_result->h_addrtype == AF_INET) {
-
-			D("DNS host query for %s: Host response has results for AF_INET\n", decoded_name_str);
-
-			for (char ** addr_entry = host_lookup_result->h_addr_list; *addr_entry != NULL; addr_entry++) {
-				++results_count;
-			}
-		}
-
-		D("DNS host query for %s: result count %d\n", decoded_name_str, results_count);
-
-		int original_query_str_size = strlen(original_query_str) + 1;
-		int response_size = packet_len + results_count * (original_query_str_size + sizeof(struct R_DATA) + sizeof(struct in_addr));
-
-		caddr_t response_packet = malloc(response_size);
-		if (response_packet == NULL) {
-			D("DNS host query for %s: Out of memory while allocating DNS response packet\n", decoded_name_str);
+		if (entry == NULL && (entry = dns_cache_add(decoded_name_str)) == NULL) {
+			D("DNS host query for %s: Out of memory while adding cache entry\n", decoded_name_str);
 		} else {
-			D("DNS host query for %s: Preparing DNS response\n", decoded_name_str);
-			
-			// use the request DNS header as our starting point for the response
-			h.qr = 1;
-			h.ans_count = htons(results_count);
-			memcpy(response_packet, &h, sizeof(struct DNS_HEADER));
-
-			// other sections verbatim out of the request
-			memcpy(response_packet + sizeof(struct DNS_HEADER), packet + sizeof(struct DNS_HEADER), packet_len - sizeof(struct DNS_HEADER));
-
-			int response_pos = packet_len;
-
-			if (results_count > 0) {
-				for (char ** addr_entry = host_lookup_result->h_addr_list; *addr_entry != NULL; addr_entry++) {
-					// answer string is verbatim from question
-					memcpy(response_packet + response_pos, original_query_str, original_query_str_size);
-
-					response_pos += original_query_str_size;
-
-					struct R_DATA resource;
-					resource.type = htons(1);
-					resource._class = htons(1);
-					resource.ttl = htonl(HOST_DOMAIN_TTL);
-					resource.data_len = htons(sizeof(struct in_addr));
-
-					memcpy(response_packet + response_pos, &resource, sizeof(struct R_DATA));
-					response_pos += sizeof(struct R_DATA);
-
-					struct in_addr * cur_addr = (struct in_addr *)*addr_entry;
-					memcpy(response_packet + response_pos, cur_addr, sizeof(struct in_addr));
-					response_pos += sizeof(struct in_addr);
+			struct dns_waiter * waiter = malloc(sizeof(struct dns_waiter) + packet_len);
+			if (waiter == NULL) {
+				D("DNS host query for %s: Out of memory while queueing request\n", decoded_name_str);
+			} else {
+				// we are going to take this request and resolve it on the host
+				drop_dns_request = true;
+
+				waiter->so = so;
+				waiter->addr = addr;
+				waiter->len = packet_len;
+				memcpy(waiter->packet, packet, packet_len);
+				waiter->next = entry->waiters;
+				entry->waiters = waiter;
+				dns_waiting++;
+
+				// one lookup answers every query for the name made meanwhile
+				if (!entry->pending) {
+					D("DNS host query for %s: Doing lookup on host\n", decoded_name_str);
+					dns_lookup_start(entry);
 				}
 			}
-
-			assert(response_pos == response_size);
-
-			D("DNS host query for %s: Injecting DNS response directly to guest\n", decoded_name_str);
-			inject_udp_packet_to_guest(so, addr, response_packet, response_size);
-
-			free(response_packet);
 		}
-
 	}
 
 	free(decoded_name_str);
@@ -897,10 +1539,9 @@ sosendto(so, m)
 	  switch(ntohl(so->so_faddr.s_addr) & 0xff) {
 	  case CTL_DNS:
 	    addr.sin_addr = dns_addr;
-		if (host_resolved_domain_suffixes != NULL) {
-			if (resolve_dns_request(so, addr, m->m_data, m->m_len))
-			return 0;
-		}
+	    addr.sin_port = so->so_fport;
+	    if (resolve_dns_request(so, addr, m->m_data, m->m_len))
+		return 0;
 	    break;
 	  case CTL_ALIAS:
 	  default:
@@ -1002,8 +1643,10 @@ solisten(port, laddr, lport, flags)
 	   so->so_faddr = alias_addr;
 	else
 	   so->so_faddr = addr.sin_addr;
+	sohash(&tcb, so);
 
 	so->s = s;
+	sopoll_add(so);
 	return so;
 }
 
@@ -1018,6 +1661,9 @@ sorwakeup(so)
 {
 /*	sowrite(so); */
 /*	FD_CLR(so->s,&writefds); */
+#ifdef SLIRP_USE_EPOLL
+	sopoll_wakeup(so);
+#endif
 }
 	
 /*
@@ -1029,7 +1675,9 @@ void
 sowwakeup(so)
 	struct socket *so;
 {
-	/* Nothing, yet */
+#ifdef SLIRP_USE_EPOLL
+	sopoll_wakeup(so);
+#endif
 }
 
 /*
@@ -1053,6 +1701,9 @@ soisfconnected(so)
 {
 	so->so_state &= ~(SS_ISFCONNECTING|SS_FWDRAIN|SS_NOFDREF);
 	so->so_state |= SS_ISFCONNECTED; /* Clobber other states */
+#ifdef SLIRP_USE_EPOLL
+	sopoll_wakeup(so);
+#endif
 }
 
 void
@@ -51,8 +51,24 @@ struct socket {
   struct sbuf so_rcv;		/* Receive buffer */
   struct sbuf so_snd;		/* Send buffer */
   void * extra;			/* Extra pointer */
+
+  struct socket *so_hnext;	/* Next socket in the same lookup hash chain */
+  struct socket **so_hprev;	/* Link pointing to this socket, NULL if not hashed */
+
+#ifdef SLIRP_USE_EPOLL
+  int	so_pollfd;		/* Descriptor registered with epoll, or -1 */
+  int	so_pollev;		/* Latched readiness, SO_POLL* below */
+  struct socket *so_pnext, *so_pprev;	/* List of sockets with latched readiness */
+#endif
 };
 
+#ifdef SLIRP_USE_EPOLL
+#define SO_POLLIN		0x01	/* Readable (or closed, or in error) */
+#define SO_POLLOUT		0x02	/* Writable */
+#define SO_POLLPRI		0x04	/* Urgent data */
+#define SO_POLLET		0x10	/* Registered edge-triggered */
+#endif
+
 
 /*
  * Socket state bits. (peer means the host on the Internet,
@@ -83,6 +99,9 @@ struct iovec {
 
 void so_init _P((void));
 struct socket * solookup _P((struct socket *, struct in_addr, u_int, struct in_addr, u_int));
+struct socket * solookup_local _P((struct socket *, struct in_addr, u_int));
+void sohash _P((struct socket *, struct socket *));
+void sounhash _P((struct socket *));
 struct socket * socreate _P((void));
 void sofree _P((struct socket *));
 int soread _P((struct socket *));
@@ -101,4 +120,21 @@ void sofcantsendmore _P((struct socket *));
 void soisfdisconnected _P((struct socket *));
 void sofwdrain _P((struct socket *));
 
+extern int dns_wakeup_fd;
+void dns_poll _P((void));
+void dns_cancel _P((struct socket *));
+void dns_cache_reply _P((caddr_t, int));
+
+#ifdef SLIRP_USE_EPOLL
+extern int so_epollfd;
+extern struct socket so_pollq;
+void sopoll_add _P((struct socket *));
+void sopoll_del _P((struct socket *));
+void sopoll_queue _P((struct socket *));
+void sopoll_dequeue _P((struct socket *));
+#else
+#define sopoll_add(so)
+#define sopoll_del(so)
+#endif
+
 #endif /* _SOCKET_H_ */
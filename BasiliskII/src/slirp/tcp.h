@@ -42,7 +42,7 @@ extern int tcp_rcvspace;
 extern int tcp_sndspace;
 extern struct socket *tcp_last_so;
 
-#define TCP_SNDSPACE 8192
+#define TCP_SNDSPACE 65536	/* Room for a full guest window of downloaded data */
 #define TCP_RCVSPACE 8192
 
 /*
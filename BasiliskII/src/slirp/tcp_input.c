@@ -55,6 +55,15 @@ tcp_seq tcp_iss;                /* tcp initial send seq # */
 #define TSTMP_LT(a,b)	((int)((a)-(b)) < 0)
 #define TSTMP_GEQ(a,b)	((int)((a)-(b)) >= 0)
 
+/*
+ * Delay the ACK, and flag that a tcp_fasttimo() is wanted
+ */
+#define TCP_DELACK(tp) { \
+	(tp)->t_flags |= TF_DELACK; \
+	if (time_fasttimo == 0) \
+		time_fasttimo = curtime; \
+}
+
 /*
  * Insert segment ti into reassembly queue of tcp with
  * control block tp.  Return TH_FIN if reassembly now includes
@@ -73,7 +82,7 @@ tcp_seq tcp_iss;                /* tcp initial send seq # */
                if (ti->ti_flags & TH_PUSH) \
                        tp->t_flags |= TF_ACKNOW; \
                else \
-                       tp->t_flags |= TF_DELACK; \
+                       TCP_DELACK(tp); \
                (tp)->rcv_nxt += (ti)->ti_len; \
                flags = (ti)->ti_flags & TH_FIN; \
                tcpstat.tcps_rcvpack++;\
@@ -93,7 +102,7 @@ tcp_seq tcp_iss;                /* tcp initial send seq # */
 	if ((ti)->ti_seq == (tp)->rcv_nxt && \
         tcpfrag_list_empty(tp) && \
 	    (tp)->t_state == TCPS_ESTABLISHED) { \
-		tp->t_flags |= TF_DELACK; \
+		TCP_DELACK(tp); \
 		(tp)->rcv_nxt += (ti)->ti_len; \
 		flags = (ti)->ti_flags & TH_FIN; \
 		tcpstat.tcps_rcvpack++;\
@@ -409,6 +418,7 @@ findso:
 	  so->so_lport = ti->ti_sport;
 	  so->so_faddr = ti->ti_dst;
 	  so->so_fport = ti->ti_dport;
+	  sohash(&tcb, so);
 		
 	  if ((so->so_iptos = tcp_tos(so)) == 0)
 	    so->so_iptos = ((struct ip *)ti)->ip_tos;
@@ -532,9 +542,7 @@ findso:
 				 * There's room in so_snd, sowwakup will read()
 				 * from the socket if we can
 				 */
-/*				if (so->so_snd.sb_flags & SB_NOTIFY)
- *					sowwakeup(so);
- */
+				sowwakeup(so);
 				/* 
 				 * This is called because sowwakeup might have
 				 * put data into so_snd.  Since we don't so sowwakeup,
@@ -1199,9 +1207,7 @@ trimthenstep6:
 		 * XXX sowwakup is called when data is acked and there's room for
 		 * for more data... it should read() the socket 
 		 */
-/*		if (so->so_snd.sb_flags & SB_NOTIFY)
- *			sowwakeup(so);
- */
+		sowwakeup(so);
 		tp->snd_una = ti->ti_ack;
 		if (SEQ_LT(tp->snd_nxt, tp->snd_una))
 			tp->snd_nxt = tp->snd_una;
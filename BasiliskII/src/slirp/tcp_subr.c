@@ -298,6 +298,7 @@ tcp_close(tp)
 	/* clobber input socket cache if we're closing the cached connection */
 	if (so == tcp_last_so)
 		tcp_last_so = &tcb;
+	sopoll_del(so);
 	closesocket(so->s);
 	sbfree(&so->so_rcv);
 	sbfree(&so->so_snd);
@@ -429,6 +430,7 @@ int tcp_fconnect(so)
 		ntohs(addr.sin_port), inet_ntoa(addr.sin_addr)));
     /* We don't care what port we get */
     ret = connect(s,(struct sockaddr *)&addr,sizeof (addr));
+    sopoll_add(so);
     
     /*
      * If it's not in progress, it failed, so we just return 0,
@@ -505,14 +507,17 @@ tcp_connect(inso)
 	/* Translate connections from localhost to the real hostname */
 	if (so->so_faddr.s_addr == 0 || so->so_faddr.s_addr == loopback_addr.s_addr)
 	   so->so_faddr = alias_addr;
+	sohash(&tcb, so);
 	
 	/* Close the accept() socket, set right state */
 	if (inso->so_state & SS_FACCEPTONCE) {
+		sopoll_del(so);
 		closesocket(so->s); /* If we only accept once, close the accept() socket */
 		so->so_state = SS_NOFDREF; /* Don't select it yet, even though we have an FD */
 					   /* if it's not FACCEPTONCE, it's already NOFDREF */
 	}
 	so->s = s;
+	sopoll_add(so);
 	
 	so->so_iptos = tcp_tos(so);
 	tp = sototcpcb(so);
@@ -841,6 +846,7 @@ tcp_emu(so, m)
 				if (ns->so_faddr.s_addr == 0 || 
 					ns->so_faddr.s_addr == loopback_addr.s_addr)
                   ns->so_faddr = alias_addr;
+				sohash(&tcb, ns);
 
 				ns->so_iptos = tcp_tos(ns);
 				tp = sototcpcb(ns);
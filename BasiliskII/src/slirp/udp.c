@@ -163,20 +163,8 @@ udp_input(m, iphlen)
 	so = udp_last_so;
 	if (so->so_lport != uh->uh_sport ||
 	    so->so_laddr.s_addr != ip->ip_src.s_addr) {
-		struct socket *tmp;
-		
-		for (tmp = udb.so_next; tmp != &udb; tmp = tmp->so_next) {
-			if (tmp->so_lport == uh->uh_sport &&
-			    tmp->so_laddr.s_addr == ip->ip_src.s_addr) {
-				tmp->so_faddr.s_addr = ip->ip_dst.s_addr;
-				tmp->so_fport = uh->uh_dport;
-				so = tmp;
-				break;
-			}
-		}
-		if (tmp == &udb) {
-		  so = NULL;
-		} else {
+		so = solookup_local(&udb, ip->ip_src, uh->uh_sport);
+		if (so) {
 		  udpstat.udpps_pcbcachemiss++;
 		  udp_last_so = so;
 		}
@@ -201,6 +189,7 @@ udp_input(m, iphlen)
 	  /* udp_last_so = so; */
 	  so->so_laddr = ip->ip_src;
 	  so->so_lport = uh->uh_sport;
+	  sohash(&udb, so);
 	  
 	  if ((so->so_iptos = udp_tos(so)) == 0)
 	    so->so_iptos = ip->ip_tos;
@@ -349,6 +338,7 @@ udp_attach(so)
       /* success, insert in queue */
       so->so_expire = curtime + SO_EXPIRE;
       insque(so,&udb);
+      sopoll_add(so);
     }
   }
   return(so->s);
@@ -358,6 +348,7 @@ void
 udp_detach(so)
 	struct socket *so;
 {
+	sopoll_del(so);
 	closesocket(so->s);
 	/* if (so->so_m) m_free(so->so_m);    done by sofree */
 
@@ -666,10 +657,12 @@ udp_listen(port, laddr, lport, flags)
 	
 	so->so_lport = lport;
 	so->so_laddr.s_addr = laddr;
+	sohash(&udb, so);
 	if (flags != SS_FACCEPTONCE)
 	   so->so_expire = 0;
 	
 	so->so_state = SS_ISFCONNECTED;
+	sopoll_add(so);
 	
 	return so;
 }
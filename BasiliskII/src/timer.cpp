@@ -25,6 +25,7 @@
  */
 
 #include <stdio.h>
+#include <vector>
 
 #include "sysdeps.h"
 #include "cpu_emulation.h"
@@ -35,6 +36,8 @@
 #define DEBUG 0
 #include "debug.h"
 
+using std::vector;
+
 
 // Set this to 1 to enable TMQueue management (doesn't work)
 #define TM_QUEUE 0
@@ -49,41 +52,160 @@ enum {	// TMTask struct
 };
 
 
-// Array of additional info for each installed TMTask
+// Additional info for each installed TMTask
 struct TMDesc {
 	uint32 task;		// Mac address of associated TMTask
 	tm_time_t wakeup;	// Time this task is scheduled for execution
-	bool in_use;		// Flag: descriptor in use
+	int heap_index;		// Position in wakeup heap (-1 = not scheduled)
+	TMDesc *hash_next;	// Next descriptor in the same hash bucket
 };
 
-const int NUM_DESCS = 64;		// Maximum number of descriptors
-static TMDesc desc[NUM_DESCS];
+// Descriptors hashed by TMTask address
+static vector<TMDesc *> desc_hash;
+static uint32 num_descs = 0;
+
+// Scheduled descriptors, binary min-heap ordered by wakeup time
+static vector<TMDesc *> wakeup_heap;
+
+// Expired tasks collected by TimerInterrupt(), reused across calls
+static vector<uint32> expired_tasks;
 
 
 /*
- *  Allocate descriptor for given TMTask in list
+ *  Descriptor hash table
  */
 
-static int alloc_desc(uint32 tm)
+inline static uint32 desc_hash_index(uint32 tm)
 {
-	// Search for first free descriptor
-	for (int i=0; i<NUM_DESCS; i++)
-		if (!desc[i].in_use) {
-			desc[i].task = tm;
-			desc[i].in_use = true;
-			return i;
+	// TMTasks are word aligned, desc_hash size is a power of two
+	uint32 h = (tm >> 1) * 0x9e3779b1;
+	return (h ^ (h >> 16)) & (desc_hash.size() - 1);
+}
+
+static void desc_hash_resize(uint32 size)
+{
+	vector<TMDesc *> old_hash(size, (TMDesc *)NULL);
+	old_hash.swap(desc_hash);
+	for (uint32 i = 0; i < old_hash.size(); i++) {
+		TMDesc *d = old_hash[i];
+		while (d) {
+			TMDesc *next = d->hash_next;
+			uint32 h = desc_hash_index(d->task);
+			d->hash_next = desc_hash[h];
+			desc_hash[h] = d;
+			d = next;
 		}
-	return -1;
+	}
+}
+
+
+/*
+ *  Wakeup heap
+ */
+
+inline static bool heap_less(int a, int b)
+{
+	return timer_cmp_time(wakeup_heap[a]->wakeup, wakeup_heap[b]->wakeup) < 0;
+}
+
+inline static void heap_swap(int a, int b)
+{
+	TMDesc *d = wakeup_heap[a];
+	wakeup_heap[a] = wakeup_heap[b];
+	wakeup_heap[b] = d;
+	wakeup_heap[a]->heap_index = a;
+	wakeup_heap[b]->heap_index = b;
+}
+
+static void heap_sift_up(int i)
+{
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		if (!heap_less(i, parent))
+			break;
+		heap_swap(i, parent);
+		i = parent;
+	}
+}
+
+static void heap_sift_down(int i)
+{
+	const int n = wakeup_heap.size();
+	for (;;) {
+		int child = 2 * i + 1;
+		if (child >= n)
+			break;
+		if (child + 1 < n && heap_less(child + 1, child))
+			child++;
+		if (!heap_less(child, i))
+			break;
+		heap_swap(i, child);
+		i = child;
+	}
+}
+
+// Insert descriptor into heap or move it after its wakeup time changed
+static void heap_schedule(TMDesc *desc)
+{
+	if (desc->heap_index < 0) {
+		desc->heap_index = wakeup_heap.size();
+		wakeup_heap.push_back(desc);
+	}
+	heap_sift_up(desc->heap_index);
+	heap_sift_down(desc->heap_index);
+}
+
+// Remove descriptor from heap (if it was scheduled)
+static void heap_unschedule(TMDesc *desc)
+{
+	int i = desc->heap_index;
+	if (i < 0)
+		return;
+	int last = wakeup_heap.size() - 1;
+	if (i != last)
+		heap_swap(i, last);
+	wakeup_heap.pop_back();
+	desc->heap_index = -1;
+	if (i != last) {
+		heap_sift_up(i);
+		heap_sift_down(i);
+	}
+}
+
+
+/*
+ *  Allocate descriptor for given TMTask
+ */
+
+static TMDesc *alloc_desc(uint32 tm)
+{
+	if (num_descs >= desc_hash.size())
+		desc_hash_resize(desc_hash.size() * 2);
+
+	TMDesc *desc = new TMDesc;
+	desc->task = tm;
+	desc->heap_index = -1;
+	uint32 h = desc_hash_index(tm);
+	desc->hash_next = desc_hash[h];
+	desc_hash[h] = desc;
+	num_descs++;
+	return desc;
 }
 
 
 /*
- *  Free descriptor in list
+ *  Free descriptor
  */
 
-inline static void free_desc(int i)
+static void free_desc(TMDesc *desc)
 {
-	desc[i].in_use = false;
+	heap_unschedule(desc);
+	TMDesc **p = &desc_hash[desc_hash_index(desc->task)];
+	while (*p != desc)
+		p = &(*p)->hash_next;
+	*p = desc->hash_next;
+	num_descs--;
+	delete desc;
 }
 
 
@@ -91,12 +213,24 @@ inline static void free_desc(int i)
  *  Find descriptor associated with given TMTask
  */
 
-inline static int find_desc(uint32 tm)
+inline static TMDesc *find_desc(uint32 tm)
 {
-	for (int i=0; i<NUM_DESCS; i++)
-		if (desc[i].in_use && desc[i].task == tm)
-			return i;
-	return -1;
+	for (TMDesc *d = desc_hash[desc_hash_index(tm)]; d; d = d->hash_next)
+		if (d->task == tm)
+			return d;
+	return NULL;
+}
+
+
+/*
+ *  Have the host trigger a Time Manager interrupt when the earliest task is due
+ */
+
+static void update_wakeup_time(void)
+{
+#if PRECISE_TIMING
+	timer_schedule_interrupt(wakeup_heap.empty() ? NULL : &wakeup_heap[0]->wakeup);
+#endif
 }
 
 
@@ -139,9 +273,8 @@ static void dequeue_tm(uint32 tm)
 
 void TimerInit(void)
 {
-	// Mark all descriptors as inactive
-	for (int i=0; i<NUM_DESCS; i++)
-		free_desc(i);
+	desc_hash_resize(64);
+	TimerReset();
 }
 
 
@@ -151,6 +284,7 @@ void TimerInit(void)
 
 void TimerExit(void)
 {
+	TimerReset();
 }
 
 
@@ -160,9 +294,18 @@ void TimerExit(void)
 
 void TimerReset(void)
 {
-	// Mark all descriptors as inactive
-	for (int i=0; i<NUM_DESCS; i++)
-		free_desc(i);
+	for (uint32 i = 0; i < desc_hash.size(); i++) {
+		TMDesc *d = desc_hash[i];
+		while (d) {
+			TMDesc *next = d->hash_next;
+			delete d;
+			d = next;
+		}
+		desc_hash[i] = NULL;
+	}
+	num_descs = 0;
+	wakeup_heap.clear();
+	update_wakeup_time();
 }
 
 
@@ -174,13 +317,10 @@ int16 InsTime(uint32 tm, uint16 trap)
 {
 	D(bug("InsTime %08lx, trap %04x\n", tm, trap));
 	WriteMacInt16(tm + qType, (ReadMacInt16(tm + qType) & 0x1fff) | ((trap << 4) & 0x6000));
-	if (find_desc(tm) >= 0)
-		printf("WARNING: InsTime(): Task re-inserted\n");
-	else {
-		int i = alloc_desc(tm);
-		if (i < 0)
-			printf("FATAL: InsTime(): No free Time Manager descriptor\n");
-	}
+	if (find_desc(tm))
+		printf("WARNING: InsTime(%08x): Task re-inserted\n", tm);
+	else
+		alloc_desc(tm);
 	return 0;
 }
 
@@ -194,8 +334,8 @@ int16 RmvTime(uint32 tm)
 	D(bug("RmvTime %08lx\n", tm));
 
 	// Find descriptor
-	int i = find_desc(tm);
-	if (i < 0) {
+	TMDesc *desc = find_desc(tm);
+	if (!desc) {
 		printf("WARNING: RmvTime(%08x): Descriptor not found\n", tm);
 		return 0;
 	}
@@ -210,14 +350,15 @@ int16 RmvTime(uint32 tm)
 		// Compute remaining time
 		tm_time_t remaining, current;
 		timer_current_time(current);
-		timer_sub_time(remaining, desc[i].wakeup, current);
+		timer_sub_time(remaining, desc->wakeup, current);
 		WriteMacInt32(tm + tmCount, timer_host2mac_time(remaining));
 	} else
 		WriteMacInt32(tm + tmCount, 0);
 	D(bug(" tmCount %d\n", ReadMacInt32(tm + tmCount)));
 
 	// Free descriptor
-	free_desc(i);
+	free_desc(desc);
+	update_wakeup_time();
 	return 0;
 }
 
@@ -231,9 +372,9 @@ int16 PrimeTime(uint32 tm, int32 time)
 	D(bug("PrimeTime %08x, time %d\n", tm, time));
 
 	// Find descriptor
-	int i = find_desc(tm);
-	if (i < 0) {
-		printf("FATAL: PrimeTime(): Descriptor not found\n");
+	TMDesc *desc = find_desc(tm);
+	if (!desc) {
+		printf("FATAL: PrimeTime(%08x): Descriptor not found\n", tm);
 		return 0;
 	}
 
@@ -254,15 +395,15 @@ int16 PrimeTime(uint32 tm, int32 time)
 
 			// Yes, calculate wakeup time relative to last scheduled time
 			tm_time_t wakeup;
-			timer_add_time(wakeup, desc[i].wakeup, delay);
-			desc[i].wakeup = wakeup;
+			timer_add_time(wakeup, desc->wakeup, delay);
+			desc->wakeup = wakeup;
 
 		} else {
 
 			// No, calculate wakeup time relative to current time
 			tm_time_t now;
 			timer_current_time(now);
-			timer_add_time(desc[i].wakeup, now, delay);
+			timer_add_time(desc->wakeup, now, delay);
 		}
 
 		// Set tmWakeUp to indicate that task was scheduled
@@ -273,44 +414,63 @@ int16 PrimeTime(uint32 tm, int32 time)
 		// Not extended task, calculate wakeup time relative to current time
 		tm_time_t delay;
 		timer_mac2host_time(delay, time);
-		timer_current_time(desc[i].wakeup);
-		timer_add_time(desc[i].wakeup, desc[i].wakeup, delay);
+		timer_current_time(desc->wakeup);
+		timer_add_time(desc->wakeup, desc->wakeup, delay);
 	}
 
 	// Make task active and enqueue it in the Time Manager queue
 	WriteMacInt16(tm + qType, ReadMacInt16(tm + qType) | 0x8000);
 	enqueue_tm(tm);
+	heap_schedule(desc);
+	update_wakeup_time();
 	return 0;
 }
 
 
 /*
- *  Timer interrupt function (executed as part of 60Hz interrupt)
+ *  Timer interrupt function (executed as part of 60Hz interrupt and
+ *  from the Time Manager interrupt)
  */
 
 void TimerInterrupt(void)
 {
-	// Look for active TMTasks that have expired
+	// Collect active TMTasks that have expired, earliest first
 	tm_time_t now;
 	timer_current_time(now);
-	for (int i=0; i<NUM_DESCS; i++)
-		if (desc[i].in_use) {
-			uint32 tm = desc[i].task;
-			if ((ReadMacInt16(tm + qType) & 0x8000) && timer_cmp_time(desc[i].wakeup, now) < 0) {
-
-				// Found one, mark as inactive and remove it from the Time Manager queue
-				WriteMacInt16(tm + qType, ReadMacInt16(tm + qType) & 0x7fff);
-				dequeue_tm(tm);
-
-				// Call timer function
-				uint32 addr = ReadMacInt32(tm + tmAddr);
-				if (addr) {
-					D(bug("Calling TimeTask %08lx, addr %08lx\n", tm, addr));
-					M68kRegisters r;
-					r.a[0] = addr;
-					r.a[1] = tm;
-					Execute68k(addr, &r);
-				}
+	// (a task function may re-enter, so only work on our part of the buffer)
+	const uint32 first = expired_tasks.size();
+	while (!wakeup_heap.empty() && timer_cmp_time(wakeup_heap[0]->wakeup, now) < 0) {
+		expired_tasks.push_back(wakeup_heap[0]->task);
+		heap_unschedule(wakeup_heap[0]);
+	}
+	const uint32 last = expired_tasks.size();
+
+	for (uint32 i = first; i < last; i++) {
+		uint32 tm = expired_tasks[i];
+
+		// Skip tasks removed or re-primed by an earlier task function
+		TMDesc *desc = find_desc(tm);
+		if (desc == NULL || desc->heap_index >= 0)
+			continue;
+
+		if (ReadMacInt16(tm + qType) & 0x8000) {
+
+			// Found one, mark as inactive and remove it from the Time Manager queue
+			WriteMacInt16(tm + qType, ReadMacInt16(tm + qType) & 0x7fff);
+			dequeue_tm(tm);
+
+			// Call timer function
+			uint32 addr = ReadMacInt32(tm + tmAddr);
+			if (addr) {
+				D(bug("Calling TimeTask %08lx, addr %08lx\n", tm, addr));
+				M68kRegisters r;
+				r.a[0] = addr;
+				r.a[1] = tm;
+				Execute68k(addr, &r);
 			}
 		}
+	}
+	expired_tasks.resize(first);
+
+	update_wakeup_time();
 }
@@ -62,6 +62,11 @@ int movem_next[256];
 
 cpuop_func *cpufunctbl[65536];
 
+/* Non-zero if the opcode may leave the sequential instruction stream, i.e.
+   it branches, traps or changes the status register. The interpreter only
+   checks spcflags after such instructions (basic block boundaries). */
+static uae_u8 cpuop_end_block[65536];
+
 #if FLIGHT_RECORDER
 struct rec_step {
 	uae_u32 pc;
@@ -202,6 +207,41 @@ void REGPARAM2 op_illg_1 (uae_u32 opcode)
 	op_illg (cft_map (opcode));
 }
 
+static bool opcode_ends_block (unsigned int opcode, unsigned int cpu_level)
+{
+	/* The 68000 tables check for address errors on every memory access */
+	if (cpu_level == 0)
+		return true;
+
+	if (cpufunctbl[cft_map (opcode)] == op_illg_1)
+		return true;
+
+	const struct instr *ip = &table68k[opcode];
+	if (ip->cflow != fl_normal || ip->plev != 0)
+		return true;
+
+	switch (ip->mnemo) {
+	case i_ILLG:
+	case i_TRAP:
+	case i_BKPT:
+	case i_CALLM:
+	case i_RTM:
+	case i_FPP:
+	case i_FScc:
+	case i_FSAVE:
+	case i_FRESTORE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void build_cpuop_end_block (unsigned int cpu_level)
+{
+	for (unsigned int opcode = 0; opcode < 65536; opcode++)
+		cpuop_end_block[cft_map (opcode)] = opcode_ends_block (opcode, cpu_level);
+}
+
 static void build_cpufunctbl (void)
 {
 	int i;
@@ -247,6 +287,7 @@ static void build_cpufunctbl (void)
 		if (tbl[i].specific)
 			cpufunctbl[cft_map (tbl[i].opcode)] = tbl[i].handler;
 	}
+	build_cpuop_end_block (cpu_level);
 }
 
 void init_m68k (void)
@@ -1369,12 +1410,29 @@ int m68k_do_specialties (void)
 void m68k_do_execute (void)
 {
 	for (;;) {
-		uae_u32 opcode = GET_OPCODE;
+		uae_u32 opcode;
+		if (SPCFLAGS_TEST(SPCFLAG_TRACE | SPCFLAG_DOTRACE)) {
+			// Tracing, check spcflags after every instruction
+			opcode = GET_OPCODE;
 #if FLIGHT_RECORDER
-		m68k_record_step(m68k_getpc());
+			m68k_record_step(m68k_getpc());
 #endif
-		(*cpufunctbl[opcode])(opcode);
-		cpu_check_ticks();
+			(*cpufunctbl[opcode])(opcode);
+			cpu_check_ticks();
+		}
+		else {
+			// Run up to the end of the basic block. Instructions in the
+			// middle can't set synchronous spcflags and asynchronous ones
+			// (interrupts) are recognized at the next block boundary
+			do {
+				opcode = GET_OPCODE;
+#if FLIGHT_RECORDER
+				m68k_record_step(m68k_getpc());
+#endif
+				(*cpufunctbl[opcode])(opcode);
+				cpu_check_ticks();
+			} while (!cpuop_end_block[opcode]);
+		}
 		if (SPCFLAGS_TEST(SPCFLAG_ALL_BUT_EXEC_RETURN)) {
 			if (m68k_do_specialties())
 				return;
@@ -692,6 +692,14 @@ void VideoInstallAccel(void)
 	}
 }
 
+void VideoSyncAccel(void)
+{
+}
+
+void VideoExitAccel(void)
+{
+}
+
 
 /*
  *  Change video mode
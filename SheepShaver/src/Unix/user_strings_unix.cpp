@@ -60,6 +60,8 @@ user_string_def platform_strings[] = {
 	{STR_AUDIO_FORMAT_WARN, "/dev/dsp doesn't support signed 16 bit format. Audio output will be disabled."},
 	{STR_SCSI_DEVICE_OPEN_WARN, "Cannot open %s (%s). SCSI Manager access to this device will be disabled."},
 	{STR_SCSI_DEVICE_NOT_SCSI_WARN, "%s doesn't seem to comply to the Generic SCSI API. SCSI Manager access to this device will be disabled."},
+	{STR_SCSI_IMAGE_INVALID_WARN, "%s is not a valid disk image. SCSI Manager access to this device will be disabled."},
+	{STR_SCSI_IMAGE_SIZE_WARN, "%s is too small to be used as a disk image. SCSI Manager access to this device will be disabled."},
 	{STR_KEYCODE_FILE_WARN, "Cannot open keycode translation file %s (%s)."},
 	{STR_KEYCODE_VENDOR_WARN, "Cannot find vendor '%s' in keycode translation file %s."},
 	{STR_PREFS_MENU_FILE_GTK, "/_File"},
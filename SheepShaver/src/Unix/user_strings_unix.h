@@ -53,6 +53,8 @@ enum {
 	STR_AUDIO_FORMAT_WARN,
 	STR_SCSI_DEVICE_OPEN_WARN,
 	STR_SCSI_DEVICE_NOT_SCSI_WARN,
+	STR_SCSI_IMAGE_INVALID_WARN,
+	STR_SCSI_IMAGE_SIZE_WARN,
 	STR_KEYCODE_FILE_WARN,
 	STR_KEYCODE_VENDOR_WARN,
 
@@ -20,6 +20,18 @@
 
 #include "sysdeps.h"
 
+#include <vector>
+
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 #include "prefs.h"
 #include "video.h"
 #include "video_defs.h"
@@ -52,6 +64,40 @@ static inline int bytes_per_pixel(int depth)
 	return bpp;
 }
 
+// Return mask of the bits that make the color of a pixel
+static inline uint32 pixel_value_mask(int depth)
+{
+	switch (depth) {
+	case 16:
+		return 0x7fff;
+	case 32:
+		return 0xffffff;
+	default:
+		return (1 << depth) - 1;
+	}
+}
+
+// Return pixel value of black (all bits set in indexed modes, clear in direct modes)
+static inline uint32 black_pixel(int depth)
+{
+	return depth <= 8 ? pixel_value_mask(depth) : 0;
+}
+
+// Return pixel value of white
+static inline uint32 white_pixel(int depth)
+{
+	return depth <= 8 ? 0 : pixel_value_mask(depth);
+}
+
+// Return a row buffer of at least the specified size
+static uint8 *get_row_buffer(uint32 size)
+{
+	static std::vector<uint8> row_buffer;
+	if (row_buffer.size() < size)
+		row_buffer.resize(size);
+	return &row_buffer[0];
+}
+
 // Pass-through dirty areas to redraw functions
 static inline void NQD_set_dirty_area(uint32 p)
 {
@@ -64,6 +110,87 @@ static inline void NQD_set_dirty_area(uint32 p)
 	}
 }
 
+// Operation decoded from a parameter block, so that it can be deferred
+enum {
+	NQD_OP_BITBLT,
+	NQD_OP_FILLRECT,
+	NQD_OP_INVRECT
+};
+
+struct accl_op {
+	int type;					// NQD_OP_*
+	int transfer_mode;
+	int depth;
+	uint32 color;				// Fill color, or transparent color (pen values)
+	uint32 src_base, dest_base;
+	int32 src_row_bytes, dest_row_bytes;
+	int16 src_X, src_Y, dest_X, dest_Y;
+	int16 width, height;
+};
+
+static void NQD_decode_op(accl_op &op, int type, uint32 p)
+{
+	op.type = type;
+	op.transfer_mode = ReadMacInt32(p + acclTransferMode);
+	op.depth = ReadMacInt32(p + acclDestPixelSize);
+	if (type == NQD_OP_FILLRECT)
+		op.color = ReadMacInt32(p + acclPenMode) == 8 ? ReadMacInt32(p + acclForePen) : ReadMacInt32(p + acclBackPen);
+	else
+		op.color = ReadMacInt32(p + acclBackPen);
+	op.src_base = ReadMacInt32(p + acclSrcBaseAddr);
+	op.src_row_bytes = (int32)ReadMacInt32(p + acclSrcRowBytes);
+	op.src_X = (int16)ReadMacInt16(p + acclSrcRect + 2) - (int16)ReadMacInt16(p + acclSrcBoundsRect + 2);
+	op.src_Y = (int16)ReadMacInt16(p + acclSrcRect + 0) - (int16)ReadMacInt16(p + acclSrcBoundsRect + 0);
+	op.dest_base = ReadMacInt32(p + acclDestBaseAddr);
+	op.dest_row_bytes = (int32)ReadMacInt32(p + acclDestRowBytes);
+	op.dest_X = (int16)ReadMacInt16(p + acclDestRect + 2) - (int16)ReadMacInt16(p + acclDestBoundsRect + 2);
+	op.dest_Y = (int16)ReadMacInt16(p + acclDestRect + 0) - (int16)ReadMacInt16(p + acclDestBoundsRect + 0);
+	op.width  = (int16)ReadMacInt16(p + acclDestRect + 6) - (int16)ReadMacInt16(p + acclDestRect + 2);
+	op.height = (int16)ReadMacInt16(p + acclDestRect + 4) - (int16)ReadMacInt16(p + acclDestRect + 0);
+}
+
+// Deferred operations (see below)
+static bool NQD_can_defer(uint32 p, int type);
+static void NQD_submit(const accl_op &op, bool deferred);
+static bool NQD_accept(uint32 p, int type, int selector);
+static bool NQD_reject(uint32 p);
+
+
+/*
+ *	Sub-byte pixel rows (1, 2 and 4-bit depths)
+ */
+
+static inline uint8 merge_bits(uint8 dest, uint8 mask, uint8 value, bool invert)
+{
+	return invert ? dest ^ mask : (dest & ~mask) | (value & mask);
+}
+
+// Fill (or invert) n_bits bits of a row, starting at bit dest_bit
+static void fill_bits(uint8 *dest, uint32 dest_bit, uint32 n_bits, uint8 value, bool invert)
+{
+	if (n_bits == 0)
+		return;
+
+	dest += dest_bit >> 3;
+	const uint32 end = (dest_bit & 7) + n_bits;
+	const uint32 n_bytes = (end + 7) >> 3;
+	const uint8 head_mask = 0xff >> (dest_bit & 7);
+	const uint8 tail_mask = 0xff << ((8 - (end & 7)) & 7);
+	if (n_bytes == 1) {
+		dest[0] = merge_bits(dest[0], head_mask & tail_mask, value, invert);
+		return;
+	}
+
+	dest[0] = merge_bits(dest[0], head_mask, value, invert);
+	if (invert) {
+		for (uint32 i = 1; i < n_bytes - 1; i++)
+			dest[i] = ~dest[i];
+	}
+	else
+		memset(dest + 1, value, n_bytes - 2);
+	dest[n_bytes - 1] = merge_bits(dest[n_bytes - 1], tail_mask, value, invert);
+}
+
 
 /*
  *	Rectangle inversion
@@ -136,24 +263,28 @@ static inline void do_invrect(uint8 *dest, uint32 length)
 #undef INVERT_8
 }
 
-void NQD_invrect(uint32 p)
+static void NQD_exec_invrect(const accl_op &op)
 {
-	D(bug("accl_invrect %08x\n", p));
-
-	// Get inversion parameters
-	int16 dest_X = (int16)ReadMacInt16(p + acclDestRect + 2) - (int16)ReadMacInt16(p + acclDestBoundsRect + 2);
-	int16 dest_Y = (int16)ReadMacInt16(p + acclDestRect + 0) - (int16)ReadMacInt16(p + acclDestBoundsRect + 0);
-	int16 width  = (int16)ReadMacInt16(p + acclDestRect + 6) - (int16)ReadMacInt16(p + acclDestRect + 2);
-	int16 height = (int16)ReadMacInt16(p + acclDestRect + 4) - (int16)ReadMacInt16(p + acclDestRect + 0);
-	D(bug(" dest X %d, dest Y %d\n", dest_X, dest_Y));
-	D(bug(" width %d, height %d, bytes_per_row %d\n", width, height, (int32)ReadMacInt32(p + acclDestRowBytes)));
+	D(bug(" dest X %d, dest Y %d\n", op.dest_X, op.dest_Y));
+	D(bug(" width %d, height %d, bytes_per_row %d\n", op.width, op.height, op.dest_row_bytes));
 
 	//!!?? pen_mode == 14
 
 	// And perform the inversion
-	const int bpp = bytes_per_pixel(ReadMacInt32(p + acclDestPixelSize));
-	const int dest_row_bytes = (int32)ReadMacInt32(p + acclDestRowBytes);
-	uint8 *dest = Mac2HostAddr(ReadMacInt32(p + acclDestBaseAddr) + (dest_Y * dest_row_bytes) + (dest_X * bpp));
+	const int depth = op.depth;
+	const int dest_row_bytes = op.dest_row_bytes;
+	const int height = op.height;
+	int width = op.width;
+	if (depth < 8) {
+		uint8 *dest = Mac2HostAddr(op.dest_base + (op.dest_Y * dest_row_bytes));
+		for (int i = 0; i < height; i++) {
+			fill_bits(dest, op.dest_X * depth, width * depth, 0, true);
+			dest += dest_row_bytes;
+		}
+		return;
+	}
+	const int bpp = bytes_per_pixel(depth);
+	uint8 *dest = Mac2HostAddr(op.dest_base + (op.dest_Y * dest_row_bytes) + (op.dest_X * bpp));
 	width *= bpp;
 	switch (bpp) {
 	case 1:
@@ -177,6 +308,15 @@ void NQD_invrect(uint32 p)
 	}
 }
 
+void NQD_invrect(uint32 p)
+{
+	D(bug("accl_invrect %08x\n", p));
+
+	accl_op op;
+	NQD_decode_op(op, NQD_OP_INVRECT, p);
+	NQD_submit(op, NQD_can_defer(p, NQD_OP_INVRECT));
+}
+
 
 /*
  *	Rectangle filling
@@ -250,24 +390,29 @@ static inline void do_fillrect(uint8 *dest, uint32 color, uint32 length)
 #undef FILL_8
 }
 
-void NQD_fillrect(uint32 p)
+static void NQD_exec_fillrect(const accl_op &op)
 {
-	D(bug("accl_fillrect %08x\n", p));
-
-	// Get filling parameters
-	int16 dest_X = (int16)ReadMacInt16(p + acclDestRect + 2) - (int16)ReadMacInt16(p + acclDestBoundsRect + 2);
-	int16 dest_Y = (int16)ReadMacInt16(p + acclDestRect + 0) - (int16)ReadMacInt16(p + acclDestBoundsRect + 0);
-	int16 width  = (int16)ReadMacInt16(p + acclDestRect + 6) - (int16)ReadMacInt16(p + acclDestRect + 2);
-	int16 height = (int16)ReadMacInt16(p + acclDestRect + 4) - (int16)ReadMacInt16(p + acclDestRect + 0);
-	uint32 color = htonl(ReadMacInt32(p + acclPenMode) == 8 ? ReadMacInt32(p + acclForePen) : ReadMacInt32(p + acclBackPen));
-	D(bug(" dest X %d, dest Y %d\n", dest_X, dest_Y));
-	D(bug(" width %d, height %d\n", width, height));
-	D(bug(" bytes_per_row %d color %08x\n", (int32)ReadMacInt32(p + acclDestRowBytes), color));
+	const uint32 color = htonl(op.color);
+	D(bug(" dest X %d, dest Y %d\n", op.dest_X, op.dest_Y));
+	D(bug(" width %d, height %d\n", op.width, op.height));
+	D(bug(" bytes_per_row %d color %08x\n", op.dest_row_bytes, color));
 
 	// And perform the fill
-	const int bpp = bytes_per_pixel(ReadMacInt32(p + acclDestPixelSize));
-	const int dest_row_bytes = (int32)ReadMacInt32(p + acclDestRowBytes);
-	uint8 *dest = Mac2HostAddr(ReadMacInt32(p + acclDestBaseAddr) + (dest_Y * dest_row_bytes) + (dest_X * bpp));
+	const int depth = op.depth;
+	const int dest_row_bytes = op.dest_row_bytes;
+	const int height = op.height;
+	int width = op.width;
+	if (depth < 8) {
+		// Pen values are replicated over 32 bits
+		uint8 *dest = Mac2HostAddr(op.dest_base + (op.dest_Y * dest_row_bytes));
+		for (int i = 0; i < height; i++) {
+			fill_bits(dest, op.dest_X * depth, width * depth, color, false);
+			dest += dest_row_bytes;
+		}
+		return;
+	}
+	const int bpp = bytes_per_pixel(depth);
+	uint8 *dest = Mac2HostAddr(op.dest_base + (op.dest_Y * dest_row_bytes) + (op.dest_X * bpp));
 	width *= bpp;
 	switch (bpp) {
 	case 1:
@@ -291,123 +436,678 @@ void NQD_fillrect(uint32 p)
 	}
 }
 
+void NQD_fillrect(uint32 p)
+{
+	D(bug("accl_fillrect %08x\n", p));
+
+	accl_op op;
+	NQD_decode_op(op, NQD_OP_FILLRECT, p);
+	NQD_submit(op, NQD_can_defer(p, NQD_OP_FILLRECT));
+}
+
 bool NQD_fillrect_hook(uint32 p)
 {
 	D(bug("accl_fillrect_hook %08x\n", p));
-	NQD_set_dirty_area(p);
 
 	// Check if we can accelerate this fillrect
-	if (ReadMacInt32(p + 0x284) != 0 && ReadMacInt32(p + acclDestPixelSize) >= 8) {
+	if (ReadMacInt32(p + 0x284) != 0 && ReadMacInt32(p + acclDestPixelSize) <= 32) {
 		const int transfer_mode = ReadMacInt32(p + acclTransferMode);
 		if (transfer_mode == 8) {
 			// Fill
-			WriteMacInt32(p + acclDrawProc, NativeTVECT(NATIVE_NQD_FILLRECT));
-			return true;
+			return NQD_accept(p, NQD_OP_FILLRECT, NATIVE_NQD_FILLRECT);
 		}
 		else if (transfer_mode == 10) {
 			// Invert
-			WriteMacInt32(p + acclDrawProc, NativeTVECT(NATIVE_NQD_INVRECT));
-			return true;
+			return NQD_accept(p, NQD_OP_INVRECT, NATIVE_NQD_INVRECT);
 		}
 	}
-	return false;
+	return NQD_reject(p);
 }
 
 
 /*
- *	Isomorphic rectangle blitting
+ *	Transfer modes
  */
 
-void NQD_bitblt(uint32 p)
+enum {
+	srcCopy			= 0,
+	srcOr			= 1,
+	srcXor			= 2,
+	srcBic			= 3,
+	notSrcCopy		= 4,
+	notSrcOr		= 5,
+	notSrcXor		= 6,
+	notSrcBic		= 7,
+	blend			= 32,
+	addPin			= 33,
+	addOver			= 34,
+	subPin			= 35,
+	transparent		= 36,
+	adMax			= 37,
+	subOver			= 38,
+	adMin			= 39,
+	hilite			= 50
+};
+
+/*
+  Boolean modes are defined in terms of black and white pixels: black
+  source pixels set, invert or clear the destination. Black is all ones in
+  indexed modes but all zeros in direct modes, so the latter use the dual
+  operation (e.g. srcOr is an AND of 16/32-bit pixel values).
+
+  blend, addPin, subPin and hilite depend on colors that are not found in
+  the parameter block (opColor, hilite color), and arithmetic modes need
+  color table lookups in indexed modes: these cases are still handled by
+  QuickDraw.
+*/
+
+
+/*
+ *	Row operations on bytes, vectorized where possible
+ */
+
+#if defined(__SSE2__)
+#define NQD_VECTOR 1
+typedef __m128i nqd_vec;
+static inline nqd_vec vec_load(const uint8 *p) { return _mm_loadu_si128((const __m128i *)p); }
+static inline void vec_store(uint8 *p, nqd_vec v) { _mm_storeu_si128((__m128i *)p, v); }
+static inline nqd_vec vec_select(nqd_vec m, nqd_vec a, nqd_vec b) { return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b)); }
+static inline nqd_vec vec_not(nqd_vec a) { return _mm_xor_si128(a, _mm_set1_epi32(-1)); }
+static inline nqd_vec vec_or(nqd_vec a, nqd_vec b) { return _mm_or_si128(a, b); }
+static inline nqd_vec vec_and(nqd_vec a, nqd_vec b) { return _mm_and_si128(a, b); }
+static inline nqd_vec vec_xor(nqd_vec a, nqd_vec b) { return _mm_xor_si128(a, b); }
+static inline nqd_vec vec_andnot(nqd_vec a, nqd_vec b) { return _mm_andnot_si128(a, b); }
+static inline nqd_vec vec_max(nqd_vec a, nqd_vec b) { return _mm_max_epu8(a, b); }
+static inline nqd_vec vec_min(nqd_vec a, nqd_vec b) { return _mm_min_epu8(a, b); }
+static inline nqd_vec vec_add(nqd_vec a, nqd_vec b) { return _mm_add_epi8(a, b); }
+static inline nqd_vec vec_sub(nqd_vec a, nqd_vec b) { return _mm_sub_epi8(a, b); }
+static inline nqd_vec vec_cmpeq_8(nqd_vec a, nqd_vec b) { return _mm_cmpeq_epi8(a, b); }
+static inline nqd_vec vec_cmpeq_16(nqd_vec a, nqd_vec b) { return _mm_cmpeq_epi16(a, b); }
+static inline nqd_vec vec_cmpeq_32(nqd_vec a, nqd_vec b) { return _mm_cmpeq_epi32(a, b); }
+static inline nqd_vec vec_set1_16(uint16 v) { return _mm_set1_epi16(v); }
+static inline nqd_vec vec_bswap_16(nqd_vec a) { return _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8)); }
+template< int n > static inline nqd_vec vec_shl_16(nqd_vec a) { return _mm_slli_epi16(a, n); }
+template< int n > static inline nqd_vec vec_shr_16(nqd_vec a) { return _mm_srli_epi16(a, n); }
+static inline nqd_vec vec_max_16(nqd_vec a, nqd_vec b) { return _mm_max_epi16(a, b); }	// on positive values
+static inline nqd_vec vec_min_16(nqd_vec a, nqd_vec b) { return _mm_min_epi16(a, b); }
+static inline nqd_vec vec_add_16(nqd_vec a, nqd_vec b) { return _mm_add_epi16(a, b); }
+static inline nqd_vec vec_sub_16(nqd_vec a, nqd_vec b) { return _mm_sub_epi16(a, b); }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define NQD_VECTOR 1
+typedef uint8x16_t nqd_vec;
+static inline nqd_vec vec_load(const uint8 *p) { return vld1q_u8(p); }
+static inline void vec_store(uint8 *p, nqd_vec v) { vst1q_u8(p, v); }
+static inline nqd_vec vec_select(nqd_vec m, nqd_vec a, nqd_vec b) { return vbslq_u8(m, a, b); }
+static inline nqd_vec vec_not(nqd_vec a) { return vmvnq_u8(a); }
+static inline nqd_vec vec_or(nqd_vec a, nqd_vec b) { return vorrq_u8(a, b); }
+static inline nqd_vec vec_and(nqd_vec a, nqd_vec b) { return vandq_u8(a, b); }
+static inline nqd_vec vec_xor(nqd_vec a, nqd_vec b) { return veorq_u8(a, b); }
+static inline nqd_vec vec_andnot(nqd_vec a, nqd_vec b) { return vbicq_u8(b, a); }
+static inline nqd_vec vec_max(nqd_vec a, nqd_vec b) { return vmaxq_u8(a, b); }
+static inline nqd_vec vec_min(nqd_vec a, nqd_vec b) { return vminq_u8(a, b); }
+static inline nqd_vec vec_add(nqd_vec a, nqd_vec b) { return vaddq_u8(a, b); }
+static inline nqd_vec vec_sub(nqd_vec a, nqd_vec b) { return vsubq_u8(a, b); }
+static inline nqd_vec vec_cmpeq_8(nqd_vec a, nqd_vec b) { return vceqq_u8(a, b); }
+static inline nqd_vec vec_cmpeq_16(nqd_vec a, nqd_vec b) { return vreinterpretq_u8_u16(vceqq_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b))); }
+static inline nqd_vec vec_cmpeq_32(nqd_vec a, nqd_vec b) { return vreinterpretq_u8_u32(vceqq_u32(vreinterpretq_u32_u8(a), vreinterpretq_u32_u8(b))); }
+static inline nqd_vec vec_set1_16(uint16 v) { return vreinterpretq_u8_u16(vdupq_n_u16(v)); }
+static inline nqd_vec vec_bswap_16(nqd_vec a) { return vrev16q_u8(a); }
+template< int n > static inline nqd_vec vec_shl_16(nqd_vec a) { return vreinterpretq_u8_u16(vshlq_n_u16(vreinterpretq_u16_u8(a), n)); }
+template< int n > static inline nqd_vec vec_shr_16(nqd_vec a) { return vreinterpretq_u8_u16(vshrq_n_u16(vreinterpretq_u16_u8(a), n)); }
+static inline nqd_vec vec_max_16(nqd_vec a, nqd_vec b) { return vreinterpretq_u8_u16(vmaxq_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b))); }
+static inline nqd_vec vec_min_16(nqd_vec a, nqd_vec b) { return vreinterpretq_u8_u16(vminq_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b))); }
+static inline nqd_vec vec_add_16(nqd_vec a, nqd_vec b) { return vreinterpretq_u8_u16(vaddq_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b))); }
+static inline nqd_vec vec_sub_16(nqd_vec a, nqd_vec b) { return vreinterpretq_u8_u16(vsubq_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b))); }
+#endif
+
+// Operations, as (source, destination) -> new destination
+#ifdef NQD_VECTOR
+#define DEFINE_BLIT_OP(NAME, SCALAR, VECTOR)														\
+struct blit_op_##NAME {																				\
+	static inline uint8 apply(uint8 s, uint8 d) { return SCALAR; }									\
+	static inline nqd_vec apply(nqd_vec s, nqd_vec d) { return VECTOR; }							\
+};
+// Arithmetic operations also work on 16-bit lanes (one component per lane)
+#define DEFINE_BLIT_ARITH_OP(NAME, SCALAR, VECTOR, VECTOR_16)										\
+struct blit_op_##NAME {																				\
+	static inline uint8 apply(uint8 s, uint8 d) { return SCALAR; }									\
+	static inline nqd_vec apply(nqd_vec s, nqd_vec d) { return VECTOR; }							\
+	static inline nqd_vec apply_16(nqd_vec s, nqd_vec d) { return VECTOR_16; }						\
+};
+#else
+#define DEFINE_BLIT_OP(NAME, SCALAR, VECTOR)														\
+struct blit_op_##NAME {																				\
+	static inline uint8 apply(uint8 s, uint8 d) { return SCALAR; }									\
+};
+#define DEFINE_BLIT_ARITH_OP(NAME, SCALAR, VECTOR, VECTOR_16)										\
+	DEFINE_BLIT_OP(NAME, SCALAR, VECTOR)
+#endif
+
+DEFINE_BLIT_OP(copy,	s,					s);
+DEFINE_BLIT_OP(not,		~s,					vec_not(s));
+DEFINE_BLIT_OP(or,		d | s,				vec_or(d, s));
+DEFINE_BLIT_OP(and,		d & s,				vec_and(d, s));
+DEFINE_BLIT_OP(xor,		d ^ s,				vec_xor(d, s));
+DEFINE_BLIT_OP(xnor,	d ^ ~s,				vec_not(vec_xor(d, s)));
+DEFINE_BLIT_OP(bic,		d & ~s,				vec_andnot(s, d));
+DEFINE_BLIT_OP(ornot,	d | ~s,				vec_or(d, vec_not(s)));
+DEFINE_BLIT_ARITH_OP(max,	d > s ? d : s,	vec_max(d, s),	vec_max_16(d, s));
+DEFINE_BLIT_ARITH_OP(min,	d < s ? d : s,	vec_min(d, s),	vec_min_16(d, s));
+DEFINE_BLIT_ARITH_OP(add,	d + s,			vec_add(d, s),	vec_add_16(d, s));
+DEFINE_BLIT_ARITH_OP(sub,	d - s,			vec_sub(d, s),	vec_sub_16(d, s));
+
+#undef DEFINE_BLIT_OP
+#undef DEFINE_BLIT_ARITH_OP
+
+// Per-blit constants: mask of the pixel bits to update, and transparent color
+// (16-byte patterns of pixels in Mac byte order)
+struct blit_pattern {
+	uint8 mask[16];
+	uint8 key[16];
+};
+
+typedef void (*blit_row_func)(uint8 *dest, const uint8 *src, uint32 length, const blit_pattern &pattern);
+
+// Boolean and arithmetic operations on 8-bit components
+template< class OP >
+static void blit_row(uint8 *dest, const uint8 *src, uint32 length, const blit_pattern &pattern)
 {
-	D(bug("accl_bitblt %08x\n", p));
+	uint32 i = 0;
+#ifdef NQD_VECTOR
+	const nqd_vec m = vec_load(pattern.mask);
+	for (; i + 16 <= length; i += 16) {
+		const nqd_vec d = vec_load(dest + i);
+		vec_store(dest + i, vec_select(m, OP::apply(vec_load(src + i), d), d));
+	}
+#endif
+	for (; i < length; i++) {
+		const uint8 m = pattern.mask[i & 15];
+		dest[i] = (OP::apply(src[i], dest[i]) & m) | (dest[i] & ~m);
+	}
+}
+
+// Arithmetic operations on 5-bit components (16-bit pixels)
+template< class OP >
+static void blit_row_555(uint8 *dest, const uint8 *src, uint32 length, const blit_pattern &pattern)
+{
+	uint32 i = 0;
+#ifdef NQD_VECTOR
+	const nqd_vec cmp_mask = vec_set1_16(0x1f);
+	const nqd_vec x_mask = vec_set1_16(0x8000);
+	for (; i + 16 <= length; i += 16) {
+		const nqd_vec s = vec_bswap_16(vec_load(src + i));
+		const nqd_vec d = vec_bswap_16(vec_load(dest + i));
+		const nqd_vec r = vec_and(OP::apply_16(vec_and(vec_shr_16<10>(s), cmp_mask), vec_and(vec_shr_16<10>(d), cmp_mask)), cmp_mask);
+		const nqd_vec g = vec_and(OP::apply_16(vec_and(vec_shr_16<5>(s), cmp_mask), vec_and(vec_shr_16<5>(d), cmp_mask)), cmp_mask);
+		const nqd_vec b = vec_and(OP::apply_16(vec_and(s, cmp_mask), vec_and(d, cmp_mask)), cmp_mask);
+		const nqd_vec v = vec_or(vec_or(vec_and(d, x_mask), vec_shl_16<10>(r)), vec_or(vec_shl_16<5>(g), b));
+		vec_store(dest + i, vec_bswap_16(v));
+	}
+#endif
+	for (; i < length; i += 2) {
+		const uint32 s = (src[i] << 8) | src[i + 1];
+		const uint32 d = (dest[i] << 8) | dest[i + 1];
+		const uint32 r = OP::apply((s >> 10) & 0x1f, (d >> 10) & 0x1f) & 0x1f;
+		const uint32 g = OP::apply((s >>  5) & 0x1f, (d >>  5) & 0x1f) & 0x1f;
+		const uint32 b = OP::apply( s        & 0x1f,  d        & 0x1f) & 0x1f;
+		const uint32 v = (d & 0x8000) | (r << 10) | (g << 5) | b;
+		dest[i] = v >> 8;
+		dest[i + 1] = v;
+	}
+}
+
+// Copy source pixels that are not of the transparent color
+template< int bpp >
+static void blit_row_transparent(uint8 *dest, const uint8 *src, uint32 length, const blit_pattern &pattern)
+{
+	uint32 i = 0;
+#ifdef NQD_VECTOR
+	const nqd_vec m = vec_load(pattern.mask);
+	const nqd_vec k = vec_load(pattern.key);
+	for (; i + 16 <= length; i += 16) {
+		const nqd_vec s = vec_load(src + i);
+		const nqd_vec v = vec_and(s, m);
+		const nqd_vec eq = bpp == 1 ? vec_cmpeq_8(v, k) : bpp == 2 ? vec_cmpeq_16(v, k) : vec_cmpeq_32(v, k);
+		vec_store(dest + i, vec_select(eq, vec_load(dest + i), s));
+	}
+#endif
+	for (; i < length; i += bpp) {
+		bool is_key = true;
+		for (int j = 0; j < bpp; j++)
+			is_key &= (src[i + j] & pattern.mask[j]) == pattern.key[j];
+		if (!is_key)
+			memcpy(dest + i, src + i, bpp);
+	}
+}
+
+// Find row function for the specified transfer mode and depth (NULL if not accelerated)
+static blit_row_func find_blitter(int transfer_mode, int depth)
+{
+	static const blit_row_func indexed_boolean[8] = {
+		blit_row<blit_op_copy>, blit_row<blit_op_or>, blit_row<blit_op_xor>, blit_row<blit_op_bic>,
+		blit_row<blit_op_not>, blit_row<blit_op_ornot>, blit_row<blit_op_xnor>, blit_row<blit_op_and>
+	};
+	static const blit_row_func direct_boolean[8] = {
+		blit_row<blit_op_copy>, blit_row<blit_op_and>, blit_row<blit_op_xnor>, blit_row<blit_op_ornot>,
+		blit_row<blit_op_not>, blit_row<blit_op_bic>, blit_row<blit_op_xor>, blit_row<blit_op_or>
+	};
+
+	if (transfer_mode >= srcCopy && transfer_mode <= notSrcBic)
+		return depth <= 8 ? indexed_boolean[transfer_mode] : direct_boolean[transfer_mode];
+
+	switch (depth) {
+	case 8:
+		if (transfer_mode == transparent)
+			return blit_row_transparent<1>;
+		break;
+	case 16:
+		switch (transfer_mode) {
+		case transparent:	return blit_row_transparent<2>;
+		case addOver:		return blit_row_555<blit_op_add>;
+		case subOver:		return blit_row_555<blit_op_sub>;
+		case adMax:			return blit_row_555<blit_op_max>;
+		case adMin:			return blit_row_555<blit_op_min>;
+		}
+		break;
+	case 32:
+		switch (transfer_mode) {
+		case transparent:	return blit_row_transparent<4>;
+		case addOver:		return blit_row<blit_op_add>;
+		case subOver:		return blit_row<blit_op_sub>;
+		case adMax:			return blit_row<blit_op_max>;
+		case adMin:			return blit_row<blit_op_min>;
+		}
+		break;
+	}
+	return NULL;
+}
+
+// Set up constants for blitting at the specified depth
+static void init_blit_pattern(blit_pattern &pattern, int depth, uint32 back_pen)
+{
+	const uint32 mask = pixel_value_mask(depth);
+	const uint32 key = back_pen & mask;
+	for (int i = 0; i < 16; i += 4) {
+		switch (depth) {
+		case 16:
+			pattern.mask[i + 0] = pattern.mask[i + 2] = mask >> 8;
+			pattern.mask[i + 1] = pattern.mask[i + 3] = mask;
+			pattern.key[i + 0] = pattern.key[i + 2] = key >> 8;
+			pattern.key[i + 1] = pattern.key[i + 3] = key;
+			break;
+		case 32:
+			pattern.mask[i + 0] = mask >> 24;
+			pattern.mask[i + 1] = mask >> 16;
+			pattern.mask[i + 2] = mask >> 8;
+			pattern.mask[i + 3] = mask;
+			pattern.key[i + 0] = key >> 24;
+			pattern.key[i + 1] = key >> 16;
+			pattern.key[i + 2] = key >> 8;
+			pattern.key[i + 3] = key;
+			break;
+		default:
+			// Sub-byte pixels are not told apart
+			memset(pattern.mask + i, 0xff, 4);
+			memset(pattern.key + i, key, 4);
+			break;
+		}
+	}
+}
+
+// Apply blitter to n_bits bits of a row, from bit src_bit of src to bit dest_bit of dest
+static void blit_bits(uint8 *dest, uint32 dest_bit, const uint8 *src, uint32 src_bit, uint32 n_bits, blit_row_func blit, const blit_pattern &pattern)
+{
+	if (n_bits == 0)
+		return;
+
+	// Byte aligned rows, only go through a copy of the source if it overlaps
+	if (((dest_bit | src_bit | n_bits) & 7) == 0) {
+		const uint32 length = n_bits >> 3;
+		dest += dest_bit >> 3;
+		src += src_bit >> 3;
+		if (src < dest + length && dest < src + length) {
+			uint8 *row = get_row_buffer(length);
+			memcpy(row, src, length);
+			src = row;
+		}
+		blit(dest, src, length, pattern);
+		return;
+	}
+
+	// Shift source bits in line with the destination ones
+	dest += dest_bit >> 3;
+	const uint32 lead = dest_bit & 7;
+	const uint32 end = lead + n_bits;
+	const uint32 n_bytes = (end + 7) >> 3;
+	uint8 *row = get_row_buffer(n_bytes);
+	const int32 first_src_byte = src_bit >> 3;
+	const int32 last_src_byte = (src_bit + n_bits - 1) >> 3;
+	const int32 src_start = int32(src_bit) - int32(lead);
+	const int shift = src_start & 7;
+	int32 b = src_start >> 3;
+	for (uint32 i = 0; i < n_bytes; i++, b++) {
+		const uint32 hi = (b >= first_src_byte && b <= last_src_byte) ? src[b] : 0;
+		const uint32 lo = (b + 1 >= first_src_byte && b + 1 <= last_src_byte) ? src[b + 1] : 0;
+		row[i] = ((hi << 8) | lo) >> (8 - shift);
+	}
+
+	// Keep the destination bits out of the span
+	const uint8 head = dest[0], tail = dest[n_bytes - 1];
+	blit(dest, row, n_bytes, pattern);
+	const uint8 head_mask = 0xff >> lead;
+	const uint8 tail_mask = 0xff << ((8 - (end & 7)) & 7);
+	dest[0] = (dest[0] & head_mask) | (head & ~head_mask);
+	dest[n_bytes - 1] = (dest[n_bytes - 1] & tail_mask) | (tail & ~tail_mask);
+}
+
 
+/*
+ *	Rectangle blitting
+ */
+
+static void NQD_exec_bitblt(const accl_op &op)
+{
 	// Get blitting parameters
-	int16 src_X  = (int16)ReadMacInt16(p + acclSrcRect + 2) - (int16)ReadMacInt16(p + acclSrcBoundsRect + 2);
-	int16 src_Y  = (int16)ReadMacInt16(p + acclSrcRect + 0) - (int16)ReadMacInt16(p + acclSrcBoundsRect + 0);
-	int16 dest_X = (int16)ReadMacInt16(p + acclDestRect + 2) - (int16)ReadMacInt16(p + acclDestBoundsRect + 2);
-	int16 dest_Y = (int16)ReadMacInt16(p + acclDestRect + 0) - (int16)ReadMacInt16(p + acclDestBoundsRect + 0);
-	int16 width  = (int16)ReadMacInt16(p + acclDestRect + 6) - (int16)ReadMacInt16(p + acclDestRect + 2);
-	int16 height = (int16)ReadMacInt16(p + acclDestRect + 4) - (int16)ReadMacInt16(p + acclDestRect + 0);
-	D(bug(" src addr %08x, dest addr %08x\n", ReadMacInt32(p + acclSrcBaseAddr), ReadMacInt32(p + acclDestBaseAddr)));
+	const int16 src_X = op.src_X, src_Y = op.src_Y;
+	const int16 dest_X = op.dest_X, dest_Y = op.dest_Y;
+	const int16 height = op.height;
+	int16 width = op.width;
+	const int depth = op.depth;
+	const int transfer_mode = op.transfer_mode;
+	D(bug(" src addr %08x, dest addr %08x\n", op.src_base, op.dest_base));
 	D(bug(" src X %d, src Y %d, dest X %d, dest Y %d\n", src_X, src_Y, dest_X, dest_Y));
-	D(bug(" width %d, height %d\n", width, height));
+	D(bug(" width %d, height %d, depth %d, transfer mode %d\n", width, height, depth, transfer_mode));
 
-	// And perform the blit
-	const int bpp = bytes_per_pixel(ReadMacInt32(p + acclSrcPixelSize));
-	width *= bpp;
-	if ((int32)ReadMacInt32(p + acclSrcRowBytes) > 0) {
-		const int src_row_bytes = (int32)ReadMacInt32(p + acclSrcRowBytes);
-		const int dst_row_bytes = (int32)ReadMacInt32(p + acclDestRowBytes);
-		uint8 *src = Mac2HostAddr(ReadMacInt32(p + acclSrcBaseAddr) + (src_Y * src_row_bytes) + (src_X * bpp));
-		uint8 *dst = Mac2HostAddr(ReadMacInt32(p + acclDestBaseAddr) + (dest_Y * dst_row_bytes) + (dest_X * bpp));
+	// Plain copies of whole bytes are memmove()s
+	if (transfer_mode == srcCopy && depth >= 8) {
+		const int bpp = bytes_per_pixel(depth);
+		width *= bpp;
+		if (op.src_row_bytes > 0) {
+			const int src_row_bytes = op.src_row_bytes;
+			const int dst_row_bytes = op.dest_row_bytes;
+			uint8 *src = Mac2HostAddr(op.src_base + (src_Y * src_row_bytes) + (src_X * bpp));
+			uint8 *dst = Mac2HostAddr(op.dest_base + (dest_Y * dst_row_bytes) + (dest_X * bpp));
+			for (int i = 0; i < height; i++) {
+				memmove(dst, src, width);
+				src += src_row_bytes;
+				dst += dst_row_bytes;
+			}
+		}
+		else {
+			const int src_row_bytes = -op.src_row_bytes;
+			const int dst_row_bytes = -op.dest_row_bytes;
+			uint8 *src = Mac2HostAddr(op.src_base + ((src_Y + height - 1) * src_row_bytes) + (src_X * bpp));
+			uint8 *dst = Mac2HostAddr(op.dest_base + ((dest_Y + height - 1) * dst_row_bytes) + (dest_X * bpp));
+			for (int i = height - 1; i >= 0; i--) {
+				memmove(dst, src, width);
+				src -= src_row_bytes;
+				dst -= dst_row_bytes;
+			}
+		}
+		return;
+	}
+
+	// Other transfer modes and sub-byte depths
+	blit_row_func blit = find_blitter(transfer_mode, depth);
+	if (blit == NULL)
+		return;
+	blit_pattern pattern;
+	init_blit_pattern(pattern, depth, op.color);
+	const uint32 src_bit = src_X * depth;
+	const uint32 dest_bit = dest_X * depth;
+	const uint32 n_bits = width * depth;
+	if (op.src_row_bytes > 0) {
+		const int src_row_bytes = op.src_row_bytes;
+		const int dst_row_bytes = op.dest_row_bytes;
+		uint8 *src = Mac2HostAddr(op.src_base + (src_Y * src_row_bytes));
+		uint8 *dst = Mac2HostAddr(op.dest_base + (dest_Y * dst_row_bytes));
 		for (int i = 0; i < height; i++) {
-			memmove(dst, src, width);
+			blit_bits(dst, dest_bit, src, src_bit, n_bits, blit, pattern);
 			src += src_row_bytes;
 			dst += dst_row_bytes;
 		}
 	}
 	else {
-		const int src_row_bytes = -(int32)ReadMacInt32(p + acclSrcRowBytes);
-		const int dst_row_bytes = -(int32)ReadMacInt32(p + acclDestRowBytes);
-		uint8 *src = Mac2HostAddr(ReadMacInt32(p + acclSrcBaseAddr) + ((src_Y + height - 1) * src_row_bytes) + (src_X * bpp));
-		uint8 *dst = Mac2HostAddr(ReadMacInt32(p + acclDestBaseAddr) + ((dest_Y + height - 1) * dst_row_bytes) + (dest_X * bpp));
+		const int src_row_bytes = -op.src_row_bytes;
+		const int dst_row_bytes = -op.dest_row_bytes;
+		uint8 *src = Mac2HostAddr(op.src_base + ((src_Y + height - 1) * src_row_bytes));
+		uint8 *dst = Mac2HostAddr(op.dest_base + ((dest_Y + height - 1) * dst_row_bytes));
 		for (int i = height - 1; i >= 0; i--) {
-			memmove(dst, src, width);
+			blit_bits(dst, dest_bit, src, src_bit, n_bits, blit, pattern);
 			src -= src_row_bytes;
 			dst -= dst_row_bytes;
 		}
 	}
 }
 
-/*
-  BitBlt transfer modes:
-  0 : srcCopy
-  1 : srcOr
-  2 : srcXor
-  3 : srcBic
-  4 : notSrcCopy
-  5 : notSrcOr
-  6 : notSrcXor
-  7 : notSrcBic
-  32 : blend
-  33 : addPin
-  34 : addOver
-  35 : subPin
-  36 : transparent
-  37 : adMax
-  38 : subOver
-  39 : adMin
-  50 : hilite
-*/
+void NQD_bitblt(uint32 p)
+{
+	D(bug("accl_bitblt %08x\n", p));
+
+	accl_op op;
+	NQD_decode_op(op, NQD_OP_BITBLT, p);
+	NQD_submit(op, NQD_can_defer(p, NQD_OP_BITBLT));
+}
 
 bool NQD_bitblt_hook(uint32 p)
 {
 	D(bug("accl_draw_hook %08x\n", p));
-	NQD_set_dirty_area(p);
 
 	// Check if we can accelerate this bitblt
 	if (ReadMacInt32(p + 0x018) + ReadMacInt32(p + 0x128) == 0 &&
 		ReadMacInt32(p + 0x130) == 0 &&
-		ReadMacInt32(p + acclSrcPixelSize) >= 8 &&
 		ReadMacInt32(p + acclSrcPixelSize) == ReadMacInt32(p + acclDestPixelSize) &&
 		(int32)(ReadMacInt32(p + acclSrcRowBytes) ^ ReadMacInt32(p + acclDestRowBytes)) >= 0 &&	// same sign?
-		ReadMacInt32(p + acclTransferMode) == 0 &&												// srcCopy?
 		(int32)ReadMacInt32(p + 0x15c) > 0) {
 
+		const int depth = ReadMacInt32(p + acclSrcPixelSize);
+		const int transfer_mode = ReadMacInt32(p + acclTransferMode);
+		if (depth > 32 || find_blitter(transfer_mode, depth) == NULL)
+			return NQD_reject(p);
+
+		// Boolean modes other than srcCopy colorize with non black & white pens
+		if (transfer_mode > srcCopy && transfer_mode <= notSrcBic) {
+			const uint32 mask = pixel_value_mask(depth);
+			if ((ReadMacInt32(p + acclForePen) & mask) != black_pixel(depth) ||
+				(ReadMacInt32(p + acclBackPen) & mask) != white_pixel(depth))
+				return NQD_reject(p);
+		}
+
 		// Yes, set function pointer
-		WriteMacInt32(p + acclDrawProc, NativeTVECT(NATIVE_NQD_BITBLT));
-		return true;
+		return NQD_accept(p, NQD_OP_BITBLT, NATIVE_NQD_BITBLT);
 	}
-	return false;
+	return NQD_reject(p);
 }
 
 // Unknown hook
 bool NQD_unknown_hook(uint32 arg)
 {
 	D(bug("accl_unknown_hook %08x\n", arg));
-	NQD_set_dirty_area(arg);
+	return NQD_reject(arg);
+}
 
+
+/*
+ *	Deferred operations
+ */
+
+/*
+  Operations drawing into the frame buffer are queued for a graphics thread,
+  so that MacOS keeps running while large blits and fills complete. QuickDraw
+  calls the sync hook before it touches pixels itself. Operations with an
+  offscreen source or destination are not deferred since applications may
+  access their pixels directly: they are executed in order after the queued
+  ones. The dirty areas of a batch of queued operations are published
+  together once it has been executed, so that the video refresh does not
+  pick them up before the pixels are drawn.
+*/
+
+static void NQD_exec(const accl_op &op)
+{
+	switch (op.type) {
+	case NQD_OP_BITBLT:
+		NQD_exec_bitblt(op);
+		break;
+	case NQD_OP_FILLRECT:
+		NQD_exec_fillrect(op);
+		break;
+	case NQD_OP_INVRECT:
+		NQD_exec_invrect(op);
+		break;
+	}
+}
+
+#ifdef HAVE_PTHREADS
+const int NQD_QUEUE_SIZE = 256;			// Must be a power of two
+const int NQD_MAX_DIRTY_AREAS = 8;		// Dirty rectangles published per batch
+
+static accl_op nqd_queue[NQD_QUEUE_SIZE];
+static uint32 nqd_queue_head = 0;		// Next operation to be queued
+static uint32 nqd_queue_tail = 0;		// Next operation to be completed
+static pthread_mutex_t nqd_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t nqd_queue_submitted = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t nqd_queue_completed = PTHREAD_COND_INITIALIZER;
+static pthread_t nqd_thread;
+static bool nqd_thread_active = false;
+static volatile bool nqd_thread_cancel = false;
+
+// Merge destination rectangles of a batch of operations into a few dirty areas
+static void NQD_publish_dirty_areas(uint32 first, uint32 last)
+{
+	struct dirty_area { int x0, y0, x1, y1; } areas[NQD_MAX_DIRTY_AREAS];
+	int n_areas = 0;
+	for (uint32 i = first; i != last; i++) {
+		const accl_op &op = nqd_queue[i & (NQD_QUEUE_SIZE - 1)];
+		const int x0 = op.dest_X, y0 = op.dest_Y;
+		const int x1 = x0 + op.width, y1 = y0 + op.height;
+		int j;
+		for (j = 0; j < n_areas; j++) {
+			dirty_area &a = areas[j];
+			if (x0 <= a.x1 && a.x0 <= x1 && y0 <= a.y1 && a.y0 <= y1)
+				break;
+		}
+		if (j == n_areas) {
+			if (n_areas < NQD_MAX_DIRTY_AREAS) {
+				dirty_area &a = areas[n_areas++];
+				a.x0 = x0; a.y0 = y0; a.x1 = x1; a.y1 = y1;
+				continue;
+			}
+			j = n_areas - 1;
+		}
+		dirty_area &a = areas[j];
+		if (x0 < a.x0) a.x0 = x0;
+		if (y0 < a.y0) a.y0 = y0;
+		if (x1 > a.x1) a.x1 = x1;
+		if (y1 > a.y1) a.y1 = y1;
+	}
+	for (int i = 0; i < n_areas; i++)
+		video_set_dirty_area(areas[i].x0, areas[i].y0, areas[i].x1 - areas[i].x0, areas[i].y1 - areas[i].y0);
+}
+
+// Graphics thread, executes queued operations
+static void *NQD_thread_func(void *arg)
+{
+	pthread_mutex_lock(&nqd_queue_lock);
+	for (;;) {
+		while (nqd_queue_tail == nqd_queue_head && !nqd_thread_cancel)
+			pthread_cond_wait(&nqd_queue_submitted, &nqd_queue_lock);
+		if (nqd_queue_tail == nqd_queue_head)
+			break;
+
+		// Execute all pending operations, the queue is only appended to meanwhile
+		const uint32 first = nqd_queue_tail, last = nqd_queue_head;
+		pthread_mutex_unlock(&nqd_queue_lock);
+		D(bug("accl_thread: %d operations\n", last - first));
+		for (uint32 i = first; i != last; i++)
+			NQD_exec(nqd_queue[i & (NQD_QUEUE_SIZE - 1)]);
+		NQD_publish_dirty_areas(first, last);
+		pthread_mutex_lock(&nqd_queue_lock);
+		nqd_queue_tail = last;
+		pthread_cond_broadcast(&nqd_queue_completed);
+	}
+	pthread_mutex_unlock(&nqd_queue_lock);
+	return NULL;
+}
+
+static bool NQD_start_thread(void)
+{
+	if (nqd_thread_active)
+		return true;
+	nqd_thread_cancel = false;
+	nqd_thread_active = (pthread_create(&nqd_thread, NULL, NQD_thread_func, NULL) == 0);
+	D(bug("accl_thread %s\n", nqd_thread_active ? "started" : "failed"));
+	return nqd_thread_active;
+}
+
+static void NQD_stop_thread(void)
+{
+	if (!nqd_thread_active)
+		return;
+	pthread_mutex_lock(&nqd_queue_lock);
+	nqd_thread_cancel = true;
+	pthread_cond_signal(&nqd_queue_submitted);
+	pthread_mutex_unlock(&nqd_queue_lock);
+	pthread_join(nqd_thread, NULL);
+	nqd_thread_active = false;
+}
+
+// Wait for all queued operations to complete
+static void NQD_sync(void)
+{
+	if (!nqd_thread_active)
+		return;
+	pthread_mutex_lock(&nqd_queue_lock);
+	while (nqd_queue_tail != nqd_queue_head)
+		pthread_cond_wait(&nqd_queue_completed, &nqd_queue_lock);
+	pthread_mutex_unlock(&nqd_queue_lock);
+}
+
+static void NQD_submit(const accl_op &op, bool deferred)
+{
+	if (!deferred) {
+		NQD_sync();
+		NQD_exec(op);
+		return;
+	}
+	pthread_mutex_lock(&nqd_queue_lock);
+	while (nqd_queue_head - nqd_queue_tail == NQD_QUEUE_SIZE)
+		pthread_cond_wait(&nqd_queue_completed, &nqd_queue_lock);
+	nqd_queue[nqd_queue_head & (NQD_QUEUE_SIZE - 1)] = op;
+	nqd_queue_head++;
+	pthread_cond_signal(&nqd_queue_submitted);
+	pthread_mutex_unlock(&nqd_queue_lock);
+}
+
+// Check whether the operation set up in the parameter block only touches the screen
+static bool NQD_can_defer(uint32 p, int type)
+{
+	return nqd_thread_active
+		&& ReadMacInt32(p + acclDestBaseAddr) == screen_base
+		&& (type != NQD_OP_BITBLT || ReadMacInt32(p + acclSrcBaseAddr) == screen_base);
+}
+#else
+static bool NQD_start_thread(void) { return false; }
+static void NQD_stop_thread(void) { }
+static void NQD_sync(void) { }
+static void NQD_submit(const accl_op &op, bool deferred) { NQD_exec(op); }
+static bool NQD_can_defer(uint32 p, int type) { return false; }
+#endif
+
+// Operation will be accelerated, set function pointer
+static bool NQD_accept(uint32 p, int type, int selector)
+{
+	// Dirty areas of deferred operations are published by the graphics thread
+	if (!NQD_can_defer(p, type))
+		NQD_set_dirty_area(p);
+	WriteMacInt32(p + acclDrawProc, NativeTVECT(selector));
+	return true;
+}
+
+// Operation will be drawn by QuickDraw, once queued operations completed
+static bool NQD_reject(uint32 p)
+{
+	NQD_set_dirty_area(p);
+	NQD_sync();
 	return false;
 }
 
@@ -415,9 +1115,22 @@ bool NQD_unknown_hook(uint32 arg)
 bool NQD_sync_hook(uint32 arg)
 {
 	D(bug("accl_sync_hook %08x\n", arg));
+	NQD_sync();
 	return true;
 }
 
+// Complete queued operations before the frame buffer changes
+void VideoSyncAccel(void)
+{
+	NQD_sync();
+}
+
+void VideoExitAccel(void)
+{
+	NQD_sync();
+	NQD_stop_thread();
+}
+
 
 /*
  *	Install Native QuickDraw acceleration hooks
@@ -430,6 +1143,10 @@ void VideoInstallAccel(void)
 		D(bug("Video: Installing acceleration hooks\n"));
 		uint32 base;
 
+		// Execute operations on the screen asynchronously
+		if (PrefsFindBool("gfxaccelasync"))
+			NQD_start_thread();
+
 		SheepVar bitblt_hook_info(sizeof(accl_hook_info));
 		base = bitblt_hook_info.addr();
 		WriteMacInt32(base + 0, NativeTVECT(NATIVE_NQD_BITBLT_HOOK));
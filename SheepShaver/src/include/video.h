@@ -138,6 +138,8 @@ extern bool VideoInit(void);
 extern void VideoExit(void);
 extern void VideoVBL(void);
 extern void VideoInstallAccel(void);
+extern void VideoSyncAccel(void);
+extern void VideoExitAccel(void);
 extern void VideoQuitFullScreen(void);
 
 extern void video_set_palette(void);
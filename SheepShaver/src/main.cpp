@@ -309,6 +309,7 @@ void ExitAll(void)
 	ADBExit();
 
 	// Exit video
+	VideoExitAccel();
 	VideoExit();
 
 	// Exit external file system
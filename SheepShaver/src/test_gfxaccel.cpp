@@ -0,0 +1,544 @@
+/*
+ *  test_gfxaccel.cpp - Check and time the Native QuickDraw acceleration
+ *
+ *  SheepShaver (C) 1997-2008 Marc Hellwig and Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  QuickDraw itself can't run without a ROM, so the accelerated bitblt,
+ *  fillrect and invrect operations are checked against a pixel by pixel
+ *  model of the transfer modes, for every depth, on random rectangles of
+ *  distinct and overlapping (scrolled) pixmaps. Blits of a full 1024x768
+ *  screen are then timed for each accelerated mode. Finally, sequences of
+ *  operations on the screen are run through the graphics thread queue.
+ *
+ *  Usage: test-gfxaccel [iterations]
+ */
+
+#include "sysdeps.h"
+
+#include <sys/time.h>
+
+#include "vm_alloc.h"
+#include "gfxaccel.cpp"
+
+// Environment of the acceleration hooks
+uint32 screen_base = 0;
+uintptr SheepMem::data = 0;
+uintptr SheepMem::proc = 0;
+
+uint32 NativeTVECT(int selector)
+{
+	return 0x1000 + selector;
+}
+
+void NQDMisc(uint32 arg1, uintptr arg2)
+{
+}
+
+void video_set_dirty_area(int x, int y, int w, int h)
+{
+}
+
+bool PrefsFindBool(const char *name)
+{
+	return false;
+}
+
+// Test pixmaps (in Mac memory)
+const int WIDTH = 1024;
+const int HEIGHT = 768;
+const uint32 ROW_BYTES = WIDTH * 4 + 32;
+const uint32 PIXMAP_SIZE = ROW_BYTES * HEIGHT;
+
+static uint32 params_base, src_base, dest_base, ref_base;
+
+// Checked rectangles lie in the first rows
+const int CHECK_HEIGHT = 160;
+const int MAX_SIZE = 96;
+const int CHECKS_PER_MODE = 200;
+
+static double get_time(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static uint32 random_state = 1;
+
+static uint32 random32(void)
+{
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 17;
+	random_state ^= random_state << 5;
+	return random_state;
+}
+
+
+/*
+ *	Reference model
+ */
+
+static uint32 get_pixel(uint32 base, int x, int y, int depth)
+{
+	uint8 *row = Mac2HostAddr(base + y * ROW_BYTES);
+	switch (depth) {
+	case 16:
+		return (row[x * 2] << 8) | row[x * 2 + 1];
+	case 32:
+		return (row[x * 4] << 24) | (row[x * 4 + 1] << 16) | (row[x * 4 + 2] << 8) | row[x * 4 + 3];
+	default: {
+		const int bit = x * depth;
+		return (row[bit >> 3] >> (8 - depth - (bit & 7))) & ((1 << depth) - 1);
+	}
+	}
+}
+
+static void set_pixel(uint32 base, int x, int y, int depth, uint32 v)
+{
+	uint8 *row = Mac2HostAddr(base + y * ROW_BYTES);
+	switch (depth) {
+	case 16:
+		row[x * 2] = v >> 8;
+		row[x * 2 + 1] = v;
+		break;
+	case 32:
+		row[x * 4] = v >> 24;
+		row[x * 4 + 1] = v >> 16;
+		row[x * 4 + 2] = v >> 8;
+		row[x * 4 + 3] = v;
+		break;
+	default: {
+		const int bit = x * depth;
+		const int shift = 8 - depth - (bit & 7);
+		const uint8 mask = ((1 << depth) - 1) << shift;
+		row[bit >> 3] = (row[bit >> 3] & ~mask) | ((v << shift) & mask);
+		break;
+	}
+	}
+}
+
+// Combine source and destination pixels as QuickDraw does
+static uint32 transfer_pixel(int mode, int depth, uint32 s, uint32 d, uint32 back_pen)
+{
+	const uint32 mask = pixel_value_mask(depth);
+	const uint32 bits = depth == 16 ? 0xffff : (depth == 32 ? 0xffffffff : mask);
+	if (mode == srcCopy)
+		return s;
+
+	if (mode <= notSrcBic) {
+		// Boolean modes: black source pixels ("ink") act on the destination
+		const uint32 invert = depth <= 8 ? 0 : mask;
+		const uint32 si = (s ^ invert) & mask, di = (d ^ invert) & mask;
+		uint32 r = 0;
+		switch (mode) {
+		case srcOr:			r = di | si;	break;
+		case srcXor:		r = di ^ si;	break;
+		case srcBic:		r = di & ~si;	break;
+		case notSrcCopy:	r = ~si;		break;
+		case notSrcOr:		r = di | ~si;	break;
+		case notSrcXor:		r = di ^ ~si;	break;
+		case notSrcBic:		r = di & si;	break;
+		}
+		return (d & ~mask & bits) | ((r ^ invert) & mask);
+	}
+
+	if (mode == transparent)
+		return (s & mask) == (back_pen & mask) ? d : s;
+
+	// Arithmetic modes, on each component
+	const int cmp_size = depth == 16 ? 5 : 8;
+	const uint32 cmp_mask = (1 << cmp_size) - 1;
+	uint32 r = d & ~mask & bits;
+	for (int c = 0; c < 3; c++) {
+		const int shift = c * cmp_size;
+		const uint32 sc = (s >> shift) & cmp_mask, dc = (d >> shift) & cmp_mask;
+		uint32 rc = 0;
+		switch (mode) {
+		case addOver:	rc = dc + sc;				break;
+		case subOver:	rc = dc - sc;				break;
+		case adMax:		rc = dc > sc ? dc : sc;		break;
+		case adMin:		rc = dc < sc ? dc : sc;		break;
+		}
+		r |= (rc & cmp_mask) << shift;
+	}
+	return r;
+}
+
+
+/*
+ *	Parameter blocks
+ */
+
+static void set_rect(uint32 addr, int top, int left, int bottom, int right)
+{
+	WriteMacInt16(addr + 0, top);
+	WriteMacInt16(addr + 2, left);
+	WriteMacInt16(addr + 4, bottom);
+	WriteMacInt16(addr + 6, right);
+}
+
+static void init_params(uint32 p, int depth, int transfer_mode, uint32 fore_pen, uint32 back_pen,
+						uint32 src, int src_x, int src_y, uint32 dest, int dest_x, int dest_y, int w, int h)
+{
+	Mac_memset(p, 0, sizeof(accl_params));
+	WriteMacInt32(p + 0x15c, 1);
+	WriteMacInt32(p + 0x284, 1);
+	WriteMacInt32(p + acclTransferMode, transfer_mode);
+	WriteMacInt32(p + acclForePen, fore_pen);
+	WriteMacInt32(p + acclBackPen, back_pen);
+
+	// Scroll down with a negative row bytes value, as QuickDraw does
+	const int32 row_bytes = (src == dest && dest_y > src_y) ? -(int32)ROW_BYTES : ROW_BYTES;
+	WriteMacInt32(p + acclSrcBaseAddr, src);
+	WriteMacInt32(p + acclSrcRowBytes, row_bytes);
+	WriteMacInt32(p + acclSrcPixelSize, depth);
+	WriteMacInt32(p + acclDestBaseAddr, dest);
+	WriteMacInt32(p + acclDestRowBytes, row_bytes);
+	WriteMacInt32(p + acclDestPixelSize, depth);
+
+	// Pixmap bounds don't start at (0, 0) to check their handling
+	set_rect(p + acclSrcBoundsRect, -10, -20, HEIGHT - 10, WIDTH - 20);
+	set_rect(p + acclDestBoundsRect, 30, 40, HEIGHT + 30, WIDTH + 40);
+	set_rect(p + acclSrcRect, src_y - 10, src_x - 20, src_y - 10 + h, src_x - 20 + w);
+	set_rect(p + acclDestRect, dest_y + 30, dest_x + 40, dest_y + 30 + h, dest_x + 40 + w);
+}
+
+static uint32 pen_value(int depth, uint32 v)
+{
+	// Pen values are replicated over 32 bits
+	v &= pixel_value_mask(depth);
+	for (int d = depth; d < 32; d *= 2)
+		v |= v << d;
+	return v;
+}
+
+static const char *mode_name(int mode)
+{
+	switch (mode) {
+	case srcCopy:		return "srcCopy";
+	case srcOr:			return "srcOr";
+	case srcXor:		return "srcXor";
+	case srcBic:		return "srcBic";
+	case notSrcCopy:	return "notSrcCopy";
+	case notSrcOr:		return "notSrcOr";
+	case notSrcXor:		return "notSrcXor";
+	case notSrcBic:		return "notSrcBic";
+	case addOver:		return "addOver";
+	case transparent:	return "transparent";
+	case adMax:			return "adMax";
+	case subOver:		return "subOver";
+	case adMin:			return "adMin";
+	}
+	return "?";
+}
+
+static void randomize_pixmap(uint32 base, int depth)
+{
+	uint8 *p = Mac2HostAddr(base);
+	const bool repeat = depth > 8 && (random32() & 1);
+	for (uint32 i = 0; i < CHECK_HEIGHT * ROW_BYTES; i += 4) {
+		// Make transparent pixels and equal components frequent
+		if (repeat && (random32() & 3) == 0)
+			memcpy(p + i, p, 4);
+		else {
+			const uint32 v = random32();
+			memcpy(p + i, &v, 4);
+		}
+	}
+}
+
+
+/*
+ *	Checks
+ */
+
+
+static bool check_blit(int depth, int mode)
+{
+	const int pixels_per_row = ROW_BYTES * 8 / depth;
+	const int max_width = pixels_per_row < WIDTH ? pixels_per_row : WIDTH;
+	for (int n = 0; n < CHECKS_PER_MODE; n++) {
+		const int w = 1 + random32() % MAX_SIZE, h = 1 + random32() % MAX_SIZE;
+		const int src_x = random32() % (max_width - w), src_y = random32() % (CHECK_HEIGHT - h);
+		int dest_x = random32() % (max_width - w), dest_y = random32() % (CHECK_HEIGHT - h);
+		const bool scroll = (n & 1) != 0;
+		if (scroll) {
+			// Overlapping rectangles of the same pixmap
+			dest_x = src_x + random32() % 17 - 8;
+			dest_y = src_y + random32() % 9 - 4;
+			if (dest_x < 0 || dest_x + w > max_width)
+				dest_x = src_x;
+			if (dest_y < 0 || dest_y + h > CHECK_HEIGHT)
+				dest_y = src_y;
+		}
+
+		randomize_pixmap(src_base, depth);
+		randomize_pixmap(dest_base, depth);
+		const uint32 src = scroll ? dest_base : src_base;
+		const uint32 mask = pixel_value_mask(depth);
+		uint32 fore_pen = pen_value(depth, black_pixel(depth)), back_pen = pen_value(depth, white_pixel(depth));
+		if (mode == transparent)
+			back_pen = pen_value(depth, get_pixel(src, 0, 0, depth) & mask);
+
+		// Expected result
+		Mac2Mac_memcpy(ref_base, dest_base, PIXMAP_SIZE);
+		for (int y = 0; y < h; y++)
+			for (int x = 0; x < w; x++) {
+				const uint32 s = get_pixel(src, src_x + x, src_y + y, depth);
+				const uint32 d = get_pixel(dest_base, dest_x + x, dest_y + y, depth);
+				set_pixel(ref_base, dest_x + x, dest_y + y, depth, transfer_pixel(mode, depth, s, d, back_pen));
+			}
+
+		init_params(params_base, depth, mode, fore_pen, back_pen, src, src_x, src_y, dest_base, dest_x, dest_y, w, h);
+		if (!NQD_bitblt_hook(params_base)) {
+			printf("  %d-bit %s not accelerated\n", depth, mode_name(mode));
+			return false;
+		}
+		NQD_bitblt(params_base);
+		if (memcmp(Mac2HostAddr(ref_base), Mac2HostAddr(dest_base), PIXMAP_SIZE) != 0) {
+			printf("  %d-bit %s MISMATCH, %dx%d from (%d,%d) to (%d,%d)%s\n", depth, mode_name(mode),
+				   w, h, src_x, src_y, dest_x, dest_y, scroll ? " (scroll)" : "");
+			return false;
+		}
+	}
+
+	// Colorized boolean modes are left to QuickDraw (pens are always black and white in 1-bit mode)
+	if (mode > srcCopy && mode <= notSrcBic && depth > 1) {
+		init_params(params_base, depth, mode, pen_value(depth, 1), pen_value(depth, 2), src_base, 0, 0, dest_base, 0, 0, 8, 8);
+		if (NQD_bitblt_hook(params_base)) {
+			printf("  %d-bit colorized %s accelerated\n", depth, mode_name(mode));
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool check_fill(int depth, bool invert)
+{
+	const int pixels_per_row = ROW_BYTES * 8 / depth;
+	const int max_width = pixels_per_row < WIDTH ? pixels_per_row : WIDTH;
+	for (int n = 0; n < CHECKS_PER_MODE; n++) {
+		const int w = 1 + random32() % MAX_SIZE, h = 1 + random32() % MAX_SIZE;
+		const int x0 = random32() % (max_width - w), y0 = random32() % (CHECK_HEIGHT - h);
+		const uint32 color = random32() & pixel_value_mask(depth);
+
+		randomize_pixmap(dest_base, depth);
+		Mac2Mac_memcpy(ref_base, dest_base, PIXMAP_SIZE);
+		for (int y = 0; y < h; y++)
+			for (int x = 0; x < w; x++) {
+				const uint32 d = get_pixel(dest_base, x0 + x, y0 + y, depth);
+				uint32 v = pen_value(depth, color) >> (32 - (depth == 32 ? 32 : depth == 16 ? 16 : depth));
+				if (invert)
+					v = depth == 16 ? d ^ 0xffff : depth == 32 ? ~d : d ^ pixel_value_mask(depth);
+				set_pixel(ref_base, x0 + x, y0 + y, depth, v);
+			}
+
+		init_params(params_base, depth, invert ? 10 : 8, pen_value(depth, color), 0, 0, 0, 0, dest_base, x0, y0, w, h);
+		WriteMacInt32(params_base + acclPenMode, 8);
+		if (!NQD_fillrect_hook(params_base)) {
+			printf("  %d-bit %s not accelerated\n", depth, invert ? "invert" : "fill");
+			return false;
+		}
+		if (invert)
+			NQD_invrect(params_base);
+		else
+			NQD_fillrect(params_base);
+		if (memcmp(Mac2HostAddr(ref_base), Mac2HostAddr(dest_base), PIXMAP_SIZE) != 0) {
+			printf("  %d-bit %s MISMATCH, %dx%d at (%d,%d)\n", depth, invert ? "invert" : "fill", w, h, x0, y0);
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool check_queue(int depth)
+{
+	const int pixels_per_row = ROW_BYTES * 8 / depth;
+	const int max_width = pixels_per_row < WIDTH ? pixels_per_row : WIDTH;
+	static const int modes[] = { srcCopy, srcXor, srcBic, notSrcCopy };
+	std::vector<uint32> pixels;
+
+	randomize_pixmap(src_base, depth);
+	randomize_pixmap(dest_base, depth);
+	Mac2Mac_memcpy(ref_base, dest_base, PIXMAP_SIZE);
+	screen_base = dest_base;
+	for (int n = 0; n < CHECKS_PER_MODE; n++) {
+		const int w = 1 + random32() % MAX_SIZE, h = 1 + random32() % MAX_SIZE;
+		const int x0 = random32() % (max_width - w), y0 = random32() % (CHECK_HEIGHT - h);
+		const int type = random32() % 4;
+		if (type < 2) {
+			// Fill or invert
+			const bool invert = type == 1;
+			const uint32 color = random32() & pixel_value_mask(depth);
+			for (int y = 0; y < h; y++)
+				for (int x = 0; x < w; x++) {
+					const uint32 d = get_pixel(ref_base, x0 + x, y0 + y, depth);
+					uint32 v = pen_value(depth, color) >> (32 - (depth == 32 ? 32 : depth == 16 ? 16 : depth));
+					if (invert)
+						v = depth == 16 ? d ^ 0xffff : depth == 32 ? ~d : d ^ pixel_value_mask(depth);
+					set_pixel(ref_base, x0 + x, y0 + y, depth, v);
+				}
+			init_params(params_base, depth, invert ? 10 : 8, pen_value(depth, color), 0, 0, 0, 0, dest_base, x0, y0, w, h);
+			WriteMacInt32(params_base + acclPenMode, 8);
+			if (!NQD_fillrect_hook(params_base))
+				break;
+			if (invert)
+				NQD_invrect(params_base);
+			else
+				NQD_fillrect(params_base);
+		}
+		else {
+			// Scroll on the screen, or blit from an offscreen pixmap (executed after the queue)
+			const bool scroll = type == 2;
+			const int mode = modes[random32() % 4];
+			int src_x = random32() % (max_width - w), src_y = random32() % (CHECK_HEIGHT - h);
+			if (scroll) {
+				src_x = x0 + random32() % 17 - 8;
+				src_y = y0 + random32() % 9 - 4;
+				if (src_x < 0 || src_x + w > max_width)
+					src_x = x0;
+				if (src_y < 0 || src_y + h > CHECK_HEIGHT)
+					src_y = y0;
+			}
+			pixels.resize(w * h);
+			for (int y = 0; y < h; y++)
+				for (int x = 0; x < w; x++) {
+					const uint32 s = get_pixel(scroll ? ref_base : src_base, src_x + x, src_y + y, depth);
+					const uint32 d = get_pixel(ref_base, x0 + x, y0 + y, depth);
+					pixels[y * w + x] = transfer_pixel(mode, depth, s, d, 0);
+				}
+			for (int y = 0; y < h; y++)
+				for (int x = 0; x < w; x++)
+					set_pixel(ref_base, x0 + x, y0 + y, depth, pixels[y * w + x]);
+			init_params(params_base, depth, mode, pen_value(depth, black_pixel(depth)), pen_value(depth, white_pixel(depth)),
+						scroll ? dest_base : src_base, src_x, src_y, dest_base, x0, y0, w, h);
+			if (!NQD_bitblt_hook(params_base))
+				break;
+			NQD_bitblt(params_base);
+		}
+	}
+	NQD_sync_hook(0);
+	screen_base = 0;
+	if (memcmp(Mac2HostAddr(ref_base), Mac2HostAddr(dest_base), PIXMAP_SIZE) != 0) {
+		printf("  %d-bit queued operations MISMATCH\n", depth);
+		return false;
+	}
+	return true;
+}
+
+static double time_blit(int depth, int mode, int iterations)
+{
+	init_params(params_base, depth, mode, pen_value(depth, black_pixel(depth)), pen_value(depth, white_pixel(depth)),
+				src_base, 0, 0, dest_base, 0, 0, WIDTH, HEIGHT);
+	NQD_bitblt(params_base);
+	const double start = get_time();
+	for (int i = 0; i < iterations; i++)
+		NQD_bitblt(params_base);
+	return (get_time() - start) * 1e3 / iterations;
+}
+
+int main(int argc, char *argv[])
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 50;
+	if (iterations <= 0)
+		iterations = 1;
+
+	// Mac addresses are 32-bit
+	vm_init();
+	const uint32 size = 0x100000 + 3 * PIXMAP_SIZE;
+#if DIRECT_ADDRESSING
+	const uint32 base = 0x10000000;
+	if (vm_acquire_fixed(Mac2HostAddr(base), size) < 0) {
+#else
+	void *mem = vm_acquire(size, VM_MAP_DEFAULT | VM_MAP_32BIT);
+	const uint32 base = mem == VM_MAP_FAILED ? 0 : Host2MacAddr((uint8 *)mem);
+	if (mem == VM_MAP_FAILED) {
+#endif
+		fprintf(stderr, "Not enough memory\n");
+		return 1;
+	}
+	params_base = base;
+	src_base = base + 0x100000;
+	dest_base = src_base + PIXMAP_SIZE;
+	ref_base = dest_base + PIXMAP_SIZE;
+
+	static const int modes[] = {
+		srcCopy, srcOr, srcXor, srcBic, notSrcCopy, notSrcOr, notSrcXor, notSrcBic,
+		transparent, addOver, subOver, adMax, adMin
+	};
+	const int n_modes = sizeof(modes) / sizeof(modes[0]);
+
+	int errors = 0;
+	for (int depth = 1; depth <= 32; depth *= 2) {
+		printf("%d-bit\n", depth);
+		for (int i = 0; i < n_modes; i++) {
+			const int mode = modes[i];
+			if (find_blitter(mode, depth) == NULL) {
+				// Must be left to QuickDraw
+				init_params(params_base, depth, mode, 0, 0, src_base, 0, 0, dest_base, 0, 0, 8, 8);
+				if (NQD_bitblt_hook(params_base)) {
+					printf("  %d-bit %s accelerated without blitter\n", depth, mode_name(mode));
+					errors++;
+				}
+				continue;
+			}
+			if (!check_blit(depth, mode)) {
+				errors++;
+				continue;
+			}
+			printf("  %-12s %8.3f ms/frame\n", mode_name(mode), time_blit(depth, mode, iterations));
+		}
+		if (!check_fill(depth, false))
+			errors++;
+		if (!check_fill(depth, true))
+			errors++;
+	}
+
+	// Same checks through the graphics thread
+	if (!NQD_start_thread()) {
+		printf("Graphics thread not available\n");
+		errors++;
+	}
+	else {
+		printf("Queued operations\n");
+		for (int depth = 1; depth <= 32; depth *= 2) {
+			if (!check_queue(depth))
+				errors++;
+		}
+
+		// Emulation thread time for full screen fills, then time until completion
+		screen_base = dest_base;
+		init_params(params_base, 32, 8, 0x00ff8040, 0, 0, 0, 0, dest_base, 0, 0, WIDTH, HEIGHT);
+		WriteMacInt32(params_base + acclPenMode, 8);
+		double start = get_time();
+		for (int i = 0; i < iterations; i++)
+			NQD_fillrect(params_base);
+		const double submitted = (get_time() - start) * 1e3 / iterations;
+		NQD_sync_hook(0);
+		const double completed = (get_time() - start) * 1e3 / iterations;
+		screen_base = 0;
+		printf("  32-bit fills %8.3f ms/frame submitted, %8.3f ms/frame completed\n", submitted, completed);
+		VideoExitAccel();
+	}
+
+	printf(errors ? "%d errors\n" : "All tests passed\n", errors);
+	vm_release(Mac2HostAddr(base), size);
+	vm_exit();
+	return errors ? 1 : 0;
+}
@@ -321,6 +321,7 @@ static int16 VideoControl(uint32 pb, VidLocals *csSave)
 			D(bug("mode:%04x page:%04x \n", ReadMacInt16(param + csMode),
 				ReadMacInt16(param + csPage)));
 			WriteMacInt32(param + csData, csSave->saveData);
+			VideoSyncAccel();
 			return video_mode_change(csSave, param);
 
 		case cscSetEntries: {							// SetEntries
@@ -459,6 +460,7 @@ static int16 VideoControl(uint32 pb, VidLocals *csSave)
 		case cscSwitchMode:
 			D(bug("cscSwitchMode (Display Manager support) \nMode:%02x ID:%04x Page:%d\n",
 			  ReadMacInt16(param + csMode), ReadMacInt32(param + csData), ReadMacInt16(param + csPage)));
+			VideoSyncAccel();
 			return video_mode_change(csSave, param);
 
 		case cscSavePreferredConfiguration: